@@ -27,6 +27,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "CameraARCore.h"
 #include "util.h"
+#include "yuv_to_bgr.h"
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/core/util3d_transforms.h"
 #include "rtabmap/core/OdometryEvent.h"
@@ -170,6 +171,8 @@ bool CameraARCore::init(const std::string & calibrationFolder, const std::string
     }
 
     ArConfig_setFocusMode(arSession_, arConfig_, AR_FOCUS_MODE_FIXED);
+    // Horizontal planes seed the ground reference of the volumes
+    ArConfig_setPlaneFindingMode(arSession_, arConfig_, AR_PLANE_FINDING_MODE_HORIZONTAL);
     UASSERT(ArSession_configure(arSession_, arConfig_) == AR_SUCCESS);
 
     ArFrame_create(arSession_, &arFrame_);
@@ -358,6 +361,60 @@ SensorData CameraARCore::updateDataOnRender(Transform & pose)
             return data;
         }
 
+        // Upward facing planes, updated only if some changed in this frame
+        ArTrackableList * planeList = nullptr;
+        ArTrackableList_create(arSession_, &planeList);
+        ArFrame_getUpdatedTrackables(arSession_, arFrame_, AR_TRACKABLE_PLANE, planeList);
+        int32_t planeCount = 0;
+        ArTrackableList_getSize(arSession_, planeList, &planeCount);
+        if(planeCount > 0)
+        {
+            ArSession_getAllTrackables(arSession_, AR_TRACKABLE_PLANE, planeList);
+            ArTrackableList_getSize(arSession_, planeList, &planeCount);
+            std::vector<DetectedPlane> planes;
+            ArPose * planePose = nullptr;
+            ArPose_create(arSession_, nullptr, &planePose);
+            for(int i=0; i<planeCount; ++i)
+            {
+                ArTrackable * trackable = nullptr;
+                ArTrackableList_acquireItem(arSession_, planeList, i, &trackable);
+                ::ArPlane * plane = ArAsPlane(trackable);
+                ArTrackingState trackingState;
+                ArTrackable_getTrackingState(arSession_, trackable, &trackingState);
+                ::ArPlane * subsumedBy = nullptr;
+                ArPlane_acquireSubsumedBy(arSession_, plane, &subsumedBy);
+                ArPlaneType planeType;
+                ArPlane_getType(arSession_, plane, &planeType);
+                if(trackingState == AR_TRACKING_STATE_TRACKING &&
+                   subsumedBy == nullptr &&
+                   planeType == AR_PLANE_HORIZONTAL_UPWARD_FACING)
+                {
+                    int32_t polygonSize = 0;
+                    ArPlane_getPolygonSize(arSession_, plane, &polygonSize);
+                    std::vector<float> polygon(polygonSize);
+                    if(polygonSize >= 6)
+                    {
+                        ArPlane_getPolygon(arSession_, plane, polygon.data());
+                        float planeRaw[7];
+                        ArPlane_getCenterPose(arSession_, plane, planePose);
+                        ArPose_getPoseRaw(arSession_, planePose, planeRaw);
+                        planes.push_back(detectedPlaneFromOpenGL(
+                                Transform(planeRaw[4], planeRaw[5], planeRaw[6], planeRaw[0], planeRaw[1], planeRaw[2], planeRaw[3]),
+                                polygon.data(),
+                                polygonSize/2));
+                    }
+                }
+                if(subsumedBy)
+                {
+                    ArTrackable_release(ArAsTrackable(subsumedBy));
+                }
+                ArTrackable_release(trackable);
+            }
+            ArPose_destroy(planePose);
+            this->setDetectedPlanes(planes);
+        }
+        ArTrackableList_destroy(planeList);
+
         // Get calibration parameters
         float fx,fy, cx, cy;
         int32_t width, height;
@@ -445,25 +502,21 @@ SensorData CameraARCore::updateDataOnRender(Transform & pose)
                     int32_t uv_data_length;
                     ArImage_getPlaneData(arSession_, image, 2, &plane_uv_data, &uv_data_length);
 
-                    if(plane_data != nullptr && data_length == height*width)
+                    int32_t y_row_stride = width;
+                    int32_t uv_row_stride = width;
+                    ArImage_getPlaneRowStride(arSession_, image, 0, &y_row_stride);
+                    ArImage_getPlaneRowStride(arSession_, image, 2, &uv_row_stride);
+
+                    if(plane_data != nullptr && plane_uv_data != nullptr && data_length >= (height-1)*y_row_stride+width)
                     {
                         double stamp = double(timestamp_ns)/10e8;
 #ifndef DISABLE_LOG
                         LOGI("data_length=%d stamp=%f", data_length, stamp);
 #endif
-                        cv::Mat rgb;
-                        if((long)plane_uv_data-(long)plane_data != data_length)
-                        {
-                            // The uv-plane is not concatenated to y plane in memory, so concatenate them
-                            cv::Mat yuv(height+height/2, width, CV_8UC1);
-                            memcpy(yuv.data, plane_data, data_length);
-                            memcpy(yuv.data+data_length, plane_uv_data, height/2*width);
-                            cv::cvtColor(yuv, rgb, cv::COLOR_YUV2BGR_NV21);
-                        }
-                        else
-                        {
-                            cv::cvtColor(cv::Mat(height+height/2, width, CV_8UC1, (void*)plane_data), rgb, cv::COLOR_YUV2BGR_NV21);
-                        }
+                        // The VU plane (NV21) is read in place with the row strides, it
+                        // doesn't need to be concatenated to the y plane
+                        YuvToBgr::convert(plane_data, y_row_stride, plane_uv_data, uv_row_stride, width, height, YuvToBgr::kNV21, 1, rgbBuffer_);
+                        cv::Mat rgb = rgbBuffer_;
 
                         std::vector<cv::KeyPoint> kpts;
                         std::vector<cv::Point3f> kpts3;
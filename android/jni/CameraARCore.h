@@ -78,6 +78,7 @@ private:
     UMutex arSessionMutex_;
 
     bool depthFromMotion_;
+    cv::Mat rgbBuffer_; // converted camera image, reused when no longer referenced
 };
 
 } /* namespace rtabmap */
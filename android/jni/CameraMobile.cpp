@@ -64,7 +64,8 @@ CameraMobile::CameraMobile(bool smoothing, float upstreamRelocalizationAccThr) :
         originUpdate_(true),
         upstreamRelocalizationAccThr_(upstreamRelocalizationAccThr),
         previousAnchorStamp_(0.0),
-        dataGoodTracking_(true)
+        dataGoodTracking_(true),
+        detectedPlanesRevision_(0)
 {
 }
 
@@ -98,6 +99,7 @@ void CameraMobile::close()
     previousAnchorPose_.setNull();
     previousAnchorLinearVelocity_.clear();
     previousAnchorStamp_ = 0.0;
+    setDetectedPlanes(std::vector<DetectedPlane>());
 
     if(textureId_ != 0)
     {
@@ -115,60 +117,8 @@ void CameraMobile::resetOrigin()
 
 bool CameraMobile::getPose(double epochStamp, Transform & pose, cv::Mat & covariance, double maxWaitTime)
 {
-    pose.setNull();
-
-    int maxWaitTimeMs = maxWaitTime * 1000;
-
     // Interpolate pose
-    if(!poseBuffer_.empty())
-    {
-        poseMutex_.lock();
-        int waitTry = 0;
-        while(maxWaitTimeMs>0 && poseBuffer_.rbegin()->first < epochStamp && waitTry < maxWaitTimeMs)
-        {
-            poseMutex_.unlock();
-            ++waitTry;
-            uSleep(1);
-            poseMutex_.lock();
-        }
-        if(poseBuffer_.rbegin()->first < epochStamp)
-        {
-            if(maxWaitTimeMs > 0)
-            {
-                UWARN("Could not find poses to interpolate at time %f after waiting %d ms (latest is %f)...", epochStamp, maxWaitTimeMs, poseBuffer_.rbegin()->first);
-            }
-            else
-            {
-                UWARN("Could not find poses to interpolate at time %f (latest is %f)...", epochStamp, poseBuffer_.rbegin()->first);
-            }
-        }
-        else
-        {
-            std::map<double, Transform>::const_iterator iterB = poseBuffer_.lower_bound(epochStamp);
-            std::map<double, Transform>::const_iterator iterA = iterB;
-            if(iterA != poseBuffer_.begin())
-            {
-                iterA = --iterA;
-            }
-            if(iterB == poseBuffer_.end())
-            {
-                iterB = --iterB;
-            }
-            if(iterA == iterB && epochStamp == iterA->first)
-            {
-                pose = iterA->second;
-            }
-            else if(epochStamp >= iterA->first && epochStamp <= iterB->first)
-            {
-                pose = iterA->second.interpolate((epochStamp-iterA->first) / (iterB->first-iterA->first), iterB->second);
-            }
-            else // stamp < iterA->first
-            {
-                UWARN("Could not find pose data to interpolate at time %f (earliest is %f). Are sensors synchronized?", epochStamp, iterA->first);
-            }
-        }
-        poseMutex_.unlock();
-    }
+    pose = poseBuffer_.getPose(epochStamp, maxWaitTime);
     return !pose.isNull();
 }
 
@@ -273,20 +223,50 @@ void CameraMobile::poseReceived(const Transform & pose, double deviceStamp)
             }
         }
 
-        {
-            UScopeMutex lock(poseMutex_);
-            poseBuffer_.insert(poseBuffer_.end(), std::make_pair(epochStamp, p));
-            if(poseBuffer_.size() > 1000)
-            {
-                poseBuffer_.erase(poseBuffer_.begin());
-            }
-        }
+        poseBuffer_.add(epochStamp, p);
 
         // send pose of the camera (with optical rotation)
         this->post(new PoseEvent(p * deviceTColorCamera_));
     }
 }
 
+void CameraMobile::setDetectedPlanes(const std::vector<DetectedPlane> & planes)
+{
+    boost::mutex::scoped_lock lock(detectedPlanesMutex_);
+    detectedPlanes_ = planes;
+    ++detectedPlanesRevision_;
+}
+
+std::vector<CameraMobile::DetectedPlane> CameraMobile::getDetectedPlanes() const
+{
+    std::vector<DetectedPlane> planes;
+    {
+        boost::mutex::scoped_lock lock(detectedPlanesMutex_);
+        planes = detectedPlanes_;
+    }
+    if(!originOffset_.isNull())
+    {
+        for(size_t i=0; i<planes.size(); ++i)
+        {
+            planes[i].pose = originOffset_ * planes[i].pose;
+        }
+    }
+    return planes;
+}
+
+CameraMobile::DetectedPlane CameraMobile::detectedPlaneFromOpenGL(const Transform & pose, const float * boundaryXZ, int points)
+{
+    DetectedPlane plane;
+    plane.pose = rtabmap::rtabmap_world_T_opengl_world * pose * rtabmap::opengl_world_T_rtabmap_world;
+    plane.polygon.resize(points);
+    for(int i=0; i<points; ++i)
+    {
+        // (x, 0, z) in OpenGL plane frame is (-z, -x, 0) in rtabmap plane frame
+        plane.polygon[i] = cv::Point2f(-boundaryXZ[i*2+1], -boundaryXZ[i*2]);
+    }
+    return plane;
+}
+
 bool CameraMobile::isCalibrated() const
 {
     return model_.isValidForProjection();
@@ -584,42 +564,88 @@ LaserScan CameraMobile::scanFromPointCloudData(
         const float * inPtr = pointCloudData.ptr<float>();
         int ic = pointCloudData.channels();
         UASSERT(pointCloudData.depth() == CV_32F && ic >= 3);
-        
+        UASSERT(rgb.type() == CV_8UC3 && rgb.cols >= model.imageWidth() && rgb.rows >= model.imageHeight());
+
+        // Both transforms are constant for the whole cloud: opengl world -> base
+        // frame of the scan, and opengl world -> image (optical rotation and
+        // intrinsics folded in, z is the optical depth).
+        const Eigen::Matrix<float, 3, 4> toScan = (pose.inverse()*rtabmap_world_T_opengl_world).toEigen3f().matrix().topRows<3>();
+        Eigen::Matrix3f K;
+        K << model.fx(), 0, model.cx(),
+             0, model.fy(), model.cy(),
+             0, 0, 1;
+        const Eigen::Matrix<float, 3, 4> toImage = K * opticalRotationInv.toEigen3f().linear() * toScan;
+        const float width = model.imageWidth();
+        const float height = model.imageHeight();
+
+        size_t kptsOffset = 0;
+        if(kpts)
+        {
+            kptsOffset = kpts->size();
+            kpts->resize(kptsOffset + pointCloudData.cols);
+        }
+        size_t kpts3DOffset = 0;
+        if(kpts3D)
+        {
+            kpts3DOffset = kpts3D->size();
+            kpts3D->resize(kpts3DOffset + pointCloudData.cols);
+        }
+
+        // Points are transformed by blocks in structure of arrays so that
+        // the compiler can vectorize the transforms, only the color lookup
+        // of the points in the image is done point by point.
+        const int blockSize = 256;
+        float x[blockSize], y[blockSize], z[blockSize];
+        float sx[blockSize], sy[blockSize], sz[blockSize];
+        float u[blockSize], v[blockSize], w[blockSize];
         int oi = 0;
-        for(unsigned int i=0;i<pointCloudData.cols; ++i)
+        for(int start=0; start<pointCloudData.cols; start+=blockSize)
         {
-            cv::Point3f pt(inPtr[i*ic], inPtr[i*ic + 1], inPtr[i*ic + 2]);
-            pt = util3d::transformPoint(pt, pose.inverse()*rtabmap_world_T_opengl_world);
-            ptr[oi*4] = pt.x;
-            ptr[oi*4 + 1] = pt.y;
-            ptr[oi*4 + 2] = pt.z;
-
-            //get color from rgb image
-            cv::Point3f org= pt;
-            pt = util3d::transformPoint(pt, opticalRotationInv);
-            if(pt.z > 0)
+            const int n = std::min(blockSize, pointCloudData.cols - start);
+            const float * in = inPtr + start*ic;
+            for(int i=0; i<n; ++i)
             {
-                int u,v;
-                model.reproject(pt.x, pt.y, pt.z, u, v);
-                unsigned char r=255,g=255,b=255;
-                if(model.inFrame(u, v))
+                x[i] = in[i*ic];
+                y[i] = in[i*ic + 1];
+                z[i] = in[i*ic + 2];
+            }
+            for(int i=0; i<n; ++i)
+            {
+                sx[i] = toScan(0,0)*x[i] + toScan(0,1)*y[i] + toScan(0,2)*z[i] + toScan(0,3);
+                sy[i] = toScan(1,0)*x[i] + toScan(1,1)*y[i] + toScan(1,2)*z[i] + toScan(1,3);
+                sz[i] = toScan(2,0)*x[i] + toScan(2,1)*y[i] + toScan(2,2)*z[i] + toScan(2,3);
+            }
+            for(int i=0; i<n; ++i)
+            {
+                w[i] = toImage(2,0)*x[i] + toImage(2,1)*y[i] + toImage(2,2)*z[i] + toImage(2,3);
+                const float iz = w[i] > 0.0f ? 1.0f / w[i] : 0.0f;
+                u[i] = (toImage(0,0)*x[i] + toImage(0,1)*y[i] + toImage(0,2)*z[i] + toImage(0,3)) * iz;
+                v[i] = (toImage(1,0)*x[i] + toImage(1,1)*y[i] + toImage(1,2)*z[i] + toImage(1,3)) * iz;
+            }
+            for(int i=0; i<n; ++i)
+            {
+                // same test than model.inFrame() on the truncated pixel
+                if(w[i] > 0.0f && u[i] > -1.0f && u[i] < width && v[i] > -1.0f && v[i] < height)
                 {
-                    b=rgb.at<cv::Vec3b>(v,u).val[0];
-                    g=rgb.at<cv::Vec3b>(v,u).val[1];
-                    r=rgb.at<cv::Vec3b>(v,u).val[2];
+                    const int pu = int(u[i]);
+                    const int pv = int(v[i]);
+                    const unsigned char * color = rgb.ptr<unsigned char>(pv) + pu*3;
+                    ptr[oi*4] = sx[i];
+                    ptr[oi*4 + 1] = sy[i];
+                    ptr[oi*4 + 2] = sz[i];
+                    *(int*)&ptr[oi*4 + 3] = int(color[0]) | (int(color[1]) << 8) | (int(color[2]) << 16);
                     if(kpts)
-                        kpts->push_back(cv::KeyPoint(u,v,kptsSize));
+                        (*kpts)[kptsOffset + oi] = cv::KeyPoint(pu, pv, kptsSize);
                     if(kpts3D)
-                        kpts3D->push_back(org);
-                    
-                    *(int*)&ptr[oi*4 + 3] = int(b) | (int(g) << 8) | (int(r) << 16);
+                        (*kpts3D)[kpts3DOffset + oi] = cv::Point3f(sx[i], sy[i], sz[i]);
                     ++oi;
                 }
             }
-            //confidence
-            //*(int*)&ptr[i*4 + 3] = (int(pointCloudData[i*4 + 3] * 255.0f) << 8) | (int(255) << 16);
-
         }
+        if(kpts)
+            kpts->resize(kptsOffset + oi);
+        if(kpts3D)
+            kpts3D->resize(kpts3DOffset + oi);
         return LaserScan::backwardCompatibility(scanData.colRange(0, oi), 0, 10, rtabmap::Transform::getIdentity());
     }
     return LaserScan();
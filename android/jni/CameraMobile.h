@@ -37,7 +37,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UEvent.h>
 #include <rtabmap/utilite/UTimer.h>
 #include <boost/thread/mutex.hpp>
+#include <atomic>
 #include "util.h"
+#include "pose_buffer.h"
 
 namespace rtabmap {
 
@@ -124,6 +126,19 @@ public:
     void setOcclusionImage(const cv::Mat & image, const CameraModel & model) {occlusionModel_ = model; occlusionImage_ = image;}
     const cv::Mat & getOcclusionImage(CameraModel * model=0) const {if(model)*model=occlusionModel_; return occlusionImage_; }
 
+    // Horizontal planes detected by the AR session, used to seed the ground
+    // reference of the volume measurements.
+    struct DetectedPlane {
+        Transform pose;                   // center of the plane in rtabmap frame, z axis is the normal
+        std::vector<cv::Point2f> polygon; // boundary on the x/y plane of pose
+    };
+    void setDetectedPlanes(const std::vector<DetectedPlane> & planes); // poses without origin offset
+    std::vector<DetectedPlane> getDetectedPlanes() const; // poses with origin offset
+    int getDetectedPlanesRevision() const {return detectedPlanesRevision_;} // incremented on each update
+    // Plane in OpenGL world (y axis is the normal, boundary as x/z pairs in
+    // plane frame), like the ARCore and ARKit planes.
+    static DetectedPlane detectedPlaneFromOpenGL(const Transform & pose, const float * boundaryXZ, int points);
+
 protected:
     virtual SensorData updateDataOnRender(Transform & pose);
 
@@ -162,11 +177,14 @@ private:
     Transform dataPose_;
     bool dataGoodTracking_;
 
-    UMutex poseMutex_;
-    std::map<double, Transform> poseBuffer_; // <stamp, Pose>
+    PoseBuffer poseBuffer_;
     
     cv::Mat occlusionImage_;
     CameraModel occlusionModel_;
+
+    mutable boost::mutex detectedPlanesMutex_;
+    std::vector<DetectedPlane> detectedPlanes_;
+    std::atomic<int> detectedPlanesRevision_;
 };
 
 } /* namespace rtabmap */
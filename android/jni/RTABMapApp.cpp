@@ -28,6 +28,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <tango-gl/conversions.h>
 
 #include "RTABMapApp.h"
+#include "yuv_to_bgr.h"
+#include "depth_image.h"
 #ifdef __ANDROID__
 #include "CameraAvailability.h"
 #endif
@@ -221,6 +223,36 @@ rtabmap::ParametersMap RTABMapApp::getRtabmapParameters()
 	return parameters;
 }
 
+class VolumeEvent : public UEvent
+{
+public:
+	VolumeEvent(double volume) :
+		volume_(volume)
+	{
+	}
+	virtual std::string getClassName() const {return "VolumeEvent";}
+	double getVolume() const {return volume_;}
+private:
+	double volume_;
+};
+
+// Full resolution volume after the low resolution one
+class VolumeRefinedEvent : public UEvent
+{
+public:
+	VolumeRefinedEvent(double volume, double delta) :
+		volume_(volume),
+		delta_(delta)
+	{
+	}
+	virtual std::string getClassName() const {return "VolumeRefinedEvent";}
+	double getVolume() const {return volume_;}
+	double getDelta() const {return delta_;}
+private:
+	double volume_;
+	double delta_;
+};
+
 #ifdef __ANDROID__
 RTABMapApp::RTABMapApp(JNIEnv* env, jobject caller_activity) :
 #else //__APPLE__
@@ -278,6 +310,10 @@ RTABMapApp::RTABMapApp() :
 		optMesh_(new pcl::TextureMesh),
 		optRefId_(0),
 		optRefPose_(0),
+		cutFillUpdated_(false),
+		onlineHeightMapEnabled_(false),
+		onlineHeightMapPlane_(0.0f, 0.0f, 0.0f),
+		groundSeedsRevision_(-1),
 		mapToOdom_(rtabmap::Transform::getIdentity())
 
 {
@@ -306,6 +342,17 @@ RTABMapApp::RTABMapApp() :
 	progressionStatus_.setJavaObjects(jvm, RTABMapActivity);
 #endif
 	main_scene_.setBackgroundColor(backgroundColor_, backgroundColor_, backgroundColor_);
+	// Called from the scene's crop/volume worker thread
+	main_scene_.setVolumeCallback([](double volume) {
+		UEventsManager::post(new VolumeEvent(volume));
+	});
+	main_scene_.setVolumeRefinedCallback([](double volume, double delta) {
+		UEventsManager::post(new VolumeRefinedEvent(volume, delta));
+	});
+#ifndef __ANDROID__
+	swiftVolumeCallback = 0;
+	swiftVolumeRefinedCallback = 0;
+#endif
 
 	logHandler_ = new rtabmap::LogHandler();
 
@@ -342,206 +389,395 @@ void RTABMapApp::setupSwiftCallbacks(void * classPtr,
     swiftStatsUpdatedCallback = statsUpdatedCallback;
     swiftCameraInfoEventCallback = cameraInfoEventCallback;
 }
-#endif
 
-//Eigen::Vector3d calculateBoundingBoxCentroid(rtabmap::Mesh &mesh) {
-//    if (mesh.cloud->points.empty()) {
-//        throw std::invalid_argument("포인트 클라우드가 비어 있습니다.");
-//    }
-//
-//    // 초기값 설정 (첫 번째 점의 좌표 사용)
-//    double minX = mesh.cloud->points[0].x;
-//    double maxX = mesh.cloud->points[0].x;
-//    double minY = mesh.cloud->points[0].y;
-//    double maxY = mesh.cloud->points[0].y;
-//    double minZ = mesh.cloud->points[0].z;
-//    double maxZ = mesh.cloud->points[0].z;
-//
-//    // 정렬을 위한 벡터 초기화
-//    std::vector<double> xs;
-//    std::vector<double> ys;
-//    std::vector<double> zs;
-//    xs.reserve(mesh.cloud->points.size());
-//    ys.reserve(mesh.cloud->points.size());
-//    zs.reserve(mesh.cloud->points.size());
-//
-//    // 가장자리 포인트들의 z값을 저장할 벡터
-//    std::vector<double> edgeZs;
-//
-//    int count = 0;
-//    // 포인트 클라우드의 모든 점들을 순회하며 최소값, 최대값 계산 및 정렬을 위한 벡터 채우기
-//    for (const auto& point : mesh.cloud->points) {
-//        if (point.x < minX) minX = point.x;
-//        if (point.x > maxX) maxX = point.x;
-//        if (point.y < minY) minY = point.y;
-//        if (point.y > maxY) maxY = point.y;
-//        if (point.z < minZ) minZ = point.z;
-//        if (point.z > maxZ) maxZ = point.z;
-//
-//        xs.push_back(point.x);
-//        ys.push_back(point.y);
-//        zs.push_back(point.z);
-//
-//        count += 1;
-//    }
-//    std::cout << "Count: " << count << std::endl;
-//
-//    // 가장자리 포인트들의 z값 수집
-//    double epsilon = 1e-6; // 부동 소수점 비교를 위한 작은 값
-//    for (const auto& point : mesh.cloud->points) {
-//        if (std::abs(point.x - minX) < epsilon || std::abs(point.x - maxX) < epsilon ||
-//            std::abs(point.y - minY) < epsilon || std::abs(point.y - maxY) < epsilon) {
-//            edgeZs.push_back(point.z);
-//        }
-//    }
-//
-//    // edgeZs의 평균 계산
-//    double sumEdgeZs = std::accumulate(edgeZs.begin(), edgeZs.end(), 0.0);
-//    double averageEdgeZ = sumEdgeZs / edgeZs.size();
-//
-//    // 각 좌표축의 중간값 계산
-//    double centerX = (minX + maxX) / 2.0;
-//    double centerY = (minY + maxY) / 2.0;
-//
-//    std::cout << "Centroid coordinates: " << centerX << ", " << centerY << ", " << averageEdgeZ << std::endl;
-//    std::cout << "Min: " << minX << ", " << minY << ", " << minZ << std::endl;
-//    std::cout << "Max: " << maxX << ", " << maxY << ", " << maxZ << std::endl;
-//
-//    Eigen::Vector3d centroid(centerX, centerY, averageEdgeZ);
-//    return centroid;
-//}
-
-//double RTABMapApp::calculateMeshVolume() {
-//    pcl::PolygonMesh::Ptr polygonMesh(new pcl::PolygonMesh);
-//    pcl::TextureMesh::Ptr textureMesh(new pcl::TextureMesh);
-//    cv::Mat cloudMat;
-//    std::vector<std::vector<std::vector<RTABMAP_PCL_INDEX> > > polygons;
-//#if PCL_VERSION_COMPARE(>=, 1, 8, 0)
-//    std::vector<std::vector<Eigen::Vector2f, Eigen::aligned_allocator<Eigen::Vector2f> > > texCoords;
-//#else
-//    std::vector<std::vector<Eigen::Vector2f> > texCoords;
-//#endif
-//    cv::Mat textures;
-//    if (rtabmap_ && rtabmap_->getMemory()) {
-//        cloudMat = rtabmap_->getMemory()->loadOptimizedMesh(&polygons, &texCoords, &textures);
-//        if (!cloudMat.empty()) {
-//            LOGI("calculateMeshVolume: Found optimized mesh!");
-//            if (textures.empty()) {
-//                polygonMesh = rtabmap::util3d::assemblePolygonMesh(cloudMat, polygons.size() == 1 ? polygons[0] : std::vector<std::vector<RTABMAP_PCL_INDEX> >());
-//            } else {
-//                textureMesh = rtabmap::util3d::assembleTextureMesh(cloudMat, polygons, texCoords, textures, true);
-//            }
-//        } else {
-//            LOGI("calculateMeshVolume: No optimized mesh found.");
-//            return -1.0; // Return an error value if no mesh is found
-//        }
-//    }
-//
-//    double volume = 0.0;
-//
-//    // TextureMesh일 경우
-//    if (textureMesh->cloud.data.size()) {
-//        LOGD("Texturemesh(s) (%d)", textures.empty()?0:textures.cols/textures.rows);
-//        UASSERT(textures.empty() || textures.cols % textures.rows == 0);
-//        UASSERT((int)textureMesh->tex_materials.size() == textures.cols/textures.rows);
-//
-//        rtabmap::Mesh mesh;
-//        pcl::fromPCLPointCloud2(textureMesh->cloud, *mesh.cloud);
-//        pcl::fromPCLPointCloud2(textureMesh->cloud, *mesh.normals);
-//        
-//        // 메쉬의 중심 계산
-//        Eigen::Vector3d centroid = calculateBoundingBoxCentroid(mesh);
-//        LOGI("calculateMeshVolume: Mesh centroid at (%f, %f, %f)", centroid.x(), centroid.y(), centroid.z());
-//
-//        // Iterate over the faces (triangles)
-//        const std::vector<pcl::Vertices>& faces = textureMesh->tex_polygons[0];
-//        int count = 0;
-//        for (const pcl::Vertices& face : faces) {
-//            if (face.vertices.size() == 3) {
-//                int idx0 = face.vertices[0];
-//                int idx1 = face.vertices[1];
-//                int idx2 = face.vertices[2];
-//
-//                const pcl::PointXYZRGB & v0 = mesh.cloud->points[idx0];
-//                const pcl::PointXYZRGB & v1 = mesh.cloud->points[idx1];
-//                const pcl::PointXYZRGB & v2 = mesh.cloud->points[idx2];
-//
-//                Eigen::Vector3d p0(v0.x, v0.y, v0.z);
-//                Eigen::Vector3d p1(v1.x, v1.y, v1.z);
-//                Eigen::Vector3d p2(v2.x, v2.y, v2.z);
-//                
-//                // 테트라헤드론의 부피를 계산할 때 기준점을 메쉬의 중심으로 사용
-//                Eigen::Vector3d r = centroid;
-//                double tetraVolume = (p0 - r).dot((p1 - r).cross(p2 - r)) / 6.0;
-//                
-//                volume += tetraVolume;
-//                count += 1;
-//
-//            } else {
-//                LOGW("폴리곤이 삼각형이 아닙니다. 크기: %zu", face.vertices.size());
-//            }
-//        }
-//        std::cout << "Count_volume : " << count << std::endl;
-//        
-//        // 최종 볼륨의 절대값을 취함
-//        volume = std::abs(volume);
-//    }
-//    // PolygonMesh일 경우
-//    else if (polygonMesh->cloud.data.size()) {
-//        LOGD("PolygonMesh has data.");
-//        
-//        rtabmap::Mesh mesh;
-//        pcl::fromPCLPointCloud2(polygonMesh->cloud, *mesh.cloud);
-//        pcl::fromPCLPointCloud2(polygonMesh->cloud, *mesh.normals);
-//        
-//        // 메쉬의 중심 계산
-//        Eigen::Vector3d centroid = calculateBoundingBoxCentroid(mesh);
-//        LOGI("calculateMeshVolume (PolygonMesh): Mesh centroid at (%f, %f, %f)", centroid.x(), centroid.y(), centroid.z());
-//
-//        // Iterate over the faces (triangles)
-//        const std::vector<pcl::Vertices>& faces = polygonMesh->polygons;
-//        int count = 0;
-//        for (const pcl::Vertices& face : faces) {
-//            if (face.vertices.size() == 3) {
-//                int idx0 = face.vertices[0];
-//                int idx1 = face.vertices[1];
-//                int idx2 = face.vertices[2];
-//
-//                const pcl::PointXYZRGB & v0 = mesh.cloud->points[idx0];
-//                const pcl::PointXYZRGB & v1 = mesh.cloud->points[idx1];
-//                const pcl::PointXYZRGB & v2 = mesh.cloud->points[idx2];
-//
-//                Eigen::Vector3d p0(v0.x, v0.y, v0.z);
-//                Eigen::Vector3d p1(v1.x, v1.y, v1.z);
-//                Eigen::Vector3d p2(v2.x, v2.y, v2.z);
-//                
-//                // 테트라헤드론의 부피를 계산할 때 기준점을 메쉬의 중심으로 사용
-//                Eigen::Vector3d r = centroid;
-//                double tetraVolume = (p0 - r).dot((p1 - r).cross(p2 - r)) / 6.0;
-//                
-//                volume += tetraVolume;
-//                count += 1;
-//
-//            } else {
-//                LOGW("폴리곤이 삼각형이 아닙니다. 크기: %zu", face.vertices.size());
-//            }
-//        }
-//        std::cout << "Count_volume (PolygonMesh): " << count << std::endl;
-//
-//        // 최종 볼륨의 절대값을 취함
-//        volume = std::abs(volume);
-//    }
-//    std::cout << "Volume of Center : " << volume << ", cbert: " << cbrt(volume) << std::endl;
-//    return volume;
-//}
+void RTABMapApp::setupSwiftVolumeCallback(void(*volumeCallback)(void *, double))
+{
+    swiftVolumeCallback = volumeCallback;
+}
+
+void RTABMapApp::setupSwiftVolumeRefinedCallback(void(*volumeRefinedCallback)(void *, double, double))
+{
+    swiftVolumeRefinedCallback = volumeRefinedCallback;
+}
+#endif
 
+// Volume of the meshes cropped by the closed marker polygon. The crop is
+// done asynchronously by the scene, wait for the job if it is still running.
+// -1 if there is no volume for the current polygon (not closed, or the job
+// is not started yet).
 double RTABMapApp::calculateMeshVolume() {
-    return main_scene_.calculateMeshVolume(-100);
+    return main_scene_.getCroppedVolume(true);
+}
+
+// Same but doesn't wait for the full resolution crop if the volume of the
+// low resolution polygons is available (refined through the callbacks).
+double RTABMapApp::calculateMeshVolumePreview()
+{
+    return main_scene_.getCroppedVolumePreview(true);
+}
+
+// Enclosed volume of the optimized mesh (the one visualized after export or
+// loaded from the database). The x/y/z fields of the PCLPointCloud2 are copied
+// once (no conversion to a typed cloud) and all materials are integrated in
+// the same parallel pass. No reference point
+// is needed for a closed mesh (e.g., Poisson). -1 if there is no optimized mesh.
+double RTABMapApp::calculateOptimizedMeshVolume()
+{
+    pcl::TextureMesh::Ptr mesh;
+    {
+        boost::mutex::scoped_lock lock(renderingMutex_);
+        mesh = optMesh_;
+    }
+    if((mesh.get() == 0 || mesh->tex_polygons.empty()) && rtabmap_ && rtabmap_->getMemory())
+    {
+        std::vector<std::vector<std::vector<RTABMAP_PCL_INDEX> > > polygons;
+        rtabmapMutex_.lock();
+        cv::Mat cloudMat = rtabmap_->getMemory()->loadOptimizedMesh(&polygons);
+        rtabmapMutex_.unlock();
+        if(!cloudMat.empty() && !polygons.empty())
+        {
+            mesh = rtabmap::util3d::assembleTextureMesh(cloudMat, polygons,
+#if PCL_VERSION_COMPARE(>=, 1, 8, 0)
+                    std::vector<std::vector<Eigen::Vector2f, Eigen::aligned_allocator<Eigen::Vector2f> > >(),
+#else
+                    std::vector<std::vector<Eigen::Vector2f> >(),
+#endif
+                    cv::Mat(), false);
+        }
+    }
+    if(mesh.get() == 0 || mesh->tex_polygons.empty())
+    {
+        LOGI("calculateOptimizedMeshVolume: No optimized mesh found.");
+        return -1.0;
+    }
+
+    UTimer timer;
+    MeshVolume::Stats stats = MeshVolume::compute(*mesh);
+    LOGI("calculateOptimizedMeshVolume: %f m^3 (%d triangles, %d materials, %fs)",
+            fabs(stats.signedVolume), stats.triangles, (int)mesh->tex_polygons.size(), timer.ticks());
+    return fabs(stats.signedVolume);
+}
+
+// 0=surface, 1=height map
+void RTABMapApp::setVolumeMode(int mode, float heightMapCellSize)
+{
+    if(mode < Scene::kVolumeSurface || mode > Scene::kVolumeHeightMap)
+    {
+        UWARN("Invalid volume mode %d, keeping the previous one.", mode);
+        mode = main_scene_.getVolumeMode();
+    }
+    main_scene_.setVolumeMode((Scene::VolumeMode)mode, heightMapCellSize);
+}
+
+// Height map accumulated from the depth frames while scanning, see OnlineHeightMap
+void RTABMapApp::setOnlineHeightMap(bool enabled, float cellSize)
+{
+    onlineHeightMapEnabled_ = false;
+    if(enabled)
+    {
+        // An invalid cell size from the UI leaves the online height map disabled
+        onlineHeightMapEnabled_ = onlineHeightMap_.start(cellSize);
+    }
+    else
+    {
+        onlineHeightMap_.stop();
+    }
+}
+
+double RTABMapApp::getOnlineVolume()
+{
+    OnlineHeightMap::Estimate estimate;
+    onlineHeightMap_.estimate(estimate);
+    if(!onlineHeightMapEnabled_ || estimate.stats.cells == 0)
+    {
+        return -1.0;
+    }
+    return estimate.stats.volume;
+}
+
+// While markers are edited, the crop is only previewed in the shaders, see Scene::commitCrop()
+void RTABMapApp::setCropPreview(bool enabled)
+{
+    main_scene_.setCropPreview(enabled);
+}
+
+void RTABMapApp::commitCrop()
+{
+    main_scene_.commitCrop();
+}
+
+// Switch between the last crops, applied on next render
+void RTABMapApp::undoCrop()
+{
+    main_scene_.undoCrop();
+}
+
+void RTABMapApp::redoCrop()
+{
+    main_scene_.redoCrop();
+}
+
+bool RTABMapApp::addRoi(const std::string & name)
+{
+    return main_scene_.addRoi(name);
+}
+
+void RTABMapApp::removeRoi(const std::string & name)
+{
+    main_scene_.removeRoi(name);
+}
+
+// Volumes (m^3) of the named ROIs, -1 for unknown ROIs. All ROIs are
+// measured in the same job, wait for it if it is running.
+std::vector<double> RTABMapApp::getRoiVolumes(const std::vector<std::string> & names)
+{
+    std::map<std::string, MeshVolume::Stats> stats = main_scene_.getRoiVolumeStats(true);
+    std::vector<double> volumes(names.size(), -1.0);
+    for(size_t i=0; i<names.size(); ++i)
+    {
+        std::map<std::string, MeshVolume::Stats>::iterator iter = stats.find(names[i]);
+        if(iter != stats.end())
+        {
+            volumes[i] = fabs(iter->second.signedVolume);
+        }
+    }
+    return volumes;
+}
+
+void RTABMapApp::setPileSeparation(bool enabled, int minTriangles, float weldDistance)
+{
+    main_scene_.setPileSeparation(enabled, minTriangles, weldDistance);
+}
+
+void RTABMapApp::setVolumeCapping(bool enabled)
+{
+    main_scene_.setVolumeCapping(enabled);
+}
+
+// Crop primitives (scene frame) intersected with the marker polygon, flattened:
+//   0 (box), inverted, x, y, z, qx, qy, qz, qw, size x, size y, size z
+//   1 (prism), inverted, floor, ceiling, n, n x (x, z)
+//   2 (half-space, keeps the side opposite to the normal), inverted, x, y, z, nx, ny, nz
+// An empty array removes the primitives. Returns false if the array is malformed.
+bool RTABMapApp::setCropRegion(const std::vector<float> & primitives)
+{
+    CropRegion region;
+    size_t i = 0;
+    while(i < primitives.size())
+    {
+        const size_t remaining = primitives.size() - i;
+        // floats from Java, checked before any cast
+        const int type = std::isfinite(primitives[i]) && std::fabs(primitives[i]) < 256.0f ? (int)primitives[i] : -1;
+        const bool inverted = remaining >= 2 && primitives[i+1] != 0.0f;
+        const float * p = primitives.data() + i + 2;
+        if(type == CropRegion::kBox && remaining >= 12 && p[7] >= 0.0f && p[8] >= 0.0f && p[9] >= 0.0f)
+        {
+            region.add(CropRegion::box(rtabmap::Transform(p[0], p[1], p[2], p[3], p[4], p[5], p[6]), Eigen::Vector3f(p[7], p[8], p[9]), inverted));
+            i += 12;
+        }
+        else if(type == CropRegion::kPrism && remaining >= 5 && p[0] <= p[1] &&
+                std::isfinite(p[2]) && p[2] >= 3.0f && p[2] <= float((remaining-5)/2) && (size_t)p[2] <= (remaining-5)/2)
+        {
+            std::vector<Eigen::Vector2f> polygon((size_t)p[2]);
+            for(size_t j=0; j<polygon.size(); ++j)
+            {
+                polygon[j] = Eigen::Vector2f(p[3+j*2], p[4+j*2]);
+            }
+            region.add(CropRegion::prism(polygon, p[0], p[1], inverted));
+            i += 5 + 2*polygon.size();
+        }
+        else if(type == CropRegion::kHalfSpace && remaining >= 8 && Eigen::Vector3f(p[3], p[4], p[5]).norm() > 0.0f)
+        {
+            region.add(CropRegion::halfSpace(Eigen::Vector3f(p[0], p[1], p[2]), Eigen::Vector3f(p[3], p[4], p[5]), inverted));
+            i += 8;
+        }
+        else
+        {
+            UERROR("Malformed crop region (primitive type %d at %d)", type, (int)i);
+            return false;
+        }
+    }
+    main_scene_.setCropRegion(region);
+    return true;
+}
+
+// Volume (m^3), footprint (m^2) and height (m) of each pile of the last crop
+std::vector<double> RTABMapApp::getPiles()
+{
+    std::vector<MeshComponents::Component> piles = main_scene_.getPiles(true);
+    std::vector<double> values;
+    values.reserve(piles.size()*3);
+    for(size_t i=0; i<piles.size(); ++i)
+    {
+        values.push_back(fabs(piles[i].stats.signedVolume));
+        values.push_back(piles[i].stats.footprint);
+        values.push_back(piles[i].height());
+    }
+    return values;
+}
+
+// Cut, fill and net volumes (m^3), area (m^2) and alignment error (m) of the
+// session "after" compared to the session "before", empty on failure. Both
+// databases are only read, the difference map is shown on next render.
+// Long operation, should not be called in OpenGL thread.
+std::vector<double> RTABMapApp::computeCutFill(const std::string & databaseBefore, const std::string & databaseAfter, float cellSize)
+{
+    if(!(cellSize > 0.0f)) // NaN too
+    {
+        UERROR("Invalid cut/fill cell size (%f m)", cellSize);
+        return std::vector<double>();
+    }
+    UTimer time;
+    CutFill::Session before, after;
+    if(!CutFill::load(databaseBefore, cellSize/2.0f, before) || !CutFill::load(databaseAfter, cellSize/2.0f, after))
+    {
+        return std::vector<double>();
+    }
+    float rmse = 0.0f;
+    rtabmap::Transform afterPose = CutFill::align(before.vertices, after.vertices, 0.5f, 30, &rmse);
+    if(afterPose.isNull())
+    {
+        UERROR("Failed to align \"%s\" on \"%s\"", databaseAfter.c_str(), databaseBefore.c_str());
+        return std::vector<double>();
+    }
+    CutFill cutFill;
+    CutFill::Stats stats = cutFill.compute(before, after, afterPose, cellSize);
+    {
+        boost::mutex::scoped_lock  lock(renderingMutex_);
+        cutFillMesh_ = cutFill.overlayMesh();
+        cutFillUpdated_ = true;
+    }
+    LOGI("Cut/fill done: %fs", time.ticks());
+
+    std::vector<double> values(5);
+    values[0] = stats.cut;
+    values[1] = stats.fill;
+    values[2] = stats.net();
+    values[3] = stats.area;
+    values[4] = rmse;
+    return values;
+}
+
+void RTABMapApp::clearCutFill()
+{
+    boost::mutex::scoped_lock  lock(renderingMutex_);
+    cutFillMesh_ = rtabmap::Mesh();
+    cutFillUpdated_ = true;
+}
+
+// Ground of the volumes fitted on the mesh vertices within band (m) of the
+// polygon boundary (see GroundReference)
+void RTABMapApp::setGroundReference(float band, float inlierDistance, bool quadratic)
+{
+    GroundReference::Parameters parameters;
+    parameters.band = band;
+    parameters.inlierDistance = inlierDistance;
+    parameters.quadratic = quadratic;
+    main_scene_.setGroundParameters(parameters);
+}
+
+void RTABMapApp::setDetectedPlanes(const std::vector<rtabmap::CameraMobile::DetectedPlane> & planes)
+{
+    boost::mutex::scoped_lock  lock(cameraMutex_);
+    if(camera_)
+    {
+        camera_->setDetectedPlanes(planes);
+    }
+}
+
+// Mean, standard deviation and 5th/50th/95th percentiles (m^3) of the
+// cropped volume with perturbed node poses and reference height, empty if
+// the crop is not ready, all -1 if the parameters are invalid. The samples
+// are computed without the rendering lock.
+std::vector<double> RTABMapApp::estimateVolumeUncertainty(int samples, float referenceSigma)
+{
+    if(samples <= 0 || !(referenceSigma >= 0.0f)) // NaN too
+    {
+        UERROR("Volume uncertainty: invalid parameters (samples=%d, reference sigma=%f m)", samples, referenceSigma);
+        return std::vector<double>(5, -1.0);
+    }
+    std::vector<VolumeUncertainty::Node> nodes;
+    Eigen::Vector3f reference;
+    GroundReference::Surface ground;
+    {
+        boost::mutex::scoped_lock  lock(renderingMutex_);
+        if(!main_scene_.getVolumeUncertaintyNodes(nodes, reference, ground))
+        {
+            UWARN("Volume uncertainty: no cropped volume");
+            return std::vector<double>();
+        }
+    }
+    UTimer time;
+    VolumeUncertainty::Stats stats = VolumeUncertainty::estimate(nodes, reference, ground, referenceSigma, samples);
+    LOGI("Volume uncertainty: %f m^3, mean=%f std=%f p5=%f p95=%f (%d samples, %d nodes): %fs",
+            stats.volume, stats.mean, stats.stdDev, stats.p5, stats.p95, samples, (int)nodes.size(), time.ticks());
+
+    std::vector<double> values(5);
+    values[0] = stats.mean;
+    values[1] = stats.stdDev;
+    values[2] = stats.p5;
+    values[3] = stats.p50;
+    values[4] = stats.p95;
+    return values;
+}
+
+// Adaptive resolution volume (m^3) of a ROI (empty for the marker polygon),
+// see HeightMap::solve(): volume, cell size used (m), height maps rasterized,
+// relative difference of the last two volumes and 1 if it converged under
+// the tolerance. Empty if the ROI doesn't exist, volume -1 if the parameters
+// are invalid (min and max cell sizes are swapped if inverted). The height
+// maps are rasterized without the rendering lock.
+std::vector<double> RTABMapApp::solveVolume(const std::string & roi, float tolerance, float minCellSize, float maxCellSize)
+{
+    if(minCellSize > maxCellSize)
+    {
+        std::swap(minCellSize, maxCellSize);
+    }
+    if(!(tolerance >= 0.0f && minCellSize > 0.0f && maxCellSize < std::numeric_limits<float>::infinity())) // NaN too
+    {
+        UERROR("Volume solver: invalid parameters (tolerance=%f, cell size=[%f, %f] m)", tolerance, minCellSize, maxCellSize);
+        std::vector<double> values(5, 0.0);
+        values[0] = -1.0;
+        return values;
+    }
+    std::vector<rtabmap::Mesh> meshes;
+    std::vector<rtabmap::Transform> meshToScene;
+    std::vector<Eigen::Vector2f> polygon;
+    Eigen::Vector3f plane;
+    {
+        boost::mutex::scoped_lock  lock(renderingMutex_);
+        if(!main_scene_.getVolumeSolverInputs(roi, meshes, meshToScene, polygon, plane))
+        {
+            UWARN("Volume solver: unknown ROI \"%s\" or marker polygon not closed", roi.c_str());
+            return std::vector<double>();
+        }
+    }
+    UTimer time;
+    std::list<MeshVolume::VertexArrays> vertices;
+    std::vector<MeshVolume::Input> inputs;
+    for(size_t i=0; i<meshes.size(); ++i)
+    {
+        vertices.push_back(MeshVolume::VertexArrays(*meshes[i].cloud));
+        inputs.push_back(MeshVolume::Input(&vertices.back(), &meshes[i].polygons.get(), meshToScene[i]));
+    }
+    HeightMap::Solution solution = HeightMap::solve(inputs, plane, polygon, tolerance, minCellSize, maxCellSize);
+    LOGI("Volume solver: %f m^3, cell size=%f m, iterations=%d, difference=%f, converged=%s (%d meshes): %fs",
+            solution.stats.volume, solution.cellSize, solution.iterations, solution.difference,
+            solution.converged?"true":"false", (int)meshes.size(), time.ticks());
+
+    std::vector<double> values(5);
+    values[0] = solution.stats.volume;
+    values[1] = solution.cellSize;
+    values[2] = solution.iterations;
+    values[3] = solution.difference;
+    values[4] = solution.converged?1.0:0.0;
+    return values;
 }
 
 RTABMapApp::~RTABMapApp() {
 	LOGI("~RTABMapApp() begin");
 	stopCamera();
+	onlineHeightMap_.stop();
 	if(rtabmapThread_)
 	{
 		rtabmapThread_->close(false);
@@ -1520,6 +1756,13 @@ int RTABMapApp::Render()
 			visualizingMesh_ = false;
 		}
 
+		if(cutFillUpdated_)
+		{
+			main_scene_.setCutFillOverlay(cutFillMesh_);
+			cutFillMesh_ = rtabmap::Mesh();
+			cutFillUpdated_ = false;
+		}
+
 		// ARCore and AREngine capture should be done in opengl thread!
 		const float* uvsTransformed = 0;
 		glm::mat4 arProjectionMatrix(0);
@@ -1573,6 +1816,29 @@ int RTABMapApp::Render()
 						UERROR("invalid occlusionModel: %f %f %f %f %dx%d", occlusionModel.fx(), occlusionModel.fy(), occlusionModel.cx(), occlusionModel.cy(), occlusionModel.imageWidth(), occlusionModel.imageHeight());
 					}
 				}
+
+				// Planes detected by the AR session seed the ground of the volumes
+				int planesRevision = camera_->getDetectedPlanesRevision();
+				if(planesRevision != groundSeedsRevision_ || groundSeedsMapToOdom_ != mapToOdom_)
+				{
+					std::vector<rtabmap::CameraMobile::DetectedPlane> planes = camera_->getDetectedPlanes();
+					std::vector<GroundReference::Seed> seeds(planes.size());
+					for(size_t i=0; i<planes.size(); ++i)
+					{
+						Eigen::Affine3f pose = (rtabmap::opengl_world_T_rtabmap_world*mapToOdom_*planes[i].pose).toEigen3f();
+						seeds[i].point = pose.translation();
+						seeds[i].normal = pose.linear().col(2);
+						seeds[i].boundary.resize(planes[i].polygon.size());
+						for(size_t j=0; j<planes[i].polygon.size(); ++j)
+						{
+							Eigen::Vector3f p = pose * Eigen::Vector3f(planes[i].polygon[j].x, planes[i].polygon[j].y, 0.0f);
+							seeds[i].boundary[j] = Eigen::Vector2f(p[0], p[2]);
+						}
+					}
+					main_scene_.setGroundSeeds(seeds);
+					groundSeedsRevision_ = planesRevision;
+					groundSeedsMapToOdom_ = mapToOdom_;
+				}
 #ifdef DEBUG_RENDERING_PERFORMANCE
 				LOGD("Update background and occlusion mesh %fs", time.ticks());
 #endif
@@ -1827,6 +2093,7 @@ int RTABMapApp::Render()
 				poseMutex_.unlock();
 
 				main_scene_.clear();
+				onlineHeightMap_.reset();
 				clearSceneOnNextRender_ = false;
 				if(!openingDatabase_)
 				{
@@ -2258,6 +2525,39 @@ int RTABMapApp::Render()
 					}
 				}
 			}
+			if(onlineHeightMapEnabled_)
+			{
+				// Non-blocking, the frames are integrated in the online height map thread
+				if(!sensorEvent.info().odomPose.isNull() && !sensorEvent.data().depthRaw().empty())
+				{
+					onlineHeightMap_.addFrame(
+							sensorEvent.data(),
+							rtabmap::opengl_world_T_rtabmap_world*mapToOdom_*sensorEvent.info().odomPose,
+							updateMeshDecimation(sensorEvent.data().depthRaw().cols, sensorEvent.data().depthRaw().rows),
+							minCloudDepth_,
+							maxCloudDepth_);
+				}
+				std::vector<rtabmap::Transform> roi;
+				if(main_scene_.isPolygonClosed())
+				{
+					roi = main_scene_.getMarkerPolygon();
+				}
+				// Ground of the scene if it is fitted on the same markers
+				GroundReference::Surface ground;
+				bool hasGround = !roi.empty() && main_scene_.getGroundSurface(ground);
+				if(roi.size() != onlineHeightMapRoi_.size() || !std::equal(roi.begin(), roi.end(), onlineHeightMapRoi_.begin()) ||
+				   (hasGround && ground.plane != onlineHeightMapPlane_))
+				{
+					std::vector<Eigen::Vector3f> polygon(roi.size());
+					for(size_t i=0; i<roi.size(); ++i)
+					{
+						polygon[i] = Eigen::Vector3f(roi[i].x(), roi[i].y(), roi[i].z());
+					}
+					onlineHeightMap_.setRoi(polygon, hasGround?&ground.plane:0);
+					onlineHeightMapRoi_ = roi;
+					onlineHeightMapPlane_ = hasGround?ground.plane:Eigen::Vector3f::Zero();
+				}
+			}
             if(dataRecorderMode_ || !rtabmapEvents.size())
             {
 				main_scene_.setCloudVisible(-1, odomCloudShown_ && !trajectoryMode_ && sensorCaptureThread_!=0);
@@ -4086,22 +4386,20 @@ void RTABMapApp::postOdometryEvent(
 #ifndef DISABLE_LOG
 				//LOGD("y=%p u=%p v=%p yLen=%d y->v=%ld", yPlane, uPlane, vPlane, yPlaneLen,  (long)vPlane-(long)yPlane);
 #endif
-				if((long)vPlane-(long)yPlane != yPlaneLen)
-				{
-					// The uv-plane is not concatenated to y plane in memory, so concatenate them
-					cv::Mat yuv(rgbHeight+rgbHeight/2, rgbWidth, CV_8UC1);
-					memcpy(yuv.data, yPlane, yPlaneLen);
-					memcpy(yuv.data+yPlaneLen, vPlane, rgbHeight/2*rgbWidth);
-					cv::cvtColor(yuv, outputRGB, cv::COLOR_YUV2BGR_NV21);
-				}
-				else
-				{
+				// The planes are read in place (they don't need to be
+				// concatenated), decimated in the same pass if not full resolution
+				YuvToBgr::convert(
+						(const unsigned char *)yPlane, rgbWidth,
+						(const unsigned char *)vPlane, rgbWidth,
+						rgbWidth, rgbHeight,
 #ifdef __ANDROID__
-					cv::cvtColor(cv::Mat(rgbHeight+rgbHeight/2, rgbWidth, CV_8UC1, (void*)yPlane), outputRGB, cv::COLOR_YUV2BGR_NV21);
+						YuvToBgr::kNV21,
 #else // __APPLE__
-					cv::cvtColor(cv::Mat(rgbHeight+rgbHeight/2, rgbWidth, CV_8UC1, (void*)yPlane), outputRGB, cv::COLOR_YUV2RGB_NV21);
+						YuvToBgr::kNV12,
 #endif
-				}
+						fullResolution_?1:2,
+						rgbBuffer_);
+				outputRGB = rgbBuffer_;
 
 
 				cv::Mat outputDepth;
@@ -4112,44 +4410,20 @@ void RTABMapApp::postOdometryEvent(
 #endif
                     if(depthLen == 4*depthWidth*depthHeight)
                     {
-                        // IOS
-                        outputDepth = cv::Mat(depthHeight, depthWidth, CV_32FC1, (void*)depth).clone();
-                        if(conf && confWidth == depthWidth && confHeight == depthHeight && confFormat == 1278226488 && depthConfidence_>0)
-                        {
-                            const unsigned char * confPtr = (const unsigned char *)conf;
-                            float * depthPtr = outputDepth.ptr<float>();
-                            int i=0;
-                            for (int y = 0; y < outputDepth.rows; ++y)
-                            {
-                                for (int x = 0; x < outputDepth.cols; ++x)
-                                {
-                                    // https://developer.apple.com/documentation/arkit/arconfidencelevel
-                                    // 0 = low
-                                    // 1 = medium
-                                    // 2 = high
-                                    if(confPtr[y*outputDepth.cols + x] < depthConfidence_)
-                                    {
-                                        depthPtr[y*outputDepth.cols + x] = 0.0f;
-                                        ++i;
-                                    }
-                                }
-                            }
-                        }
+                        // IOS, low confidence pixels are removed during the copy
+                        // https://developer.apple.com/documentation/arkit/arconfidencelevel
+                        // 0 = low
+                        // 1 = medium
+                        // 2 = high
+                        bool masked = conf && confWidth == depthWidth && confHeight == depthHeight && confFormat == 1278226488 && depthConfidence_>0;
+                        DepthImage::fromFloat((const float *)depth, masked?(const unsigned char *)conf:0, depthWidth, depthHeight, depthConfidence_, depthBuffer_);
+                        outputDepth = depthBuffer_;
                     }
                     else if(depthLen == 2*depthWidth*depthHeight)
                     {
-                        // ANDROID
-                        outputDepth = cv::Mat(depthHeight, depthWidth, CV_16UC1);
-                        uint16_t *dataShort = (uint16_t *)depth;
-                        for (int y = 0; y < outputDepth.rows; ++y)
-                        {
-                            for (int x = 0; x < outputDepth.cols; ++x)
-                            {
-                                uint16_t depthSample = dataShort[y*outputDepth.cols + x];
-                                uint16_t depthRange = (depthSample & 0x1FFF); // first 3 bits are confidence
-                                outputDepth.at<uint16_t>(y,x) = depthRange;
-                            }
-                        }
+                        // ANDROID, first 3 bits are confidence
+                        DepthImage::fromDepth16((const unsigned short *)depth, depthWidth, depthHeight, depthBuffer_);
+                        outputDepth = depthBuffer_;
                     }
 				}
 
@@ -4197,7 +4471,7 @@ void RTABMapApp::postOdometryEvent(
 							}
 						}
 						rtabmap::Transform rgbToDepth = motion*rgbFrame.inverse()*depthFrame;
-						float scale = (float)outputDepth.cols/(float)outputRGB.cols;
+						float scale = (float)outputDepth.cols/(float)rgbWidth;
 						cv::Mat colorK = (cv::Mat_<double>(3,3) <<
 								rgb_fx*scale, 0, rgb_cx*scale,
 								0, rgb_fy*scale, rgb_cy*scale,
@@ -4206,7 +4480,7 @@ void RTABMapApp::postOdometryEvent(
 								depth_fx, 0, depth_cx,
 								0, depth_fy, depth_cy,
 								0, 0, 1);
-						outputDepth = rtabmap::util2d::registerDepth(outputDepth, depthK, outputDepth.size(), colorK, rgbToDepth);
+						outputDepth = depthRegistration_.registerDepth(outputDepth, depthK, outputDepth.size(), colorK, rgbToDepth);
 #ifndef DISABLE_LOG
 						UDEBUG("Depth registration time: %fs", time.elapsed());
 #endif
@@ -4218,7 +4492,7 @@ void RTABMapApp::postOdometryEvent(
 #endif
                     if(!fullResolution_)
                     {
-                        outputRGB = rtabmap::util2d::decimate(outputRGB, 2);
+                        // already decimated by the conversion
                         model = model.scaled(1.0/double(2));
                     }
                     
@@ -4414,6 +4688,103 @@ bool RTABMapApp::handleEvent(UEvent * event)
 		}
 	}
 
+	if(event->getClassName().compare("VolumeEvent") == 0)
+	{
+		double volume = ((VolumeEvent*)event)->getVolume();
+		LOGI("Received VolumeEvent! volume=%f", volume);
+
+		// Call JAVA callback with the new volume
+		bool success = false;
+#ifdef __ANDROID__
+		if(jvm && RTABMapActivity)
+		{
+			JNIEnv *env = 0;
+			jint rs = jvm->AttachCurrentThread(&env, NULL);
+			if(rs == JNI_OK && env)
+			{
+				jclass clazz = env->GetObjectClass(RTABMapActivity);
+				if(clazz)
+				{
+					jmethodID methodID = env->GetMethodID(clazz, "volumeUpdatedCallback", "(D)V" );
+					if(methodID)
+					{
+						env->CallVoidMethod(RTABMapActivity, methodID, volume);
+						success = true;
+					}
+					else
+					{
+						// Optional callback, clear the NoSuchMethodError
+						env->ExceptionClear();
+						success = true;
+					}
+				}
+			}
+			jvm->DetachCurrentThread();
+		}
+#else
+        if(swiftClassPtr_)
+        {
+            if(swiftVolumeCallback)
+            {
+                swiftVolumeCallback(swiftClassPtr_, volume);
+            }
+            success = true;
+        }
+#endif
+		if(!success)
+		{
+			UERROR("Failed to call RTABMapActivity::volumeUpdatedCallback");
+		}
+	}
+
+	if(event->getClassName().compare("VolumeRefinedEvent") == 0)
+	{
+		double volume = ((VolumeRefinedEvent*)event)->getVolume();
+		double delta = ((VolumeRefinedEvent*)event)->getDelta();
+		LOGI("Received VolumeRefinedEvent! volume=%f delta=%f", volume, delta);
+
+		bool success = false;
+#ifdef __ANDROID__
+		if(jvm && RTABMapActivity)
+		{
+			JNIEnv *env = 0;
+			jint rs = jvm->AttachCurrentThread(&env, NULL);
+			if(rs == JNI_OK && env)
+			{
+				jclass clazz = env->GetObjectClass(RTABMapActivity);
+				if(clazz)
+				{
+					jmethodID methodID = env->GetMethodID(clazz, "volumeRefinedCallback", "(DD)V" );
+					if(methodID)
+					{
+						env->CallVoidMethod(RTABMapActivity, methodID, volume, delta);
+					}
+					else
+					{
+						// Optional callback, clear the NoSuchMethodError
+						env->ExceptionClear();
+					}
+					success = true;
+				}
+			}
+			jvm->DetachCurrentThread();
+		}
+#else
+        if(swiftClassPtr_)
+        {
+            if(swiftVolumeRefinedCallback)
+            {
+                swiftVolumeRefinedCallback(swiftClassPtr_, volume, delta);
+            }
+            success = true;
+        }
+#endif
+		if(!success)
+		{
+			UERROR("Failed to call RTABMapActivity::volumeRefinedCallback");
+		}
+	}
+
 	if(event->getClassName().compare("PostRenderEvent") == 0)
 	{
 		LOGI("Received PostRenderEvent!");
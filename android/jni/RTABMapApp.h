@@ -36,6 +36,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <tango-gl/util.h>
 
 #include "scene.h"
+#include "online_height_map.h"
+#include "cut_fill.h"
+#include "depth_registration.h"
 #include "CameraMobile.h"
 #include "util.h"
 #include "ProgressionStatus.h"
@@ -72,6 +75,8 @@ class RTABMapApp : public UEventsHandler {
                                                     int, int,
                                                     float, float, float, float, float, float),
                               void(*cameraInfoCallback)(void *, int, const char*, const char*));
+  void setupSwiftVolumeCallback(void(*volumeCallback)(void *, double));
+  void setupSwiftVolumeRefinedCallback(void(*volumeRefinedCallback)(void *, double, double));
     
 #endif
   ~RTABMapApp();
@@ -81,6 +86,28 @@ class RTABMapApp : public UEventsHandler {
   int openDatabase(const std::string & databasePath, bool databaseInMemory, bool optimize, bool clearDatabase);
 
   double calculateMeshVolume(); //헤더추가됨
+  double calculateMeshVolumePreview(); // low resolution volume if the full one is not ready
+  double calculateOptimizedMeshVolume(); // -1 if there is no optimized mesh
+  void setVolumeMode(int mode, float heightMapCellSize);
+  void setOnlineHeightMap(bool enabled, float cellSize);
+  double getOnlineVolume(); // -1 if not available
+  void setCropPreview(bool enabled);
+  void commitCrop();
+  void undoCrop();
+  void redoCrop();
+  bool addRoi(const std::string & name);
+  void removeRoi(const std::string & name);
+  std::vector<double> getRoiVolumes(const std::vector<std::string> & names);
+  void setPileSeparation(bool enabled, int minTriangles, float weldDistance);
+  std::vector<double> getPiles();
+  void setVolumeCapping(bool enabled);
+  bool setCropRegion(const std::vector<float> & primitives);
+  std::vector<double> computeCutFill(const std::string & databaseBefore, const std::string & databaseAfter, float cellSize);
+  void clearCutFill();
+  std::vector<double> estimateVolumeUncertainty(int samples, float referenceSigma);
+  std::vector<double> solveVolume(const std::string & roi, float tolerance, float minCellSize, float maxCellSize);
+  void setGroundReference(float band, float inlierDistance, bool quadratic);
+  void setDetectedPlanes(const std::vector<rtabmap::CameraMobile::DetectedPlane> & planes); // when not detected by the camera driver (iOS)
     
   bool isBuiltWith(int cameraDriver) const;
 #ifdef __ANDROID__
@@ -271,8 +298,16 @@ class RTABMapApp : public UEventsHandler {
   cv::Mat optTexture_;
   int optRefId_;
   rtabmap::Transform * optRefPose_; // App crashes when loading native library if not dynamic
+  rtabmap::Mesh cutFillMesh_;
+  bool cutFillUpdated_;
 
   Scene main_scene_;
+  OnlineHeightMap onlineHeightMap_;
+  std::atomic<bool> onlineHeightMapEnabled_; // set from the JNI thread, read on the OpenGL thread
+  std::vector<rtabmap::Transform> onlineHeightMapRoi_;
+  Eigen::Vector3f onlineHeightMapPlane_;
+  int groundSeedsRevision_;                 // detected planes given to the scene
+  rtabmap::Transform groundSeedsMapToOdom_;
     
     UTimer fpsTime_;
 
@@ -283,6 +318,9 @@ class RTABMapApp : public UEventsHandler {
 	rtabmap::Transform mapToOdom_;
 
 	boost::mutex cameraMutex_;
+	cv::Mat rgbBuffer_; // converted camera image, reused when no longer referenced (cameraMutex_)
+	cv::Mat depthBuffer_; // same for the depth image
+	DepthRegistration depthRegistration_; // cached rays for depth to color registration
 	boost::mutex rtabmapMutex_;
 	boost::mutex meshesMutex_;
 	boost::mutex sensorMutex_;
@@ -313,6 +351,8 @@ class RTABMapApp : public UEventsHandler {
                              int, int,
                              float, float, float, float, float, float);
     void(*swiftCameraInfoEventCallback)(void *, int, const char *, const char *);
+    void(*swiftVolumeCallback)(void *, double);
+    void(*swiftVolumeRefinedCallback)(void *, double, double);
     
 #endif
 };
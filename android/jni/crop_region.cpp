@@ -0,0 +1,427 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "crop_region.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <algorithm>
+#include <limits>
+
+TriangleBvh::TriangleBvh(const MeshVolume::VertexArrays & vertices, const std::vector<pcl::Vertices> & polygons, int leafSize) :
+		size_(polygons.size())
+{
+	UASSERT(leafSize > 0);
+	const size_t n = vertices.size();
+
+	// Bounds and centroid of each valid polygon
+	std::vector<Eigen::Vector3f> mins, maxs, centroids;
+	mins.reserve(polygons.size());
+	maxs.reserve(polygons.size());
+	centroids.reserve(polygons.size());
+	std::vector<int> slots(polygons.size(), -1);
+	for(size_t i=0; i<polygons.size(); ++i)
+	{
+		const std::vector<uint32_t> & v = polygons[i].vertices;
+		bool valid = v.size() >= 3;
+		for(size_t j=0; j<v.size() && valid; ++j)
+		{
+			valid = (size_t)v[j] < n;
+		}
+		if(!valid)
+		{
+			continue;
+		}
+		Eigen::Vector3f min(vertices.x[v[0]], vertices.y[v[0]], vertices.z[v[0]]);
+		Eigen::Vector3f max = min;
+		for(size_t j=1; j<v.size(); ++j)
+		{
+			Eigen::Vector3f p(vertices.x[v[j]], vertices.y[v[j]], vertices.z[v[j]]);
+			min = min.cwiseMin(p);
+			max = max.cwiseMax(p);
+		}
+		slots[i] = (int)mins.size();
+		mins.push_back(min);
+		maxs.push_back(max);
+		centroids.push_back((min+max)*0.5f);
+		polygons_.push_back((int)i);
+	}
+	if(polygons_.empty())
+	{
+		return;
+	}
+
+	nodes_.reserve(2*(polygons_.size()/leafSize+1));
+	Node root;
+	root.left = root.right = -1;
+	root.begin = 0;
+	root.end = (int)polygons_.size();
+	nodes_.push_back(root);
+	std::vector<int> stack(1, 0);
+	while(!stack.empty())
+	{
+		const int index = stack.back();
+		stack.pop_back();
+		const int begin = nodes_[index].begin;
+		const int end = nodes_[index].end;
+
+		Eigen::Vector3f min = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+		Eigen::Vector3f max = Eigen::Vector3f::Constant(std::numeric_limits<float>::lowest());
+		Eigen::Vector3f cmin = min;
+		Eigen::Vector3f cmax = max;
+		for(int k=begin; k<end; ++k)
+		{
+			const int s = slots[polygons_[k]];
+			min = min.cwiseMin(mins[s]);
+			max = max.cwiseMax(maxs[s]);
+			cmin = cmin.cwiseMin(centroids[s]);
+			cmax = cmax.cwiseMax(centroids[s]);
+		}
+		nodes_[index].min = min;
+		nodes_[index].max = max;
+		if(end - begin <= leafSize)
+		{
+			continue;
+		}
+
+		// Median split along the longest axis of the centroids
+		int axis;
+		(cmax - cmin).maxCoeff(&axis);
+		const int middle = (begin + end) / 2;
+		std::nth_element(polygons_.begin()+begin, polygons_.begin()+middle, polygons_.begin()+end,
+				[&](int a, int b) {return centroids[slots[a]][axis] < centroids[slots[b]][axis];});
+
+		Node left;
+		left.left = left.right = -1;
+		left.begin = begin;
+		left.end = middle;
+		Node right = left;
+		right.begin = middle;
+		right.end = end;
+		nodes_[index].left = (int)nodes_.size();
+		nodes_.push_back(left);
+		nodes_[index].right = (int)nodes_.size();
+		nodes_.push_back(right);
+		stack.push_back(nodes_[index].left);
+		stack.push_back(nodes_[index].right);
+	}
+}
+
+CropRegion::Primitive CropRegion::box(const rtabmap::Transform & pose, const Eigen::Vector3f & size, bool inverted)
+{
+	UASSERT(!pose.isNull() && size.minCoeff() >= 0.0f);
+	Primitive primitive;
+	primitive.type = kBox;
+	primitive.inverted = inverted;
+	primitive.rotation = pose.toEigen3f().linear();
+	primitive.center = Eigen::Vector3f(pose.x(), pose.y(), pose.z());
+	primitive.halfSize = size*0.5f;
+	return primitive;
+}
+
+CropRegion::Primitive CropRegion::prism(const std::vector<Eigen::Vector2f> & polygon, float floor, float ceiling, bool inverted)
+{
+	UASSERT(polygon.size() >= 3 && floor <= ceiling);
+	Primitive primitive;
+	primitive.type = kPrism;
+	primitive.inverted = inverted;
+	primitive.polygon.reset(new MeshCrop(polygon));
+	primitive.floor = floor;
+	primitive.ceiling = ceiling;
+	return primitive;
+}
+
+CropRegion::Primitive CropRegion::prism(const std::vector<rtabmap::Transform> & polygon, float floor, float ceiling, bool inverted)
+{
+	std::vector<Eigen::Vector2f> polygonXZ(polygon.size());
+	for(size_t i=0; i<polygon.size(); ++i)
+	{
+		polygonXZ[i] = Eigen::Vector2f(polygon[i].x(), polygon[i].z());
+	}
+	return prism(polygonXZ, floor, ceiling, inverted);
+}
+
+CropRegion::Primitive CropRegion::halfSpace(const Eigen::Vector3f & point, const Eigen::Vector3f & normal, bool inverted)
+{
+	UASSERT(normal.norm() > 0.0f);
+	Primitive primitive;
+	primitive.type = kHalfSpace;
+	primitive.inverted = inverted;
+	primitive.normal = normal.normalized();
+	primitive.offset = primitive.normal.dot(point);
+	return primitive;
+}
+
+bool CropRegion::inside(const Primitive & primitive, const Eigen::Vector3f & point)
+{
+	bool in = false;
+	if(primitive.type == kBox)
+	{
+		Eigen::Vector3f q = primitive.rotation.transpose() * (point - primitive.center);
+		in = (q.cwiseAbs() - primitive.halfSize).maxCoeff() <= 0.0f;
+	}
+	else if(primitive.type == kPrism)
+	{
+		in = point[1] >= primitive.floor && point[1] <= primitive.ceiling &&
+			 primitive.polygon->inside(point[0], point[2]);
+	}
+	else
+	{
+		in = primitive.normal.dot(point) <= primitive.offset;
+	}
+	return in != primitive.inverted;
+}
+
+int CropRegion::classify(const Primitive & primitive, const Eigen::Vector3f & center, const Eigen::Vector3f & halfSize)
+{
+	int c = 0;
+	if(primitive.type == kBox)
+	{
+		// Separating axes of the box and of the scene frame, inside if
+		// the bounds in the box frame are inside
+		const Eigen::Matrix3f absRotation = primitive.rotation.cwiseAbs();
+		const Eigen::Vector3f d = center - primitive.center;
+		const Eigen::Vector3f q = primitive.rotation.transpose() * d;
+		const Eigen::Vector3f extent = absRotation.transpose() * halfSize;
+		if((q.cwiseAbs() - primitive.halfSize - extent).maxCoeff() > 0.0f ||
+		   (d.cwiseAbs() - halfSize - absRotation * primitive.halfSize).maxCoeff() > 0.0f)
+		{
+			c = -1;
+		}
+		else if((q.cwiseAbs() + extent - primitive.halfSize).maxCoeff() <= 0.0f)
+		{
+			c = 1;
+		}
+	}
+	else if(primitive.type == kPrism)
+	{
+		if(center[1] + halfSize[1] < primitive.floor || center[1] - halfSize[1] > primitive.ceiling)
+		{
+			c = -1;
+		}
+		else
+		{
+			int xz = primitive.polygon->classify(
+					Eigen::Vector2f(center[0]-halfSize[0], center[2]-halfSize[2]),
+					Eigen::Vector2f(center[0]+halfSize[0], center[2]+halfSize[2]));
+			if(xz < 0)
+			{
+				c = -1;
+			}
+			else if(xz > 0 &&
+					center[1] - halfSize[1] >= primitive.floor &&
+					center[1] + halfSize[1] <= primitive.ceiling)
+			{
+				c = 1;
+			}
+		}
+	}
+	else
+	{
+		const float d = primitive.normal.dot(center);
+		const float r = primitive.normal.cwiseAbs().dot(halfSize);
+		c = d + r <= primitive.offset?1:d - r > primitive.offset?-1:0;
+	}
+	return primitive.inverted?-c:c;
+}
+
+bool CropRegion::inside(const Eigen::Vector3f & point) const
+{
+	for(size_t i=0; i<primitives_.size(); ++i)
+	{
+		if(!inside(primitives_[i], point))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int CropRegion::classify(const Eigen::Vector3f & min, const Eigen::Vector3f & max) const
+{
+	const Eigen::Vector3f center = (min + max) * 0.5f;
+	const Eigen::Vector3f halfSize = (max - min) * 0.5f;
+	int c = 1;
+	for(size_t i=0; i<primitives_.size(); ++i)
+	{
+		int ci = classify(primitives_[i], center, halfSize);
+		if(ci < 0)
+		{
+			return -1;
+		}
+		c = std::min(c, ci);
+	}
+	return c;
+}
+
+int CropRegion::crop(
+		const MeshVolume::VertexArrays & vertices,
+		const TriangleBvh & bvh,
+		const rtabmap::Transform & meshToScene,
+		std::vector<pcl::Vertices> & polygons,
+		std::vector<int> * keptIndices) const
+{
+	if(keptIndices)
+	{
+		keptIndices->clear();
+	}
+	const std::vector<TriangleBvh::Node> & nodes = bvh.nodes();
+	const std::vector<int> & order = bvh.polygons();
+	if(nodes.empty() || vertices.size() == 0)
+	{
+		polygons.clear();
+		return 0;
+	}
+	UASSERT(bvh.size() == polygons.size());
+
+	// Nodes are classified on their bounds in the scene frame
+	const Eigen::Affine3f transform = meshToScene.isNull()?Eigen::Affine3f::Identity():meshToScene.toEigen3f();
+	const Eigen::Matrix3f absRotation = transform.linear().cwiseAbs();
+	std::vector<unsigned char> keep(polygons.size(), 0);
+	std::vector<int> leaves; // crossing the boundary
+	std::vector<int> stack(1, 0);
+	while(!stack.empty())
+	{
+		const int index = stack.back();
+		const TriangleBvh::Node & node = nodes[index];
+		stack.pop_back();
+		const Eigen::Vector3f center = transform * ((node.min + node.max) * 0.5f);
+		const Eigen::Vector3f halfSize = absRotation * ((node.max - node.min) * 0.5f);
+		const int c = classify(center - halfSize, center + halfSize);
+		if(c > 0)
+		{
+			for(int k=node.begin; k<node.end; ++k)
+			{
+				keep[order[k]] = 1;
+			}
+		}
+		else if(c == 0)
+		{
+			if(node.left < 0)
+			{
+				leaves.push_back(index);
+			}
+			else
+			{
+				stack.push_back(node.left);
+				stack.push_back(node.right);
+			}
+		}
+	}
+
+	// Polygons are in one leaf only
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int i=0; i<(int)leaves.size(); ++i)
+	{
+		const TriangleBvh::Node & node = nodes[leaves[i]];
+		for(int k=node.begin; k<node.end; ++k)
+		{
+			const std::vector<uint32_t> & v = polygons[order[k]].vertices;
+			bool allInside = true;
+			for(size_t j=0; j<v.size() && allInside; ++j)
+			{
+				allInside = inside(transform * Eigen::Vector3f(vertices.x[v[j]], vertices.y[v[j]], vertices.z[v[j]]));
+			}
+			keep[order[k]] = allInside?1:0;
+		}
+	}
+
+	// In place, the order of the polygons is kept
+	size_t kept = 0;
+	for(size_t i=0; i<polygons.size(); ++i)
+	{
+		if(keep[i])
+		{
+			if(kept != i)
+			{
+				polygons[kept].vertices.swap(polygons[i].vertices);
+			}
+			if(keptIndices)
+			{
+				keptIndices->push_back((int)i);
+			}
+			++kept;
+		}
+	}
+	polygons.resize(kept);
+	return (int)kept;
+}
+
+int CropRegion::crop(
+		const MeshVolume::VertexArrays & vertices,
+		const rtabmap::Transform & meshToScene,
+		std::vector<pcl::Vertices> & polygons,
+		std::vector<int> * keptIndices) const
+{
+	if(keptIndices)
+	{
+		keptIndices->clear();
+	}
+	if(vertices.size() == 0)
+	{
+		polygons.clear();
+		return 0;
+	}
+
+	const Eigen::Affine3f transform = meshToScene.isNull()?Eigen::Affine3f::Identity():meshToScene.toEigen3f();
+	std::vector<unsigned char> insideVertices(vertices.size());
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+	for(int i=0; i<(int)vertices.size(); ++i)
+	{
+		insideVertices[i] = inside(transform * Eigen::Vector3f(vertices.x[i], vertices.y[i], vertices.z[i]))?1:0;
+	}
+
+	size_t kept = 0;
+	for(size_t i=0; i<polygons.size(); ++i)
+	{
+		// Invalid polygons are removed, like by the BVH
+		const std::vector<uint32_t> & v = polygons[i].vertices;
+		bool allInside = v.size() >= 3;
+		for(size_t j=0; j<v.size() && allInside; ++j)
+		{
+			allInside = v[j] < insideVertices.size() && insideVertices[v[j]] != 0;
+		}
+		if(allInside)
+		{
+			if(kept != i)
+			{
+				polygons[kept].vertices.swap(polygons[i].vertices);
+			}
+			if(keptIndices)
+			{
+				keptIndices->push_back((int)i);
+			}
+			++kept;
+		}
+	}
+	polygons.resize(kept);
+	return (int)kept;
+}
@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CROP_REGION_H_
+#define CROP_REGION_H_
+
+#include <vector>
+#include <memory>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <pcl/Vertices.h>
+#include <rtabmap/core/Transform.h>
+#include "mesh_volume.h"
+#include "mesh_crop.h"
+
+// Bounding volume hierarchy of the polygons of a mesh (mesh frame). Nodes
+// are split at the median of their polygon centroids along their longest
+// axis until they have at most leafSize polygons. Built once per mesh and
+// shared by the crop jobs.
+class TriangleBvh {
+public:
+	struct Node {
+		Eigen::Vector3f min;
+		Eigen::Vector3f max;
+		int left;  // children, -1 for a leaf
+		int right;
+		int begin; // range in polygons()
+		int end;
+	};
+
+	TriangleBvh(const MeshVolume::VertexArrays & vertices, const std::vector<pcl::Vertices> & polygons, int leafSize = 32);
+
+	// nodes()[0] is the root, empty if there are no valid polygons
+	const std::vector<Node> & nodes() const {return nodes_;}
+	// polygon indices in node order (polygons with invalid indices are not included)
+	const std::vector<int> & polygons() const {return polygons_;}
+	size_t size() const {return size_;} // polygons of the mesh
+	size_t memoryUsed() const {return nodes_.size()*sizeof(Node) + polygons_.size()*sizeof(int);}
+
+private:
+	std::vector<Node> nodes_;
+	std::vector<int> polygons_;
+	size_t size_;
+};
+
+// Crop primitives in the scene frame (y up): oriented box, prism (polygon
+// on x/z extruded between a floor and a ceiling) and half-space, each one
+// possibly inverted. A region is the intersection of its primitives, e.g.
+// a prism minus a box. Points are tested exactly, boxes are classified
+// conservatively (inside, outside or unknown), so that the polygons of a
+// mesh are selected by traversing its TriangleBvh: nodes fully inside or
+// outside are accepted or rejected without touching their polygons.
+class CropRegion {
+public:
+	enum Type {
+		kBox,       // oriented box
+		kPrism,     // polygon on x/z between floor and ceiling
+		kHalfSpace  // points under the plane (opposite to its normal)
+	};
+
+	struct Primitive {
+		Primitive() :
+			type(kHalfSpace),
+			inverted(false),
+			rotation(Eigen::Matrix3f::Identity()),
+			center(Eigen::Vector3f::Zero()),
+			halfSize(Eigen::Vector3f::Zero()),
+			floor(0.0f),
+			ceiling(0.0f),
+			normal(Eigen::Vector3f::UnitY()),
+			offset(0.0f)
+		{}
+		Type type;
+		bool inverted;              // keep what is outside
+		Eigen::Matrix3f rotation;   // kBox: box to scene
+		Eigen::Vector3f center;     // kBox
+		Eigen::Vector3f halfSize;   // kBox
+		std::shared_ptr<const MeshCrop> polygon; // kPrism
+		float floor;                // kPrism
+		float ceiling;              // kPrism
+		Eigen::Vector3f normal;     // kHalfSpace: inside if normal.p <= offset
+		float offset;               // kHalfSpace
+	};
+
+	static Primitive box(const rtabmap::Transform & pose, const Eigen::Vector3f & size, bool inverted = false);
+	static Primitive prism(const std::vector<Eigen::Vector2f> & polygon, float floor, float ceiling, bool inverted = false);
+	static Primitive prism(const std::vector<rtabmap::Transform> & polygon, float floor, float ceiling, bool inverted = false);
+	static Primitive halfSpace(const Eigen::Vector3f & point, const Eigen::Vector3f & normal, bool inverted = false);
+
+	void add(const Primitive & primitive) {primitives_.push_back(primitive);}
+	void clear() {primitives_.clear();}
+	bool empty() const {return primitives_.empty();}
+	const std::vector<Primitive> & primitives() const {return primitives_;}
+
+	bool inside(const Eigen::Vector3f & point) const;
+	// Box of the scene frame: 1 if fully inside, -1 if fully outside, 0 otherwise (or unknown).
+	int classify(const Eigen::Vector3f & min, const Eigen::Vector3f & max) const;
+
+	// Keep the polygons with all their vertices inside (order is kept). The
+	// nodes of the BVH of the polygons (before cropping) are classified
+	// first, only the polygons of the leaves crossing the boundary are
+	// tested, in parallel. Returns the number of polygons kept. If
+	// keptIndices is not null, it is filled with the original indices of
+	// the polygons kept.
+	int crop(
+			const MeshVolume::VertexArrays & vertices,
+			const TriangleBvh & bvh,
+			const rtabmap::Transform & meshToScene,
+			std::vector<pcl::Vertices> & polygons,
+			std::vector<int> * keptIndices = 0) const;
+	// Same without BVH, all vertices are classified (in parallel). Used
+	// for small meshes like the low resolution polygons.
+	int crop(
+			const MeshVolume::VertexArrays & vertices,
+			const rtabmap::Transform & meshToScene,
+			std::vector<pcl::Vertices> & polygons,
+			std::vector<int> * keptIndices = 0) const;
+
+private:
+	static bool inside(const Primitive & primitive, const Eigen::Vector3f & point);
+	static int classify(const Primitive & primitive, const Eigen::Vector3f & center, const Eigen::Vector3f & halfSize);
+
+private:
+	std::vector<Primitive> primitives_;
+};
+
+#endif /* CROP_REGION_H_ */
@@ -0,0 +1,467 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "cut_fill.h"
+
+#include <rtabmap/core/DBDriver.h>
+#include <rtabmap/core/util3d.h>
+#include <rtabmap/core/util3d_filtering.h>
+#include <rtabmap/core/util3d_transforms.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <pcl/kdtree/kdtree_flann.h>
+#include <Eigen/Geometry>
+#include <Eigen/Eigenvalues>
+#include <cmath>
+#include <limits>
+#include <map>
+
+namespace {
+
+const int kMaxIcpPoints = 20000; // points of the aligned session used by ICP
+const int kNormalK = 8;          // neighbors of the normals
+const int kCloudDecimation = 4;  // depth images of the nodes
+const float kCloudMaxDepth = 4.0f;
+const float kOverlayLift = 0.01f; // over the surface to avoid z-fighting
+
+void appendCloud(const pcl::PointCloud<pcl::PointXYZ> & cloud, MeshVolume::VertexArrays & vertices)
+{
+	size_t offset = vertices.size();
+	vertices.x.resize(offset+cloud.size());
+	vertices.y.resize(offset+cloud.size());
+	vertices.z.resize(offset+cloud.size());
+	for(size_t i=0; i<cloud.size(); ++i)
+	{
+		vertices.x[offset+i] = cloud.points[i].x;
+		vertices.y[offset+i] = cloud.points[i].y;
+		vertices.z[offset+i] = cloud.points[i].z;
+	}
+}
+
+} // namespace
+
+bool CutFill::load(const std::string & databasePath, float voxelSize, Session & session)
+{
+	UTimer time;
+	session = Session();
+	rtabmap::DBDriver * driver = rtabmap::DBDriver::create();
+	if(!driver->openConnection(databasePath))
+	{
+		UERROR("Cannot open database \"%s\"", databasePath.c_str());
+		delete driver;
+		return false;
+	}
+
+	// Optimized mesh saved in the database (as visualized on open)
+	std::vector<std::vector<std::vector<RTABMAP_PCL_INDEX> > > polygons;
+	cv::Mat cloudMat = driver->loadOptimizedMesh(&polygons);
+	if(!cloudMat.empty())
+	{
+		UASSERT(cloudMat.rows == 1 && cloudMat.depth() == CV_32F && cloudMat.channels() >= 3);
+		const int channels = cloudMat.channels(); // x, y, z first
+		const float * data = cloudMat.ptr<float>();
+		pcl::PointCloud<pcl::PointXYZ> cloud;
+		cloud.resize(cloudMat.cols);
+		for(int i=0; i<cloudMat.cols; ++i)
+		{
+			cloud.points[i] = pcl::PointXYZ(data[i*channels], data[i*channels+1], data[i*channels+2]);
+		}
+		appendCloud(*rtabmap::util3d::transformPointCloud(cloud.makeShared(), rtabmap::opengl_world_T_rtabmap_world), session.vertices);
+		for(size_t t=0; t<polygons.size(); ++t)
+		{
+			for(size_t i=0; i<polygons[t].size(); ++i)
+			{
+				pcl::Vertices polygon;
+				polygon.vertices.assign(polygons[t][i].begin(), polygons[t][i].end());
+				session.polygons.push_back(polygon);
+			}
+		}
+		LOGI("Cut/fill: loaded optimized mesh of \"%s\" (%d vertices, %d polygons): %fs",
+				databasePath.c_str(), (int)session.vertices.size(), (int)session.polygons.size(), time.ticks());
+	}
+	else
+	{
+		// Clouds of the nodes at their optimized poses
+		std::map<int, rtabmap::Transform> poses = driver->loadOptimizedPoses();
+		pcl::PointCloud<pcl::PointXYZ>::Ptr assembled(new pcl::PointCloud<pcl::PointXYZ>);
+		for(std::map<int, rtabmap::Transform>::iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+		{
+			rtabmap::SensorData data;
+			driver->getNodeData(iter->first, data, true, true, false, false);
+			cv::Mat rgb, depth;
+			rtabmap::LaserScan scan;
+			data.uncompressData(&rgb, &depth, &scan);
+			pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
+			if(!depth.empty())
+			{
+				cloud = rtabmap::util3d::cloudFromSensorData(data, kCloudDecimation, kCloudMaxDepth);
+			}
+			else if(!scan.isEmpty())
+			{
+				cloud = rtabmap::util3d::laserScanToPointCloud(scan, scan.localTransform());
+			}
+			if(cloud.get() && !cloud->empty())
+			{
+				if(voxelSize > 0.0f)
+				{
+					cloud = rtabmap::util3d::voxelize(cloud, voxelSize);
+				}
+				*assembled += *rtabmap::util3d::transformPointCloud(cloud, rtabmap::opengl_world_T_rtabmap_world*iter->second);
+			}
+		}
+		if(voxelSize > 0.0f && !assembled->empty())
+		{
+			assembled = rtabmap::util3d::voxelize(assembled, voxelSize);
+		}
+		appendCloud(*assembled, session.vertices);
+		LOGI("Cut/fill: loaded clouds of \"%s\" (%d nodes, %d points): %fs",
+				databasePath.c_str(), (int)poses.size(), (int)session.vertices.size(), time.ticks());
+	}
+	driver->closeConnection(false);
+	delete driver;
+
+	if(session.vertices.size() == 0)
+	{
+		UERROR("No optimized mesh or clouds found in database \"%s\"", databasePath.c_str());
+		return false;
+	}
+	return true;
+}
+
+Eigen::Vector3f CutFill::groundPlane(const MeshVolume::VertexArrays & vertices, float cellSize)
+{
+	UASSERT(cellSize > 0.0f);
+	std::map<std::pair<int, int>, int> lowest;
+	for(size_t i=0; i<vertices.size(); ++i)
+	{
+		std::pair<int, int> cell((int)std::floor(vertices.x[i]/cellSize), (int)std::floor(vertices.z[i]/cellSize));
+		std::map<std::pair<int, int>, int>::iterator iter = lowest.find(cell);
+		if(iter == lowest.end())
+		{
+			lowest.insert(std::make_pair(cell, (int)i));
+		}
+		else if(vertices.y[i] < vertices.y[iter->second])
+		{
+			iter->second = (int)i;
+		}
+	}
+	std::vector<Eigen::Vector3f> points;
+	points.reserve(lowest.size());
+	for(std::map<std::pair<int, int>, int>::iterator iter=lowest.begin(); iter!=lowest.end(); ++iter)
+	{
+		points.push_back(Eigen::Vector3f(vertices.x[iter->second], vertices.y[iter->second], vertices.z[iter->second]));
+	}
+	return HeightMap::fitPlane(points);
+}
+
+rtabmap::Transform CutFill::align(
+		const MeshVolume::VertexArrays & from,
+		const MeshVolume::VertexArrays & to,
+		float maxCorrespondenceDistance,
+		int iterations,
+		float * rmse)
+{
+	UASSERT(maxCorrespondenceDistance > 0.0f && iterations >= 0);
+	if(from.size() == 0 || to.size() == 0)
+	{
+		return rtabmap::Transform();
+	}
+	UTimer time;
+
+	// (1) Seed: ground plane of "to" on ground plane of "from" (roll, pitch, height)
+	Eigen::Vector3f planeFrom = groundPlane(from);
+	Eigen::Vector3f planeTo = groundPlane(to);
+	Eigen::Vector3f normalFrom = Eigen::Vector3f(-planeFrom[0], 1.0f, -planeFrom[1]).normalized();
+	Eigen::Vector3f normalTo = Eigen::Vector3f(-planeTo[0], 1.0f, -planeTo[1]).normalized();
+	Eigen::Matrix3f R = Eigen::Quaternionf::FromTwoVectors(normalTo, normalFrom).toRotationMatrix();
+	Eigen::Vector2f centroid(0.0f, 0.0f);
+	for(size_t i=0; i<to.size(); ++i)
+	{
+		centroid += Eigen::Vector2f(to.x[i], to.z[i]);
+	}
+	centroid /= float(to.size());
+	Eigen::Vector3f ground = R * Eigen::Vector3f(
+			centroid[0],
+			planeTo[0]*centroid[0] + planeTo[1]*centroid[1] + planeTo[2],
+			centroid[1]);
+	float offset = planeFrom[0]*ground[0] + planeFrom[1]*ground[2] + planeFrom[2] - ground[1];
+	Eigen::Affine3f transform = Eigen::Translation3f(0.0f, offset, 0.0f) * R;
+
+	// (2) 4-DoF point to plane ICP: yaw around the ground normal (y) and
+	// translation. Normals of the matched points are estimated from their
+	// neighbors, correspondences and normals are computed in parallel.
+	pcl::PointCloud<pcl::PointXYZ>::Ptr target(new pcl::PointCloud<pcl::PointXYZ>);
+	target->resize(from.size());
+	for(size_t i=0; i<from.size(); ++i)
+	{
+		target->points[i] = pcl::PointXYZ(from.x[i], from.y[i], from.z[i]);
+	}
+	pcl::KdTreeFLANN<pcl::PointXYZ> tree;
+	tree.setInputCloud(target);
+
+	const int step = std::max(1, (int)to.size()/kMaxIcpPoints);
+	const int n = ((int)to.size()+step-1)/step;
+	const float maxSquaredDistance = maxCorrespondenceDistance*maxCorrespondenceDistance;
+	std::vector<Eigen::Vector3f> sources(n);
+	std::vector<Eigen::Vector3f> targets(n);
+	std::vector<Eigen::Vector3f> normals(n);
+	std::vector<float> squaredDistances(n);
+	float error = 0.0f;
+	int it = 0;
+	for(; it<iterations; ++it)
+	{
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 256)
+#endif
+		for(int i=0; i<n; ++i)
+		{
+			const size_t j = size_t(i)*step;
+			sources[i] = transform * Eigen::Vector3f(to.x[j], to.y[j], to.z[j]);
+			squaredDistances[i] = -1.0f;
+			std::vector<int> k(kNormalK);
+			std::vector<float> d(kNormalK);
+			pcl::PointXYZ pt(sources[i][0], sources[i][1], sources[i][2]);
+			if(tree.nearestKSearch(pt, kNormalK, k, d) == kNormalK && d[0] <= maxSquaredDistance)
+			{
+				Eigen::Vector3f mean = Eigen::Vector3f::Zero();
+				for(int l=0; l<kNormalK; ++l)
+				{
+					mean += target->points[k[l]].getVector3fMap();
+				}
+				mean /= float(kNormalK);
+				Eigen::Matrix3f covariance = Eigen::Matrix3f::Zero();
+				for(int l=0; l<kNormalK; ++l)
+				{
+					Eigen::Vector3f v = target->points[k[l]].getVector3fMap() - mean;
+					covariance += v * v.transpose();
+				}
+				Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+				normals[i] = solver.eigenvectors().col(0); // smallest eigenvalue
+				targets[i] = target->points[k[0]].getVector3fMap();
+				squaredDistances[i] = d[0];
+			}
+		}
+
+		// Linearized around the current pose: R(yaw)*p ~ p + yaw*(p.z, 0, -p.x)
+		Eigen::Matrix4d A = Eigen::Matrix4d::Zero();
+		Eigen::Vector4d b = Eigen::Vector4d::Zero();
+		double sum = 0.0;
+		int count = 0;
+		for(int i=0; i<n; ++i)
+		{
+			if(squaredDistances[i] >= 0.0f)
+			{
+				const Eigen::Vector3d p = sources[i].cast<double>();
+				const Eigen::Vector3d normal = normals[i].cast<double>();
+				const double r = normal.dot(p - targets[i].cast<double>());
+				Eigen::Vector4d J(normal.dot(Eigen::Vector3d(p[2], 0.0, -p[0])), normal[0], normal[1], normal[2]);
+				A += J * J.transpose();
+				b -= J * r;
+				sum += r*r;
+				++count;
+			}
+		}
+		if(count < 10)
+		{
+			UWARN("Cut/fill: not enough correspondences (%d) to align the sessions", count);
+			return rtabmap::Transform();
+		}
+		error = std::sqrt(sum/double(count));
+
+		// damped, flat areas don't constrain the yaw and the x/z translation
+		A.diagonal().array() += 1e-6 * A.trace();
+		Eigen::Vector4d x = A.ldlt().solve(b);
+		float yaw = (float)x[0];
+		Eigen::Vector3f t = x.tail<3>().cast<float>();
+		transform = Eigen::Translation3f(t) * Eigen::AngleAxisf(yaw, Eigen::Vector3f::UnitY()) * transform;
+		if(std::fabs(yaw) < 1e-5f && t.norm() < 1e-4f)
+		{
+			break;
+		}
+	}
+	LOGI("Cut/fill: sessions aligned (%d iterations, rmse=%f m): %fs", it, error, time.ticks());
+	if(rmse)
+	{
+		*rmse = error;
+	}
+	return rtabmap::Transform::fromEigen3f(transform);
+}
+
+CutFill::Stats CutFill::compute(
+		const Session & before,
+		const Session & after,
+		const rtabmap::Transform & afterPose,
+		float cellSize,
+		float minDifference)
+{
+	UASSERT(cellSize > 0.0f && minDifference >= 0.0f);
+	Stats stats;
+	before_.clear();
+	after_.clear();
+	difference_ = cv::Mat();
+
+	// Grid over the area covered by both sessions
+	std::vector<MeshVolume::Input> beforeInputs(1, MeshVolume::Input(&before.vertices, &before.polygons, rtabmap::Transform::getIdentity()));
+	std::vector<MeshVolume::Input> afterInputs(1, MeshVolume::Input(&after.vertices, &after.polygons, afterPose));
+	Eigen::Vector2f minBefore, maxBefore, minAfter, maxAfter;
+	if(!HeightMap::bounds(beforeInputs, minBefore, maxBefore) || !HeightMap::bounds(afterInputs, minAfter, maxAfter))
+	{
+		UWARN("Cut/fill: empty session");
+		return stats;
+	}
+	Eigen::Vector2f min = minBefore.cwiseMax(minAfter);
+	Eigen::Vector2f max = maxBefore.cwiseMin(maxAfter);
+	if(min[0] >= max[0] || min[1] >= max[1])
+	{
+		UWARN("Cut/fill: the sessions don't overlap");
+		return stats;
+	}
+	before_.create(min, max, cellSize);
+	after_.create(min, max, cellSize);
+	if(before.polygons.empty())
+	{
+		before_.addPoints(before.vertices, rtabmap::Transform::getIdentity());
+	}
+	else
+	{
+		before_.addMeshes(beforeInputs);
+	}
+	if(after.polygons.empty())
+	{
+		after_.addPoints(after.vertices, afterPose);
+	}
+	else
+	{
+		after_.addMeshes(afterInputs);
+	}
+
+	// Top surfaces compared cell by cell
+	difference_ = after_.maxHeights() - before_.maxHeights(); // NaN if not observed in one session
+	const double cellArea = double(after_.cellSize())*double(after_.cellSize());
+	for(int r=0; r<difference_.rows; ++r)
+	{
+		const float * row = difference_.ptr<float>(r);
+		for(int c=0; c<difference_.cols; ++c)
+		{
+			const float d = row[c];
+			if(!std::isfinite(d))
+			{
+				continue;
+			}
+			++stats.cells;
+			if(d >= minDifference)
+			{
+				stats.fill += d*cellArea;
+			}
+			else if(d <= -minDifference)
+			{
+				stats.cut -= d*cellArea;
+			}
+		}
+	}
+	stats.area = stats.cells*cellArea;
+	LOGI("Cut/fill: cut=%f m^3, fill=%f m^3, net=%f m^3, area=%f m^2 (%dx%d cells of %f m)",
+			stats.cut, stats.fill, stats.net(), stats.area, difference_.cols, difference_.rows, after_.cellSize());
+	return stats;
+}
+
+rtabmap::Mesh CutFill::overlayMesh(float maxDifference, float minDifference) const
+{
+	UASSERT(maxDifference > 0.0f);
+	rtabmap::Mesh mesh;
+	mesh.pose = rtabmap::Transform::getIdentity();
+	if(difference_.empty())
+	{
+		return mesh;
+	}
+	const int rows = difference_.rows;
+	const int cols = difference_.cols;
+	const float cellSize = after_.cellSize();
+	std::vector<int> vertexIndices(rows*cols, -1);
+	for(int r=0; r<rows; ++r)
+	{
+		const float * d = difference_.ptr<float>(r);
+		const float * h = after_.maxHeights().ptr<float>(r);
+		for(int c=0; c<cols; ++c)
+		{
+			if(!std::isfinite(d[c]))
+			{
+				continue;
+			}
+			pcl::PointXYZRGB pt;
+			pt.x = after_.origin()[0] + (float(c)+0.5f)*cellSize;
+			pt.y = h[c] + kOverlayLift;
+			pt.z = after_.origin()[1] + (float(r)+0.5f)*cellSize;
+			pt.r = pt.g = pt.b = 128;
+			if(std::fabs(d[c]) >= minDifference)
+			{
+				float t = std::min(1.0f, std::fabs(d[c])/maxDifference);
+				unsigned char high = (unsigned char)(128.0f + 127.0f*t);
+				unsigned char low = (unsigned char)(128.0f*(1.0f-t));
+				pt.r = d[c]<0?high:low; // cut
+				pt.g = low;
+				pt.b = d[c]>0?high:low; // fill
+			}
+			vertexIndices[r*cols+c] = (int)mesh.cloud->size();
+			mesh.cloud->push_back(pt);
+		}
+	}
+
+	// Two triangles (facing up) per quad of observed cells
+	std::vector<pcl::Vertices> polygons;
+	for(int r=0; r+1<rows; ++r)
+	{
+		for(int c=0; c+1<cols; ++c)
+		{
+			int a = vertexIndices[r*cols+c];
+			int b = vertexIndices[(r+1)*cols+c];
+			int e = vertexIndices[r*cols+c+1];
+			int f = vertexIndices[(r+1)*cols+c+1];
+			if(a>=0 && b>=0 && e>=0 && f>=0)
+			{
+				pcl::Vertices polygon;
+				polygon.vertices.resize(3);
+				polygon.vertices[0] = a;
+				polygon.vertices[1] = b;
+				polygon.vertices[2] = e;
+				polygons.push_back(polygon);
+				polygon.vertices[0] = e;
+				polygon.vertices[1] = b;
+				polygon.vertices[2] = f;
+				polygons.push_back(polygon);
+			}
+		}
+	}
+	mesh.polygons = polygons;
+	mesh.indices->resize(mesh.cloud->size());
+	for(size_t i=0; i<mesh.indices->size(); ++i)
+	{
+		mesh.indices->at(i) = (int)i;
+	}
+	return mesh;
+}
@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CUT_FILL_H_
+#define CUT_FILL_H_
+
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+#include <pcl/Vertices.h>
+#include <rtabmap/core/Transform.h>
+#include "mesh_volume.h"
+#include "height_map.h"
+#include "util.h"
+
+// Cut/fill volume between two sessions of the same site. Each session is
+// loaded from its database (optimized mesh if saved, otherwise the node
+// clouds at their optimized poses) in scene frame (y up). The second
+// session is aligned on the first one: the ground planes are matched
+// first (roll, pitch and height), then a 4-DoF ICP (x, y, z, yaw) refines
+// the alignment, correspondences being searched in parallel. Both sessions
+// are rasterized in height maps on the same grid and compared cell by cell.
+class CutFill {
+public:
+	struct Session {
+		MeshVolume::VertexArrays vertices;   // scene frame
+		std::vector<pcl::Vertices> polygons; // empty if only a cloud was saved
+	};
+
+	struct Stats {
+		Stats() :
+			cut(0.0),
+			fill(0.0),
+			area(0.0),
+			cells(0)
+		{}
+		double net() const {return fill - cut;}
+
+		double cut;  // material removed (m^3)
+		double fill; // material added (m^3)
+		double area; // area observed in both sessions (m^2)
+		int cells;
+	};
+
+public:
+	// Vertices closer than voxelSize are merged for the clouds (not for meshes).
+	static bool load(const std::string & databasePath, float voxelSize, Session & session);
+
+	// Ground plane y = a*x + b*z + c fitted on the lowest point of each cell.
+	static Eigen::Vector3f groundPlane(const MeshVolume::VertexArrays & vertices, float cellSize = 0.5f);
+
+	// Transform of session "to" aligning it on session "from".
+	static rtabmap::Transform align(
+			const MeshVolume::VertexArrays & from,
+			const MeshVolume::VertexArrays & to,
+			float maxCorrespondenceDistance = 0.5f,
+			int iterations = 30,
+			float * rmse = 0);
+
+public:
+	CutFill() {}
+
+	// Difference after - before of the top surfaces, afterPose is applied
+	// to the session after (see align()).
+	Stats compute(
+			const Session & before,
+			const Session & after,
+			const rtabmap::Transform & afterPose,
+			float cellSize = 0.05f,
+			float minDifference = 0.01f);
+
+	// Per cell difference (m), CV_32FC1, NaN if not observed in both sessions.
+	const cv::Mat & difference() const {return difference_;}
+	float cellSize() const {return after_.cellSize();}
+	const Eigen::Vector2f & origin() const {return after_.origin();}
+
+	// Grid mesh on the top surface of the session after, colored by the
+	// difference: red for cut, blue for fill, gray under minDifference.
+	// The colors are saturated at maxDifference.
+	rtabmap::Mesh overlayMesh(float maxDifference = 0.5f, float minDifference = 0.01f) const;
+
+private:
+	HeightMap before_;
+	HeightMap after_;
+	cv::Mat difference_;
+};
+
+#endif /* CUT_FILL_H_ */
@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include "depth_image.h"
+#include "util.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <algorithm>
+#include <cstring>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DEPTH_IMAGE_NEON
+#endif
+
+void DepthImage::fromFloat(
+		const float * depth,
+		const unsigned char * confidence,
+		int width, int height,
+		int minConfidence,
+		cv::Mat & output)
+{
+	UASSERT(depth && width > 0 && height > 0);
+	rtabmap::createUnshared(output, height, width, CV_32FC1);
+	if(confidence && minConfidence > 0)
+	{
+		maskConfidence(depth, confidence, width*height, (unsigned char)std::min(minConfidence, 255), output.ptr<float>());
+	}
+	else
+	{
+		memcpy(output.data, depth, width*height*sizeof(float));
+	}
+}
+
+void DepthImage::fromDepth16(
+		const unsigned short * depth,
+		int width, int height,
+		cv::Mat & output)
+{
+	UASSERT(depth && width > 0 && height > 0);
+	rtabmap::createUnshared(output, height, width, CV_16UC1);
+	unpackDepth16(depth, width*height, output.ptr<unsigned short>());
+}
+
+void DepthImage::maskConfidence(const float * depth, const unsigned char * confidence, int count, unsigned char minConfidence, float * output)
+{
+	int i = 0;
+#ifdef DEPTH_IMAGE_NEON
+	const uint8x16_t threshold = vdupq_n_u8(minConfidence);
+	for(; i+16<=count; i+=16)
+	{
+		// -1 (all bits set) where the confidence is high enough, sign
+		// extended to the 16 floats
+		const int8x16_t keep = vreinterpretq_s8_u8(vcgeq_u8(vld1q_u8(confidence + i), threshold));
+		const int16x8_t low = vmovl_s8(vget_low_s8(keep));
+		const int16x8_t high = vmovl_s8(vget_high_s8(keep));
+		const uint32x4_t masks[4] = {
+				vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(low))),
+				vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(low))),
+				vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(high))),
+				vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(high)))};
+		for(int k=0; k<4; ++k)
+		{
+			const uint32x4_t d = vreinterpretq_u32_f32(vld1q_f32(depth + i + k*4));
+			vst1q_f32(output + i + k*4, vreinterpretq_f32_u32(vandq_u32(d, masks[k])));
+		}
+	}
+#endif
+	for(; i<count; ++i)
+	{
+		output[i] = confidence[i] >= minConfidence?depth[i]:0.0f;
+	}
+}
+
+void DepthImage::unpackDepth16(const unsigned short * depth, int count, unsigned short * output)
+{
+	int i = 0;
+#ifdef DEPTH_IMAGE_NEON
+	const uint16x8_t range = vdupq_n_u16(0x1FFF);
+	for(; i+8<=count; i+=8)
+	{
+		vst1q_u16(output + i, vandq_u16(vld1q_u16(depth + i), range));
+	}
+#endif
+	for(; i<count; ++i)
+	{
+		output[i] = depth[i] & 0x1FFF;
+	}
+}
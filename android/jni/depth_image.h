@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#ifndef DEPTH_IMAGE_H_
+#define DEPTH_IMAGE_H_
+
+#include <opencv2/core/core.hpp>
+
+// Depth images of the AR frameworks copied in one vectorized pass. The
+// output is reused if it has the right size and type and its data is not
+// shared (e.g., with a SensorData still in use), otherwise it is reallocated.
+class DepthImage {
+public:
+	// Float depth (m, iOS) with the pixels of confidence lower than
+	// minConfidence set to 0 during the copy. confidence (same size as the
+	// depth) can be null or minConfidence 0 to copy without masking.
+	static void fromFloat(
+			const float * depth,
+			const unsigned char * confidence,
+			int width, int height,
+			int minConfidence,
+			cv::Mat & output);
+
+	// DEPTH16 (Android): the 13 low bits are the range (mm) and the 3 high
+	// bits the confidence, which is removed.
+	static void fromDepth16(
+			const unsigned short * depth,
+			int width, int height,
+			cv::Mat & output);
+
+	// Same on count contiguous pixels
+	static void maskConfidence(const float * depth, const unsigned char * confidence, int count, unsigned char minConfidence, float * output);
+	static void unpackDepth16(const unsigned short * depth, int count, unsigned short * output);
+};
+
+#endif /* DEPTH_IMAGE_H_ */
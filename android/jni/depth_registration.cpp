@@ -0,0 +1,237 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include "depth_registration.h"
+#include "util.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define DEPTH_REGISTRATION_NEON
+#endif
+
+namespace {
+
+#ifdef DEPTH_REGISTRATION_NEON
+inline float32x4_t loadDepth(const unsigned short * depth)
+{
+	return vcvtq_f32_u32(vmovl_u16(vld1_u16(depth)));
+}
+inline float32x4_t loadDepth(const float * depth)
+{
+	return vld1q_f32(depth);
+}
+#endif
+
+// One row of depth pixels to color pixels: u = d*(px[x] + r) + t, with
+// d the depth (m) and r the row term of each projection row.
+template<typename T>
+void projectRow(
+		const T * depth, float scale, int cols,
+		const float * px0, const float * px1, const float * px2,
+		float r0, float r1, float r2,
+		float t0, float t1, float t2,
+		int colorCols, int colorRows,
+		int * indices, float * depths)
+{
+	int x = 0;
+#ifdef DEPTH_REGISTRATION_NEON
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+	for(; x+4<=cols; x+=4)
+	{
+		const float32x4_t d = vmulq_n_f32(loadDepth(depth + x), scale);
+		const float32x4_t u = vmlaq_f32(vdupq_n_f32(t0), d, vaddq_f32(vld1q_f32(px0 + x), vdupq_n_f32(r0)));
+		const float32x4_t v = vmlaq_f32(vdupq_n_f32(t1), d, vaddq_f32(vld1q_f32(px1 + x), vdupq_n_f32(r1)));
+		const float32x4_t z = vmlaq_f32(vdupq_n_f32(t2), d, vaddq_f32(vld1q_f32(px2 + x), vdupq_n_f32(r2)));
+		const uint32x4_t valid = vandq_u32(vcgtq_f32(d, zero), vcgtq_f32(z, zero));
+		// truncated like the scalar version
+		const int32x4_t c = vcvtq_s32_f32(vdivq_f32(u, z));
+		const int32x4_t r = vcvtq_s32_f32(vdivq_f32(v, z));
+		const uint32x4_t inside = vandq_u32(valid, vandq_u32(
+				vandq_u32(vcgeq_s32(c, vdupq_n_s32(0)), vcltq_s32(c, vdupq_n_s32(colorCols))),
+				vandq_u32(vcgeq_s32(r, vdupq_n_s32(0)), vcltq_s32(r, vdupq_n_s32(colorRows)))));
+		const int32x4_t index = vmlaq_n_s32(c, r, colorCols);
+		vst1q_s32(indices + x, vbslq_s32(inside, index, vdupq_n_s32(-1)));
+		vst1q_f32(depths + x, z);
+	}
+#endif
+	for(; x<cols; ++x)
+	{
+		const float d = float(depth[x]) * scale;
+		const float z = d*(px2[x] + r2) + t2;
+		indices[x] = -1;
+		depths[x] = z;
+		if(d > 0.0f && z > 0.0f)
+		{
+			// in the image once truncated
+			const float c = (d*(px0[x] + r0) + t0) / z;
+			const float r = (d*(px1[x] + r1) + t1) / z;
+			if(c > -1.0f && c < float(colorCols) && r > -1.0f && r < float(colorRows))
+			{
+				indices[x] = int(c) + int(r)*colorCols;
+			}
+		}
+	}
+}
+
+} // namespace
+
+DepthRegistration::DepthRegistration() :
+		depthK_(0.0, 0.0, 0.0, 0.0)
+{
+}
+
+void DepthRegistration::updateRays(const cv::Mat & depthK, int cols, int rows)
+{
+	const cv::Vec4d k(depthK.at<double>(0,0), depthK.at<double>(1,1), depthK.at<double>(0,2), depthK.at<double>(1,2));
+	if(k == depthK_ && (int)rayX_.size() == cols && (int)rayY_.size() == rows)
+	{
+		return;
+	}
+	UDEBUG("Depth rays updated: %dx%d fx=%f fy=%f cx=%f cy=%f", cols, rows, k[0], k[1], k[2], k[3]);
+	depthK_ = k;
+	rayX_.resize(cols);
+	rayY_.resize(rows);
+	for(int x=0; x<cols; ++x)
+	{
+		rayX_[x] = float((double(x) - k[2]) / k[0]);
+	}
+	for(int y=0; y<rows; ++y)
+	{
+		rayY_[y] = float((double(y) - k[3]) / k[1]);
+	}
+}
+
+cv::Mat DepthRegistration::registerDepth(
+		const cv::Mat & depth,
+		const cv::Mat & depthK,
+		const cv::Size & colorSize,
+		const cv::Mat & colorK,
+		const rtabmap::Transform & depthToColor)
+{
+	UASSERT(!depthToColor.isNull());
+	UASSERT(!depth.empty());
+	UASSERT(depth.type() == CV_16UC1 || depth.type() == CV_32FC1); // mm or m
+	UASSERT(depthK.type() == CV_64FC1 && depthK.cols == 3 && depthK.rows == 3);
+	UASSERT(colorK.type() == CV_64FC1 && colorK.cols == 3 && colorK.rows == 3);
+
+	updateRays(depthK, depth.cols, depth.rows);
+
+	// Projection of the depth frame in the color image, columns of the
+	// rays are combined once per frame
+	Eigen::Matrix3f K;
+	for(int i=0; i<3; ++i)
+	{
+		for(int j=0; j<3; ++j)
+		{
+			K(i,j) = (float)colorK.at<double>(i,j);
+		}
+	}
+	const Eigen::Affine3f pose = depthToColor.toEigen3f();
+	const Eigen::Matrix3f M = K * pose.linear();
+	const Eigen::Vector3f t = K * pose.translation();
+	for(int i=0; i<3; ++i)
+	{
+		projX_[i].resize(depth.cols);
+		for(int x=0; x<depth.cols; ++x)
+		{
+			projX_[i][x] = M(i,0) * rayX_[x];
+		}
+	}
+
+	const int count = depth.cols*depth.rows;
+	indices_.resize(count);
+	depths_.resize(count);
+	const bool depthInMM = depth.type() == CV_16UC1;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+	for(int y=0; y<depth.rows; ++y)
+	{
+		const float r0 = M(0,1)*rayY_[y] + M(0,2);
+		const float r1 = M(1,1)*rayY_[y] + M(1,2);
+		const float r2 = M(2,1)*rayY_[y] + M(2,2);
+		const int offset = y*depth.cols;
+		if(depthInMM)
+		{
+			projectRow(depth.ptr<unsigned short>(y), 0.001f, depth.cols,
+					projX_[0].data(), projX_[1].data(), projX_[2].data(),
+					r0, r1, r2, t[0], t[1], t[2],
+					colorSize.width, colorSize.height,
+					&indices_[offset], &depths_[offset]);
+		}
+		else
+		{
+			projectRow(depth.ptr<float>(y), 1.0f, depth.cols,
+					projX_[0].data(), projX_[1].data(), projX_[2].data(),
+					r0, r1, r2, t[0], t[1], t[2],
+					colorSize.width, colorSize.height,
+					&indices_[offset], &depths_[offset]);
+		}
+	}
+
+	// Closest depth per color pixel. Pixels of different rows can land
+	// on the same color pixel, so this part is not parallel.
+	rtabmap::createUnshared(registered_, colorSize.height, colorSize.width, depth.type());
+	registered_.setTo(0);
+	if(depthInMM)
+	{
+		unsigned short * out = registered_.ptr<unsigned short>();
+		for(int i=0; i<count; ++i)
+		{
+			if(indices_[i] >= 0)
+			{
+				const unsigned short z = (unsigned short)(depths_[i] * 1000.0f);
+				unsigned short & zReg = out[indices_[i]];
+				if(zReg == 0 || z < zReg)
+				{
+					zReg = z;
+				}
+			}
+		}
+	}
+	else
+	{
+		float * out = registered_.ptr<float>();
+		for(int i=0; i<count; ++i)
+		{
+			if(indices_[i] >= 0)
+			{
+				float & zReg = out[indices_[i]];
+				if(zReg == 0.0f || depths_[i] < zReg)
+				{
+					zReg = depths_[i];
+				}
+			}
+		}
+	}
+	return registered_;
+}
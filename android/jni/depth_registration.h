@@ -0,0 +1,72 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#ifndef DEPTH_REGISTRATION_H_
+#define DEPTH_REGISTRATION_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <rtabmap/core/Transform.h>
+
+// Registration of a depth image to the color camera, same output as
+// rtabmap::util2d::registerDepth() (closest depth kept per color pixel).
+// The rays of the depth pixels are separable, (x-cx)/fx per column and
+// (y-cy)/fy per row, so they are cached and only rebuilt when the depth
+// intrinsics or size change. On each frame the color intrinsics and the
+// depth to color transform are combined in a single 3x4 projection, the
+// rows are projected in parallel, then the depths are written in a buffer
+// reused from the previous frame if no longer referenced.
+class DepthRegistration {
+public:
+	DepthRegistration();
+
+	// depth: CV_16UC1 (mm) or CV_32FC1 (m). depthToColor: pose of the
+	// depth camera in the color camera frame (optical frames). Pixels
+	// without depth (<= 0) are ignored.
+	cv::Mat registerDepth(
+			const cv::Mat & depth,
+			const cv::Mat & depthK,
+			const cv::Size & colorSize,
+			const cv::Mat & colorK,
+			const rtabmap::Transform & depthToColor);
+
+private:
+	void updateRays(const cv::Mat & depthK, int cols, int rows);
+
+private:
+	cv::Vec4d depthK_;         // fx, fy, cx, cy of the cached rays
+	std::vector<float> rayX_;  // (x-cx)/fx per column
+	std::vector<float> rayY_;  // (y-cy)/fy per row
+	std::vector<float> projX_[3]; // first column of the projection times rayX_
+	std::vector<int> indices_; // color pixel of each depth pixel, -1 if outside
+	std::vector<float> depths_;
+	cv::Mat registered_;
+};
+
+#endif /* DEPTH_REGISTRATION_H_ */
@@ -0,0 +1,388 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "ground_reference.h"
+#include "height_map.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+bool tooSteep(const Eigen::Vector3f & plane, float maxSlope)
+{
+	return std::sqrt(plane[0]*plane[0] + plane[1]*plane[1]) > std::tan(maxSlope * float(M_PI) / 180.0f);
+}
+
+float planeHeight(const Eigen::Vector3f & plane, const Eigen::Vector3f & p)
+{
+	return plane[0]*p[0] + plane[1]*p[2] + plane[2];
+}
+
+int countInliers(const std::vector<Eigen::Vector3f> & points, const Eigen::Vector3f & plane, float distance)
+{
+	int count = 0;
+	for(size_t i=0; i<points.size(); ++i)
+	{
+		count += std::fabs(points[i][1] - planeHeight(plane, points[i])) <= distance?1:0;
+	}
+	return count;
+}
+
+} // namespace
+
+bool GroundReference::Parameters::operator==(const Parameters & p) const
+{
+	return band == p.band &&
+			inlierDistance == p.inlierDistance &&
+			maxSlope == p.maxSlope &&
+			iterations == p.iterations &&
+			maxPoints == p.maxPoints &&
+			minInliers == p.minInliers &&
+			quadratic == p.quadratic;
+}
+
+float GroundReference::Surface::height(float x, float z) const
+{
+	if(model == kQuadratic)
+	{
+		float dx = x - center[0];
+		float dz = z - center[1];
+		return coefficients[0] + coefficients[1]*dx + coefficients[2]*dz +
+				coefficients[3]*dx*dx + coefficients[4]*dx*dz + coefficients[5]*dz*dz;
+	}
+	return plane[0]*x + plane[1]*z + plane[2];
+}
+
+Eigen::Matrix<float, 6, 1> GroundReference::Surface::quadratic() const
+{
+	if(model == kQuadratic)
+	{
+		return coefficients;
+	}
+	Eigen::Matrix<float, 6, 1> out;
+	out << plane[0]*center[0] + plane[1]*center[1] + plane[2], plane[0], plane[1], 0.0f, 0.0f, 0.0f;
+	return out;
+}
+
+GroundReference::GroundReference(const std::vector<Eigen::Vector3f> & polygon, const Parameters & parameters) :
+	parameters_(parameters),
+	polygon_(polygon),
+	center_(Eigen::Vector2f::Zero()),
+	min_(Eigen::Vector2f::Zero()),
+	max_(Eigen::Vector2f::Zero())
+{
+	UASSERT(parameters_.band >= 0.0f && parameters_.inlierDistance > 0.0f && parameters_.maxPoints > 0);
+	if(polygon_.empty())
+	{
+		return;
+	}
+	min_ = max_ = Eigen::Vector2f(polygon_[0][0], polygon_[0][2]);
+	for(size_t i=0; i<polygon_.size(); ++i)
+	{
+		Eigen::Vector2f p(polygon_[i][0], polygon_[i][2]);
+		center_ += p;
+		min_ = min_.cwiseMin(p);
+		max_ = max_.cwiseMax(p);
+	}
+	center_ /= float(polygon_.size());
+	min_ -= Eigen::Vector2f::Constant(parameters_.band);
+	max_ += Eigen::Vector2f::Constant(parameters_.band);
+}
+
+bool GroundReference::overlaps(const Eigen::Vector2f & min, const Eigen::Vector2f & max) const
+{
+	return !polygon_.empty() &&
+			min[0] <= max_[0] && max[0] >= min_[0] &&
+			min[1] <= max_[1] && max[1] >= min_[1];
+}
+
+bool GroundReference::inBand(float x, float z) const
+{
+	if(x < min_[0] || x > max_[0] || z < min_[1] || z > max_[1])
+	{
+		return false;
+	}
+	const float band2 = parameters_.band * parameters_.band;
+	for(size_t i=0, j=polygon_.size()-1; i<polygon_.size(); j=i++)
+	{
+		// distance to segment j-i on the x/z plane
+		float ax = polygon_[j][0], az = polygon_[j][2];
+		float dx = polygon_[i][0] - ax, dz = polygon_[i][2] - az;
+		float px = x - ax, pz = z - az;
+		float l2 = dx*dx + dz*dz;
+		float t = l2 > 0.0f?std::max(0.0f, std::min(1.0f, (px*dx + pz*dz) / l2)):0.0f;
+		px -= t*dx;
+		pz -= t*dz;
+		if(px*px + pz*pz <= band2)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void GroundReference::addPoints(const pcl::PointCloud<pcl::PointXYZRGB> & cloud, const rtabmap::Transform & pose)
+{
+	if(polygon_.size() < 3)
+	{
+		return;
+	}
+	Eigen::Affine3f transform = pose.isNull()?Eigen::Affine3f::Identity():pose.toEigen3f();
+	for(size_t i=0; i<cloud.size(); ++i)
+	{
+		const pcl::PointXYZRGB & pt = cloud.at(i);
+		if(std::isfinite(pt.x) && std::isfinite(pt.y) && std::isfinite(pt.z))
+		{
+			Eigen::Vector3f p = transform * Eigen::Vector3f(pt.x, pt.y, pt.z);
+			if(inBand(p[0], p[2]))
+			{
+				points_.push_back(p);
+			}
+		}
+	}
+}
+
+void GroundReference::addPoints(const std::vector<Eigen::Vector3f> & points)
+{
+	if(polygon_.size() < 3)
+	{
+		return;
+	}
+	for(size_t i=0; i<points.size(); ++i)
+	{
+		if(inBand(points[i][0], points[i][2]))
+		{
+			points_.push_back(points[i]);
+		}
+	}
+}
+
+bool GroundReference::seedPlane(const Seed & seed, float maxSlope, Eigen::Vector3f & plane)
+{
+	const Eigen::Vector3f & n = seed.normal;
+	if(n[1] <= 0.0f)
+	{
+		return false;
+	}
+	// n.(q-p) = 0 -> y = p.y - (n.x*(x-p.x) + n.z*(z-p.z))/n.y
+	plane = Eigen::Vector3f(
+			-n[0]/n[1],
+			-n[2]/n[1],
+			seed.point[1] + (n[0]*seed.point[0] + n[2]*seed.point[2])/n[1]);
+	return !tooSteep(plane, maxSlope);
+}
+
+GroundReference::Surface GroundReference::fit(const std::vector<Seed> & seeds) const
+{
+	Surface surface;
+	surface.center = center_;
+	surface.plane = HeightMap::fitPlane(polygon_);
+	surface.samples = (int)points_.size();
+
+	// Decimated samples
+	std::vector<Eigen::Vector3f> points;
+	size_t step = (points_.size() + parameters_.maxPoints - 1) / parameters_.maxPoints;
+	points.reserve(points_.size() / std::max(step, (size_t)1) + 1);
+	for(size_t i=0; i<points_.size(); i+=std::max(step, (size_t)1))
+	{
+		points.push_back(points_[i]);
+	}
+	if((int)points.size() < parameters_.minInliers)
+	{
+		return surface;
+	}
+
+	// Hypotheses: the seeds overlapping the band first, then random planes
+	std::vector<Eigen::Vector3f> planes;
+	std::vector<char> valid; // written by the threads
+	int seedCount = 0;
+	for(size_t i=0; i<seeds.size(); ++i)
+	{
+		bool overlapping = seeds[i].boundary.empty();
+		if(!overlapping)
+		{
+			Eigen::Vector2f min = seeds[i].boundary[0];
+			Eigen::Vector2f max = min;
+			for(size_t j=1; j<seeds[i].boundary.size(); ++j)
+			{
+				min = min.cwiseMin(seeds[i].boundary[j]);
+				max = max.cwiseMax(seeds[i].boundary[j]);
+			}
+			overlapping = overlaps(min, max);
+		}
+		Eigen::Vector3f plane;
+		if(overlapping && seedPlane(seeds[i], parameters_.maxSlope, plane))
+		{
+			planes.push_back(plane);
+			valid.push_back(true);
+			++seedCount;
+		}
+	}
+	const int hypotheses = seedCount + std::max(0, parameters_.iterations);
+	planes.resize(hypotheses);
+	valid.resize(hypotheses, false);
+	std::vector<int> counts(hypotheses, 0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int h=0; h<hypotheses; ++h)
+	{
+		if(h >= seedCount)
+		{
+			// Each hypothesis has its own generator, the result doesn't
+			// depend on the number of threads
+			std::mt19937 generator((unsigned int)h);
+			std::uniform_int_distribution<size_t> uniform(0, points.size()-1);
+			const Eigen::Vector3f & p0 = points[uniform(generator)];
+			const Eigen::Vector3f & p1 = points[uniform(generator)];
+			const Eigen::Vector3f & p2 = points[uniform(generator)];
+			Eigen::Matrix3f A;
+			A << p0[0], p0[2], 1.0f,
+				 p1[0], p1[2], 1.0f,
+				 p2[0], p2[2], 1.0f;
+			if(std::fabs(A.determinant()) < 1e-6f)
+			{
+				continue; // collinear on x/z
+			}
+			planes[h] = A.inverse() * Eigen::Vector3f(p0[1], p1[1], p2[1]);
+			valid[h] = !tooSteep(planes[h], parameters_.maxSlope);
+		}
+		if(valid[h])
+		{
+			counts[h] = countInliers(points, planes[h], parameters_.inlierDistance);
+		}
+	}
+
+	// Ties are won by the seeds
+	int best = -1;
+	for(int h=0; h<hypotheses; ++h)
+	{
+		if(valid[h] && (best < 0 || counts[h] > counts[best]))
+		{
+			best = h;
+		}
+	}
+	if(best < 0 || counts[best] < parameters_.minInliers)
+	{
+		UWARN("Ground reference: not enough inliers (%d/%d samples), using the plane of the markers",
+				best<0?0:counts[best], (int)points.size());
+		return surface;
+	}
+
+	// Least squares refinement on the inliers
+	Eigen::Vector3f plane = planes[best];
+	std::vector<Eigen::Vector3f> inliers;
+	for(int i=0; i<2; ++i)
+	{
+		inliers.clear();
+		for(size_t j=0; j<points.size(); ++j)
+		{
+			if(std::fabs(points[j][1] - planeHeight(plane, points[j])) <= parameters_.inlierDistance)
+			{
+				inliers.push_back(points[j]);
+			}
+		}
+		if((int)inliers.size() < parameters_.minInliers)
+		{
+			break;
+		}
+		plane = HeightMap::fitPlane(inliers);
+	}
+	double sse = 0.0;
+	for(size_t i=0; i<inliers.size(); ++i)
+	{
+		float e = inliers[i][1] - planeHeight(plane, inliers[i]);
+		sse += e*e;
+	}
+	surface.model = kPlane;
+	surface.plane = plane;
+	surface.inliers = (int)inliers.size();
+	surface.rmse = inliers.empty()?0.0f:(float)std::sqrt(sse/double(inliers.size()));
+	surface.seeded = best < seedCount;
+
+	if(parameters_.quadratic && (int)inliers.size() >= std::max(parameters_.minInliers, 12))
+	{
+		Eigen::VectorXd x;
+		for(int i=0; i<2; ++i)
+		{
+			Eigen::MatrixXd A(inliers.size(), 6);
+			Eigen::VectorXd b(inliers.size());
+			for(size_t j=0; j<inliers.size(); ++j)
+			{
+				double dx = inliers[j][0] - center_[0];
+				double dz = inliers[j][2] - center_[1];
+				A.row(j) << 1.0, dx, dz, dx*dx, dx*dz, dz*dz;
+				b[j] = inliers[j][1];
+			}
+			Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(A);
+			qr.setThreshold(1e-6);
+			if(qr.rank() < 6)
+			{
+				x.resize(0);
+				break;
+			}
+			x = qr.solve(b);
+
+			// inliers of the quadratic surface
+			Surface quadratic = surface;
+			quadratic.model = kQuadratic;
+			quadratic.coefficients = x.cast<float>();
+			inliers.clear();
+			for(size_t j=0; j<points.size(); ++j)
+			{
+				if(std::fabs(points[j][1] - quadratic.height(points[j][0], points[j][2])) <= parameters_.inlierDistance)
+				{
+					inliers.push_back(points[j]);
+				}
+			}
+		}
+		// Kept if it explains at least the inliers of the plane
+		if(x.size() == 6 && (int)inliers.size() >= surface.inliers)
+		{
+			Surface quadratic = surface;
+			quadratic.model = kQuadratic;
+			quadratic.coefficients = x.cast<float>();
+			sse = 0.0;
+			for(size_t i=0; i<inliers.size(); ++i)
+			{
+				float e = inliers[i][1] - quadratic.height(inliers[i][0], inliers[i][2]);
+				sse += e*e;
+			}
+			quadratic.plane = HeightMap::fitPlane(inliers);
+			quadratic.inliers = (int)inliers.size();
+			quadratic.rmse = (float)std::sqrt(sse/double(inliers.size()));
+			surface = quadratic;
+		}
+	}
+
+	return surface;
+}
@@ -0,0 +1,141 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef GROUND_REFERENCE_H_
+#define GROUND_REFERENCE_H_
+
+#include <vector>
+#include <Eigen/Core>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <rtabmap/core/Transform.h>
+
+// Ground reference surface of a volume ROI (scene frame, y up). The base of
+// a pile is around its boundary, so the ground is sampled on the vertices
+// within a band on both sides of the ROI polygon (x/z) and fitted with
+// RANSAC. The planes detected by the AR session are tested first as
+// hypotheses, then random planes from 3 points, all evaluated in parallel
+// with OpenMP. The best plane is refined by least squares on its inliers
+// and, optionally, replaced by a quadratic surface fitted on the same
+// inliers (uneven ground). If there are not enough samples, the plane of
+// the polygon markers is used.
+class GroundReference {
+public:
+	enum Model {
+		kMarkers,   // plane of the polygon markers
+		kPlane,     // y = a*x + b*z + c
+		kQuadratic  // y = c0 + c1*x + c2*z + c3*x^2 + c4*x*z + c5*z^2 (x/z relative to center)
+	};
+
+	struct Parameters {
+		Parameters() :
+			band(0.2f),
+			inlierDistance(0.02f),
+			maxSlope(20.0f),
+			iterations(256),
+			maxPoints(20000),
+			minInliers(50),
+			quadratic(false)
+		{}
+		bool operator==(const Parameters & p) const;
+		bool operator!=(const Parameters & p) const {return !(*this == p);}
+
+		float band;           // sampled distance on both sides of the polygon boundary (m)
+		float inlierDistance; // vertical distance of the inliers (m)
+		float maxSlope;       // steeper hypotheses (seeds included) are rejected (deg)
+		int iterations;       // random hypotheses
+		int maxPoints;        // samples are decimated above this
+		int minInliers;       // below, the plane of the markers is used
+		bool quadratic;       // try a quadratic surface on the plane inliers
+	};
+
+	// Plane detected by the AR session (scene frame)
+	struct Seed {
+		Eigen::Vector3f point;
+		Eigen::Vector3f normal;
+		std::vector<Eigen::Vector2f> boundary; // x/z, the seed is used only if it overlaps the band
+	};
+
+	struct Surface {
+		Surface() :
+			model(kMarkers),
+			plane(Eigen::Vector3f::Zero()),
+			coefficients(Eigen::Matrix<float, 6, 1>::Zero()),
+			center(Eigen::Vector2f::Zero()),
+			samples(0),
+			inliers(0),
+			rmse(0.0f),
+			seeded(false)
+		{}
+		float height(float x, float z) const;
+		// Coefficients of the quadratic model relative to center, for all
+		// models (the plane has no second order terms).
+		Eigen::Matrix<float, 6, 1> quadratic() const;
+
+		Model model;
+		Eigen::Vector3f plane;                  // (a, b, c), least squares plane of the inliers (all models)
+		Eigen::Matrix<float, 6, 1> coefficients; // kQuadratic only
+		Eigen::Vector2f center;                 // x/z centroid of the polygon
+		int samples;                            // sampled vertices
+		int inliers;
+		float rmse;                             // of the inliers (m)
+		bool seeded;                            // the best hypothesis was an AR plane
+	};
+
+public:
+	// polygon: markers of the ROI (scene frame)
+	GroundReference(const std::vector<Eigen::Vector3f> & polygon, const Parameters & parameters = Parameters());
+
+	// x/z bounds of the band, clouds outside can be skipped
+	const Eigen::Vector2f & min() const {return min_;}
+	const Eigen::Vector2f & max() const {return max_;}
+	bool overlaps(const Eigen::Vector2f & min, const Eigen::Vector2f & max) const;
+
+	// Add the points within the band, pose is cloud to scene.
+	void addPoints(const pcl::PointCloud<pcl::PointXYZRGB> & cloud, const rtabmap::Transform & pose);
+	void addPoints(const std::vector<Eigen::Vector3f> & points);
+	size_t samples() const {return points_.size();}
+
+	Surface fit(const std::vector<Seed> & seeds = std::vector<Seed>()) const;
+
+	// Plane y = a*x + b*z + c of a seed, returns false if it is too steep.
+	static bool seedPlane(const Seed & seed, float maxSlope, Eigen::Vector3f & plane);
+
+private:
+	bool inBand(float x, float z) const;
+
+private:
+	Parameters parameters_;
+	std::vector<Eigen::Vector3f> polygon_;
+	Eigen::Vector2f center_;
+	Eigen::Vector2f min_;
+	Eigen::Vector2f max_;
+	std::vector<Eigen::Vector3f> points_;
+};
+
+#endif /* GROUND_REFERENCE_H_ */
@@ -0,0 +1,840 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "height_map.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <Eigen/Geometry>
+#include <Eigen/QR>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const int kTileSize = 64; // cells
+const int kSums = 7;       // sums of the pyramid cells: count, height, x, z, x^2, x*z, z^2
+
+inline void updateCell(float * maxRow, float * minRow, int c, float y)
+{
+	if(!(maxRow[c] >= y)) // also true if NaN
+	{
+		maxRow[c] = y;
+	}
+	if(!(minRow[c] <= y))
+	{
+		minRow[c] = y;
+	}
+}
+
+// Calls f(r, z, c0, c1) for each span [c0, c1] of the row r of a grid
+// (origin, cell size s, rows x cols) whose cell centers are inside the roi
+// (even-odd rule), z is the center of the row.
+template<typename F>
+void forEachSpan(const std::vector<Eigen::Vector2f> & roi, const Eigen::Vector2f & origin, float s, int rows, int cols, F f)
+{
+	float minZ = roi[0][1];
+	float maxZ = roi[0][1];
+	for(size_t i=1; i<roi.size(); ++i)
+	{
+		minZ = std::min(minZ, roi[i][1]);
+		maxZ = std::max(maxZ, roi[i][1]);
+	}
+	std::vector<float> xs;
+	int r0 = std::max(0, (int)std::ceil((minZ - origin[1]) / s - 0.5f));
+	int r1 = std::min(rows-1, (int)std::floor((maxZ - origin[1]) / s - 0.5f));
+	for(int r=r0; r<=r1; ++r)
+	{
+		// Polygon edges crossing the row center
+		const float z = origin[1] + (float(r)+0.5f)*s;
+		xs.clear();
+		for(size_t i=0; i<roi.size(); ++i)
+		{
+			const Eigen::Vector2f & a = roi[i];
+			const Eigen::Vector2f & b = roi[(i+1)%roi.size()];
+			if((a[1] <= z && b[1] > z) || (b[1] <= z && a[1] > z))
+			{
+				xs.push_back(a[0] + (z-a[1]) / (b[1]-a[1]) * (b[0]-a[0]));
+			}
+		}
+		std::sort(xs.begin(), xs.end());
+		for(size_t k=0; k+1<xs.size(); k+=2)
+		{
+			int c0 = std::max(0, (int)std::ceil((xs[k] - origin[0]) / s - 0.5f));
+			int c1 = std::min(cols-1, (int)std::floor((xs[k+1] - origin[0]) / s - 0.5f));
+			if(c0 <= c1)
+			{
+				f(r, z, c0, c1);
+			}
+		}
+	}
+}
+
+} // namespace
+
+HeightMap::HeightMap() :
+		cellSize_(0.0f),
+		origin_(0.0f, 0.0f)
+{
+}
+
+void HeightMap::create(const Eigen::Vector2f & min, const Eigen::Vector2f & max, float cellSize, int maxCells)
+{
+	UASSERT(cellSize > 0.0f && maxCells > 0);
+	UASSERT(max[0] >= min[0] && max[1] >= min[1]);
+	float extent = std::max(max[0]-min[0], max[1]-min[1]);
+	if(extent / cellSize > float(maxCells))
+	{
+		float newCellSize = extent / float(maxCells);
+		UWARN("Height map of %fx%f m with cell size %f m would be larger than %dx%d cells, cell size is increased to %f m.",
+				max[0]-min[0], max[1]-min[1], cellSize, maxCells, maxCells, newCellSize);
+		cellSize = newCellSize;
+	}
+	cellSize_ = cellSize;
+	origin_ = min;
+	int cols = std::max(1, (int)std::ceil((max[0]-min[0]) / cellSize_));
+	int rows = std::max(1, (int)std::ceil((max[1]-min[1]) / cellSize_));
+	maxHeights_ = cv::Mat(rows, cols, CV_32FC1, cv::Scalar(std::numeric_limits<float>::quiet_NaN()));
+	minHeights_ = cv::Mat(rows, cols, CV_32FC1, cv::Scalar(std::numeric_limits<float>::quiet_NaN()));
+}
+
+void HeightMap::clear()
+{
+	maxHeights_ = cv::Mat();
+	minHeights_ = cv::Mat();
+}
+
+void HeightMap::addMeshes(const std::vector<MeshVolume::Input> & inputs)
+{
+	UASSERT(!empty());
+
+	// (1) Vertices in scene frame, grid coordinates: cell (c,r) center is at (u,v)=(c,r)
+	std::vector<size_t> vertexOffsets(inputs.size()+1, 0);
+	std::vector<size_t> triangleOffsets(inputs.size()+1, 0);
+	for(size_t i=0; i<inputs.size(); ++i)
+	{
+		vertexOffsets[i+1] = vertexOffsets[i] + inputs[i].vertices->size();
+		size_t triangles = 0;
+		const std::vector<pcl::Vertices> & polygons = *inputs[i].polygons;
+		for(size_t j=0; j<polygons.size(); ++j)
+		{
+			triangles += polygons[j].vertices.size()>=3?polygons[j].vertices.size()-2:0;
+		}
+		triangleOffsets[i+1] = triangleOffsets[i] + triangles;
+	}
+	const size_t totalVertices = vertexOffsets.back();
+	const size_t totalTriangles = triangleOffsets.back();
+	std::vector<float> U(totalVertices), V(totalVertices), Y(totalVertices);
+	std::vector<uint32_t> triangles(totalTriangles*3);
+	const float invCell = 1.0f / cellSize_;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int i=0; i<(int)inputs.size(); ++i)
+	{
+		const MeshVolume::VertexArrays & v = *inputs[i].vertices;
+		Eigen::Affine3f t = inputs[i].pose.isNull()?Eigen::Affine3f::Identity():inputs[i].pose.toEigen3f();
+		const Eigen::Matrix3f R = t.linear();
+		const Eigen::Vector3f T = t.translation();
+		const size_t offset = vertexOffsets[i];
+		for(size_t j=0; j<v.size(); ++j)
+		{
+			const float x = R(0,0)*v.x[j] + R(0,1)*v.y[j] + R(0,2)*v.z[j] + T[0];
+			const float y = R(1,0)*v.x[j] + R(1,1)*v.y[j] + R(1,2)*v.z[j] + T[1];
+			const float z = R(2,0)*v.x[j] + R(2,1)*v.y[j] + R(2,2)*v.z[j] + T[2];
+			U[offset+j] = (x - origin_[0]) * invCell - 0.5f;
+			V[offset+j] = (z - origin_[1]) * invCell - 0.5f;
+			Y[offset+j] = y;
+		}
+
+		// triangle fans, invalid indices are set to the first vertex (degenerated)
+		const std::vector<pcl::Vertices> & polygons = *inputs[i].polygons;
+		uint32_t * tri = triangles.data() + triangleOffsets[i]*3;
+		const uint32_t size = (uint32_t)v.size();
+		for(size_t j=0; j<polygons.size(); ++j)
+		{
+			const std::vector<uint32_t> & p = polygons[j].vertices;
+			for(size_t k=1; k+1<p.size(); ++k)
+			{
+				bool valid = p[0] < size && p[k] < size && p[k+1] < size;
+				*tri++ = offset + (valid?p[0]:0);
+				*tri++ = offset + (valid?p[k]:0);
+				*tri++ = offset + (valid?p[k+1]:0);
+			}
+		}
+	}
+
+	// (2) Bin triangles by tile (counting sort, a triangle can be in many tiles)
+	const int cols = maxHeights_.cols;
+	const int rows = maxHeights_.rows;
+	const int tilesX = (cols + kTileSize - 1) / kTileSize;
+	const int tilesY = (rows + kTileSize - 1) / kTileSize;
+	std::vector<int> tileRanges(totalTriangles*4);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+	for(int i=0; i<(int)totalTriangles; ++i)
+	{
+		const uint32_t * tri = &triangles[i*3];
+		float u0 = std::min(std::min(U[tri[0]], U[tri[1]]), U[tri[2]]);
+		float u1 = std::max(std::max(U[tri[0]], U[tri[1]]), U[tri[2]]);
+		float v0 = std::min(std::min(V[tri[0]], V[tri[1]]), V[tri[2]]);
+		float v1 = std::max(std::max(V[tri[0]], V[tri[1]]), V[tri[2]]);
+		int * range = &tileRanges[i*4];
+		// cells touched by the triangle, including its rounded vertices
+		int c0 = std::max(0, (int)std::floor(u0+0.5f));
+		int c1 = std::min(cols-1, (int)std::floor(u1+0.5f));
+		int r0 = std::max(0, (int)std::floor(v0+0.5f));
+		int r1 = std::min(rows-1, (int)std::floor(v1+0.5f));
+		if(c0 > c1 || r0 > r1)
+		{
+			range[0] = range[2] = 0;
+			range[1] = range[3] = -1;
+			continue;
+		}
+		range[0] = c0/kTileSize;
+		range[1] = c1/kTileSize;
+		range[2] = r0/kTileSize;
+		range[3] = r1/kTileSize;
+	}
+	std::vector<size_t> tileOffsets(tilesX*tilesY+1, 0);
+	for(size_t i=0; i<totalTriangles; ++i)
+	{
+		const int * range = &tileRanges[i*4];
+		for(int ty=range[2]; ty<=range[3]; ++ty)
+		{
+			for(int tx=range[0]; tx<=range[1]; ++tx)
+			{
+				++tileOffsets[ty*tilesX+tx+1];
+			}
+		}
+	}
+	for(size_t i=1; i<tileOffsets.size(); ++i)
+	{
+		tileOffsets[i] += tileOffsets[i-1];
+	}
+	std::vector<uint32_t> tileTriangles(tileOffsets.back());
+	{
+		std::vector<size_t> fill(tileOffsets.begin(), tileOffsets.end()-1);
+		for(size_t i=0; i<totalTriangles; ++i)
+		{
+			const int * range = &tileRanges[i*4];
+			for(int ty=range[2]; ty<=range[3]; ++ty)
+			{
+				for(int tx=range[0]; tx<=range[1]; ++tx)
+				{
+					tileTriangles[fill[ty*tilesX+tx]++] = (uint32_t)i;
+				}
+			}
+		}
+	}
+
+	// (3) Rasterize tiles in parallel, each tile owns its cells
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int t=0; t<tilesX*tilesY; ++t)
+	{
+		const int tileC0 = (t%tilesX)*kTileSize;
+		const int tileR0 = (t/tilesX)*kTileSize;
+		const int tileC1 = std::min(cols, tileC0+kTileSize) - 1;
+		const int tileR1 = std::min(rows, tileR0+kTileSize) - 1;
+		for(size_t k=tileOffsets[t]; k<tileOffsets[t+1]; ++k)
+		{
+			const uint32_t * tri = &triangles[tileTriangles[k]*3];
+			const float u[3] = {U[tri[0]], U[tri[1]], U[tri[2]]};
+			const float v[3] = {V[tri[0]], V[tri[1]], V[tri[2]]};
+			const float y[3] = {Y[tri[0]], Y[tri[1]], Y[tri[2]]};
+
+			// vertices, so that triangles smaller than a cell are not lost
+			for(int j=0; j<3; ++j)
+			{
+				int c = (int)std::floor(u[j]+0.5f);
+				int r = (int)std::floor(v[j]+0.5f);
+				if(c >= tileC0 && c <= tileC1 && r >= tileR0 && r <= tileR1)
+				{
+					updateCell(maxHeights_.ptr<float>(r), minHeights_.ptr<float>(r), c, y[j]);
+				}
+			}
+
+			// cell centers inside the triangle
+			const float area = (u[1]-u[0])*(v[2]-v[0]) - (u[2]-u[0])*(v[1]-v[0]);
+			if(std::fabs(area) < 1e-6f)
+			{
+				continue; // vertical or degenerated triangle
+			}
+			const float invArea = 1.0f / area;
+			int c0 = std::max(tileC0, (int)std::ceil(std::min(std::min(u[0], u[1]), u[2])));
+			int c1 = std::min(tileC1, (int)std::floor(std::max(std::max(u[0], u[1]), u[2])));
+			int r0 = std::max(tileR0, (int)std::ceil(std::min(std::min(v[0], v[1]), v[2])));
+			int r1 = std::min(tileR1, (int)std::floor(std::max(std::max(v[0], v[1]), v[2])));
+			for(int r=r0; r<=r1; ++r)
+			{
+				float * maxRow = maxHeights_.ptr<float>(r);
+				float * minRow = minHeights_.ptr<float>(r);
+				for(int c=c0; c<=c1; ++c)
+				{
+					// barycentric coordinates
+					float w1 = ((c-u[0])*(v[2]-v[0]) - (u[2]-u[0])*(r-v[0])) * invArea;
+					float w2 = ((u[1]-u[0])*(r-v[0]) - (c-u[0])*(v[1]-v[0])) * invArea;
+					float w0 = 1.0f - w1 - w2;
+					if(w0 >= -1e-5f && w1 >= -1e-5f && w2 >= -1e-5f)
+					{
+						updateCell(maxRow, minRow, c, w0*y[0] + w1*y[1] + w2*y[2]);
+					}
+				}
+			}
+		}
+	}
+}
+
+void HeightMap::addPoints(const MeshVolume::VertexArrays & vertices, const rtabmap::Transform & pose)
+{
+	UASSERT(!empty());
+	Eigen::Affine3f t = pose.isNull()?Eigen::Affine3f::Identity():pose.toEigen3f();
+	const float invCell = 1.0f / cellSize_;
+	for(size_t i=0; i<vertices.size(); ++i)
+	{
+		Eigen::Vector3f p = t * Eigen::Vector3f(vertices.x[i], vertices.y[i], vertices.z[i]);
+		int c = (int)std::floor((p[0] - origin_[0]) * invCell);
+		int r = (int)std::floor((p[2] - origin_[1]) * invCell);
+		if(c >= 0 && c < maxHeights_.cols && r >= 0 && r < maxHeights_.rows)
+		{
+			updateCell(maxHeights_.ptr<float>(r), minHeights_.ptr<float>(r), c, p[1]);
+		}
+	}
+}
+
+cv::Mat HeightMap::roiMask(const std::vector<Eigen::Vector2f> & roi) const
+{
+	cv::Mat mask = cv::Mat::zeros(rows(), cols(), CV_8UC1);
+	if(roi.size() >= 3)
+	{
+		// fixed-point coordinates (8 bits), cell (c,r) center is at (c,r)
+		const int shift = 8;
+		const float scale = float(1<<shift) / cellSize_;
+		std::vector<std::vector<cv::Point> > polygons(1);
+		for(size_t i=0; i<roi.size(); ++i)
+		{
+			polygons[0].push_back(cv::Point(
+					(int)std::round((roi[i][0] - origin_[0]) * scale - float(1<<(shift-1))),
+					(int)std::round((roi[i][1] - origin_[1]) * scale - float(1<<(shift-1)))));
+		}
+		cv::fillPoly(mask, polygons, cv::Scalar(255), 8, shift);
+	}
+	return mask;
+}
+
+HeightMap::Stats HeightMap::volume(const Eigen::Vector3f & plane, const std::vector<Eigen::Vector2f> & roi) const
+{
+	Stats stats;
+	if(empty())
+	{
+		return stats;
+	}
+	cv::Mat mask;
+	if(!roi.empty())
+	{
+		mask = roiMask(roi);
+	}
+	const int rows = maxHeights_.rows;
+	const int cols = maxHeights_.cols;
+	const double cellArea = double(cellSize_)*double(cellSize_);
+	std::vector<double> rowVolume(rows, 0.0);
+	std::vector<double> rowBelow(rows, 0.0);
+	std::vector<int> rowCells(rows, 0);
+	std::vector<float> rowMax(rows, -std::numeric_limits<float>::max());
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+	for(int r=0; r<rows; ++r)
+	{
+		const float * h = maxHeights_.ptr<float>(r);
+		const unsigned char * m = mask.empty()?0:mask.ptr<unsigned char>(r);
+		const float z = origin_[1] + (float(r)+0.5f)*cellSize_;
+		// reference height of cell c: ref0 + c*dRef
+		const float ref0 = plane[0]*(origin_[0] + 0.5f*cellSize_) + plane[1]*z + plane[2];
+		const float dRef = plane[0]*cellSize_;
+		double above = 0.0;
+		double below = 0.0;
+		int cells = 0;
+		float maxHeight = rowMax[r];
+		for(int c=0; c<cols; ++c)
+		{
+			if(std::isnan(h[c]) || (m && m[c] == 0))
+			{
+				continue;
+			}
+			float height = h[c] - (ref0 + float(c)*dRef);
+			if(height > 0.0f)
+			{
+				above += height;
+			}
+			else
+			{
+				below -= height;
+			}
+			maxHeight = std::max(maxHeight, height);
+			++cells;
+		}
+		rowVolume[r] = above * cellArea;
+		rowBelow[r] = below * cellArea;
+		rowCells[r] = cells;
+		rowMax[r] = maxHeight;
+	}
+	bool first = true;
+	for(int r=0; r<rows; ++r)
+	{
+		stats.volume += rowVolume[r];
+		stats.volumeBelow += rowBelow[r];
+		stats.cells += rowCells[r];
+		if(rowCells[r])
+		{
+			stats.maxHeight = first?rowMax[r]:std::max(stats.maxHeight, rowMax[r]);
+			first = false;
+		}
+	}
+	stats.netVolume = stats.volume - stats.volumeBelow;
+	stats.footprint = double(stats.cells) * cellArea;
+	return stats;
+}
+
+bool HeightMap::bounds(const std::vector<MeshVolume::Input> & inputs, Eigen::Vector2f & min, Eigen::Vector2f & max)
+{
+	bool valid = false;
+	for(size_t i=0; i<inputs.size(); ++i)
+	{
+		const MeshVolume::VertexArrays & v = *inputs[i].vertices;
+		Eigen::Affine3f t = inputs[i].pose.isNull()?Eigen::Affine3f::Identity():inputs[i].pose.toEigen3f();
+		for(size_t j=0; j<v.size(); ++j)
+		{
+			Eigen::Vector3f p = t * Eigen::Vector3f(v.x[j], v.y[j], v.z[j]);
+			if(!valid)
+			{
+				min = max = Eigen::Vector2f(p[0], p[2]);
+				valid = true;
+			}
+			else
+			{
+				min = min.cwiseMin(Eigen::Vector2f(p[0], p[2]));
+				max = max.cwiseMax(Eigen::Vector2f(p[0], p[2]));
+			}
+		}
+	}
+	return valid;
+}
+
+Eigen::Vector3f HeightMap::fitPlane(const std::vector<Eigen::Vector3f> & points)
+{
+	if(points.empty())
+	{
+		return Eigen::Vector3f::Zero();
+	}
+	double meanY = 0.0;
+	for(size_t i=0; i<points.size(); ++i)
+	{
+		meanY += points[i][1];
+	}
+	meanY /= double(points.size());
+	if(points.size() >= 3)
+	{
+		Eigen::MatrixXd A(points.size(), 3);
+		Eigen::VectorXd b(points.size());
+		for(size_t i=0; i<points.size(); ++i)
+		{
+			A(i,0) = points[i][0];
+			A(i,1) = points[i][2];
+			A(i,2) = 1.0;
+			b[i] = points[i][1];
+		}
+		Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(A);
+		qr.setThreshold(1e-6);
+		if(qr.rank() == 3)
+		{
+			Eigen::Vector3d x = qr.solve(b);
+			return x.cast<float>();
+		}
+	}
+	return Eigen::Vector3f(0.0f, 0.0f, (float)meanY);
+}
+
+HeightMap::Solution HeightMap::solve(
+		const std::vector<MeshVolume::Input> & inputs,
+		const Eigen::Vector3f & plane,
+		const std::vector<Eigen::Vector2f> & roi,
+		float tolerance,
+		float minCellSize,
+		float maxCellSize,
+		int maxCells)
+{
+	UASSERT(tolerance >= 0.0f && minCellSize > 0.0f && maxCellSize >= minCellSize);
+	Solution solution;
+	if(roi.size() < 3 || inputs.empty())
+	{
+		return solution;
+	}
+
+	// Bounds of the roi, with a margin for the triangles covering the border cells
+	Eigen::Vector2f min = roi[0];
+	Eigen::Vector2f max = roi[0];
+	for(size_t i=1; i<roi.size(); ++i)
+	{
+		min = min.cwiseMin(roi[i]);
+		max = max.cwiseMax(roi[i]);
+	}
+	min -= Eigen::Vector2f::Constant(maxCellSize);
+	max += Eigen::Vector2f::Constant(maxCellSize);
+
+	// Polygons overlapping the bounds on the x/z plane
+	std::vector<std::vector<pcl::Vertices> > polygons(inputs.size());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int i=0; i<(int)inputs.size(); ++i)
+	{
+		const MeshVolume::VertexArrays & v = *inputs[i].vertices;
+		Eigen::Affine3f t = inputs[i].pose.isNull()?Eigen::Affine3f::Identity():inputs[i].pose.toEigen3f();
+		std::vector<float> xs(v.size()), zs(v.size());
+		for(size_t j=0; j<v.size(); ++j)
+		{
+			xs[j] = t(0,0)*v.x[j] + t(0,1)*v.y[j] + t(0,2)*v.z[j] + t(0,3);
+			zs[j] = t(2,0)*v.x[j] + t(2,1)*v.y[j] + t(2,2)*v.z[j] + t(2,3);
+		}
+		const std::vector<pcl::Vertices> & meshPolygons = *inputs[i].polygons;
+		for(size_t j=0; j<meshPolygons.size(); ++j)
+		{
+			const std::vector<uint32_t> & p = meshPolygons[j].vertices;
+			if(p.size() < 3)
+			{
+				continue;
+			}
+			float x0 = std::numeric_limits<float>::max(), x1 = -x0;
+			float z0 = x0, z1 = -x0;
+			bool valid = true;
+			for(size_t k=0; k<p.size() && valid; ++k)
+			{
+				valid = p[k] < v.size();
+				if(valid)
+				{
+					x0 = std::min(x0, xs[p[k]]);
+					x1 = std::max(x1, xs[p[k]]);
+					z0 = std::min(z0, zs[p[k]]);
+					z1 = std::max(z1, zs[p[k]]);
+				}
+			}
+			if(valid && x1 >= min[0] && x0 <= max[0] && z1 >= min[1] && z0 <= max[1])
+			{
+				polygons[i].push_back(meshPolygons[j]);
+			}
+		}
+	}
+	std::vector<MeshVolume::Input> selected;
+	for(size_t i=0; i<inputs.size(); ++i)
+	{
+		if(!polygons[i].empty())
+		{
+			selected.push_back(MeshVolume::Input(inputs[i].vertices, &polygons[i], inputs[i].pose));
+		}
+	}
+	if(selected.empty())
+	{
+		return solution;
+	}
+
+	float cellSize = maxCellSize;
+	while(true)
+	{
+		HeightMap heightMap;
+		heightMap.create(min, max, cellSize, maxCells);
+		if(solution.iterations > 0 && heightMap.cellSize() >= solution.cellSize)
+		{
+			// limited by maxCells
+			break;
+		}
+		heightMap.addMeshes(selected);
+		Stats stats = heightMap.volume(plane, roi);
+		if(solution.iterations > 0)
+		{
+			double difference = std::fabs(stats.volume - solution.stats.volume);
+			solution.difference = stats.volume > 0.0?difference / stats.volume:(difference > 0.0?1.0:0.0);
+		}
+		solution.stats = stats;
+		solution.cellSize = heightMap.cellSize();
+		++solution.iterations;
+		UDEBUG("Volume at cell size %f m: %f m^3 (difference=%f)", solution.cellSize, stats.volume, solution.difference);
+		if(solution.iterations > 1 && solution.difference <= tolerance)
+		{
+			solution.converged = true;
+			break;
+		}
+		if(cellSize <= minCellSize)
+		{
+			break;
+		}
+		cellSize = std::max(minCellSize, cellSize * 0.5f);
+	}
+	return solution;
+}
+
+HeightMapPyramid::HeightMapPyramid(const HeightMap & heightMap, int maxLevels) :
+		cellSize0_(heightMap.cellSize()),
+		origin_(heightMap.origin())
+{
+	if(heightMap.empty())
+	{
+		return;
+	}
+	UASSERT(maxLevels >= 1);
+
+	// Per-cell sums of level 0: count, height, x, z, x^2, x*z, z^2, with
+	// x/z relative to the origin to keep the quadratic sums small
+	int rows = heightMap.rows();
+	int cols = heightMap.cols();
+	maxHeights0_ = heightMap.maxHeights().clone();
+	std::vector<double> sums(rows*cols*kSums, 0.0);
+	for(int r=0; r<rows; ++r)
+	{
+		const float * h = maxHeights0_.ptr<float>(r);
+		const double z = (r+0.5)*cellSize0_;
+		for(int c=0; c<cols; ++c)
+		{
+			if(!std::isnan(h[c]))
+			{
+				const double x = (c+0.5)*cellSize0_;
+				double * s = &sums[(r*cols+c)*kSums];
+				s[0] = 1.0;
+				s[1] = h[c];
+				s[2] = x;
+				s[3] = z;
+				s[4] = x*x;
+				s[5] = x*z;
+				s[6] = z*z;
+			}
+		}
+	}
+
+	float cellSize = cellSize0_;
+	for(int l=0; l<maxLevels; ++l)
+	{
+		Level level;
+		level.cellSize = cellSize;
+		level.rows = rows;
+		level.cols = cols;
+
+		// Summed-area table
+		const int stride = (cols+1)*kSums;
+		level.sat.assign((rows+1)*stride, 0.0);
+		for(int r=0; r<rows; ++r)
+		{
+			double rowSum[kSums] = {0.0};
+			const double * above = &level.sat[r*stride];
+			double * out = &level.sat[(r+1)*stride];
+			for(int c=0; c<cols; ++c)
+			{
+				const double * s = &sums[(r*cols+c)*kSums];
+				for(int k=0; k<kSums; ++k)
+				{
+					rowSum[k] += s[k];
+					out[(c+1)*kSums+k] = above[(c+1)*kSums+k] + rowSum[k];
+				}
+			}
+		}
+		levels_.push_back(level);
+
+		if(rows == 1 && cols == 1)
+		{
+			break;
+		}
+
+		// Next level: 2x2 sums
+		int nextRows = (rows+1)/2;
+		int nextCols = (cols+1)/2;
+		std::vector<double> nextSums(nextRows*nextCols*kSums, 0.0);
+		for(int r=0; r<rows; ++r)
+		{
+			for(int c=0; c<cols; ++c)
+			{
+				const int i = r*cols+c;
+				const int j = (r/2)*nextCols+c/2;
+				for(int k=0; k<kSums; ++k)
+				{
+					nextSums[j*kSums+k] += sums[i*kSums+k];
+				}
+			}
+		}
+		sums.swap(nextSums);
+		rows = nextRows;
+		cols = nextCols;
+		cellSize *= 2.0f;
+	}
+}
+
+void HeightMapPyramid::cells(const Eigen::Vector2f & min, const Eigen::Vector2f & max, std::vector<Eigen::Vector3f> & points) const
+{
+	if(levels_.empty())
+	{
+		return;
+	}
+	const Level & level = levels_[0];
+	int c0 = std::max(0, (int)std::floor((min[0]-origin_[0])/cellSize0_));
+	int c1 = std::min(level.cols-1, (int)std::floor((max[0]-origin_[0])/cellSize0_));
+	int r0 = std::max(0, (int)std::floor((min[1]-origin_[1])/cellSize0_));
+	int r1 = std::min(level.rows-1, (int)std::floor((max[1]-origin_[1])/cellSize0_));
+	for(int r=r0; r<=r1; ++r)
+	{
+		for(int c=c0; c<=c1; ++c)
+		{
+			float h = maxHeights0_.at<float>(r, c);
+			if(!std::isnan(h))
+			{
+				points.push_back(Eigen::Vector3f(
+						origin_[0] + (c+0.5f)*cellSize0_,
+						h,
+						origin_[1] + (r+0.5f)*cellSize0_));
+			}
+		}
+	}
+}
+
+Eigen::Matrix<double, 6, 1> HeightMapPyramid::toOrigin(const Eigen::Matrix<float, 6, 1> & coefficients, const Eigen::Vector2f & center) const
+{
+	// dx = x + ox, dz = z + oz with x/z relative to the origin
+	const double ox = double(origin_[0]) - double(center[0]);
+	const double oz = double(origin_[1]) - double(center[1]);
+	const Eigen::Matrix<double, 6, 1> k = coefficients.cast<double>();
+	Eigen::Matrix<double, 6, 1> out;
+	out[0] = k[0] + k[1]*ox + k[2]*oz + k[3]*ox*ox + k[4]*ox*oz + k[5]*oz*oz;
+	out[1] = k[1] + 2.0*k[3]*ox + k[4]*oz;
+	out[2] = k[2] + k[4]*ox + 2.0*k[5]*oz;
+	out[3] = k[3];
+	out[4] = k[4];
+	out[5] = k[5];
+	return out;
+}
+
+HeightMap::Stats HeightMapPyramid::volume(
+		const Eigen::Vector3f & plane,
+		const std::vector<Eigen::Vector2f> & roi,
+		int levelIndex,
+		int maxRows) const
+{
+	Eigen::Matrix<float, 6, 1> coefficients;
+	coefficients << plane[2], plane[0], plane[1], 0.0f, 0.0f, 0.0f;
+	return volume(coefficients, Eigen::Vector2f::Zero(), roi, levelIndex, maxRows);
+}
+
+HeightMap::Stats HeightMapPyramid::volume(
+		const Eigen::Matrix<float, 6, 1> & coefficients,
+		const Eigen::Vector2f & center,
+		const std::vector<Eigen::Vector2f> & roi,
+		int levelIndex,
+		int maxRows) const
+{
+	HeightMap::Stats stats;
+	if(empty() || roi.size() < 3)
+	{
+		return stats;
+	}
+
+	if(levelIndex < 0)
+	{
+		float minZ = roi[0][1];
+		float maxZ = roi[0][1];
+		for(size_t i=1; i<roi.size(); ++i)
+		{
+			minZ = std::min(minZ, roi[i][1]);
+			maxZ = std::max(maxZ, roi[i][1]);
+		}
+		levelIndex = 0;
+		while(levelIndex+1 < (int)levels_.size() &&
+			  (maxZ-minZ) / levels_[levelIndex].cellSize > float(maxRows))
+		{
+			++levelIndex;
+		}
+	}
+	UASSERT(levelIndex < (int)levels_.size());
+	const Level & level = levels_[levelIndex];
+	const int stride = (level.cols+1)*kSums;
+
+	double sums[kSums] = {0.0};
+	forEachSpan(roi, origin_, level.cellSize, level.rows, level.cols, [&](int r, float, int c0, int c1) {
+		const double * top = &level.sat[r*stride];
+		const double * bottom = &level.sat[(r+1)*stride];
+		for(int j=0; j<kSums; ++j)
+		{
+			sums[j] += bottom[(c1+1)*kSums+j] - top[(c1+1)*kSums+j] - bottom[c0*kSums+j] + top[c0*kSums+j];
+		}
+	});
+
+	const Eigen::Matrix<double, 6, 1> k = toOrigin(coefficients, center);
+	const double reference = k[0]*sums[0] + k[1]*sums[2] + k[2]*sums[3] + k[3]*sums[4] + k[4]*sums[5] + k[5]*sums[6];
+	const double cellArea = double(cellSize0_)*double(cellSize0_);
+	stats.cells = (int)std::round(sums[0]);
+	stats.footprint = sums[0] * cellArea;
+	stats.netVolume = (sums[1] - reference) * cellArea;
+	return stats;
+}
+
+float HeightMapPyramid::maxHeight(
+		const Eigen::Vector3f & plane,
+		const std::vector<Eigen::Vector2f> & roi) const
+{
+	Eigen::Matrix<float, 6, 1> coefficients;
+	coefficients << plane[2], plane[0], plane[1], 0.0f, 0.0f, 0.0f;
+	return maxHeight(coefficients, Eigen::Vector2f::Zero(), roi);
+}
+
+float HeightMapPyramid::maxHeight(
+		const Eigen::Matrix<float, 6, 1> & coefficients,
+		const Eigen::Vector2f & center,
+		const std::vector<Eigen::Vector2f> & roi) const
+{
+	float maxHeight = 0.0f;
+	if(empty() || roi.size() < 3)
+	{
+		return maxHeight;
+	}
+	const Eigen::Matrix<double, 6, 1> k = toOrigin(coefficients, center);
+	bool first = true;
+	forEachSpan(roi, origin_, cellSize0_, maxHeights0_.rows, maxHeights0_.cols, [&](int r, float, int c0, int c1) {
+		const float * h = maxHeights0_.ptr<float>(r);
+		const double z = (r+0.5)*cellSize0_;
+		for(int c=c0; c<=c1; ++c)
+		{
+			if(!std::isnan(h[c]))
+			{
+				const double x = (c+0.5)*cellSize0_;
+				float height = h[c] - float(k[0] + k[1]*x + k[2]*z + k[3]*x*x + k[4]*x*z + k[5]*z*z);
+				maxHeight = first?height:std::max(maxHeight, height);
+				first = false;
+			}
+		}
+	});
+	return maxHeight;
+}
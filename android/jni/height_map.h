@@ -0,0 +1,199 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef HEIGHT_MAP_H_
+#define HEIGHT_MAP_H_
+
+#include <vector>
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+#include "mesh_volume.h"
+
+// 2.5D height map (DEM) of meshes on the ground plane. Cells are indexed
+// on the scene x/z plane (the same projection used to crop the meshes) and
+// keep the max/min height along y of the triangles covering them.
+// Triangles are binned in square tiles that are rasterized in parallel, so
+// the cost is linear in the number of triangles.
+class HeightMap {
+public:
+	struct Stats {
+		Stats() :
+			volume(0.0),
+			volumeBelow(0.0),
+			netVolume(0.0),
+			footprint(0.0),
+			maxHeight(0.0f),
+			cells(0)
+		{}
+		double volume;      // volume above the reference surface (m^3)
+		double volumeBelow; // volume below the reference surface (m^3)
+		double netVolume;   // volume - volumeBelow (m^3)
+		double footprint;   // area of the observed cells (m^2)
+		float maxHeight;    // highest cell above the reference surface (m)
+		int cells;          // observed cells
+	};
+
+	// Result of solve()
+	struct Solution {
+		Solution() :
+			cellSize(0.0f),
+			iterations(0),
+			difference(0.0),
+			converged(false)
+		{}
+		Stats stats;        // at the last resolution
+		float cellSize;     // last resolution (m)
+		int iterations;     // height maps rasterized
+		double difference;  // between the last two volumes, relative to the last one
+		bool converged;
+	};
+
+public:
+	HeightMap();
+
+	// Grid covering [min, max] on the x/z plane. The cell size is increased
+	// if the grid would be larger than maxCells x maxCells.
+	void create(const Eigen::Vector2f & min, const Eigen::Vector2f & max, float cellSize, int maxCells = 2048);
+	void clear();
+	bool empty() const {return maxHeights_.empty();}
+
+	// Rasterize the triangles of the inputs (in scene frame).
+	void addMeshes(const std::vector<MeshVolume::Input> & inputs);
+	// Rasterize points (clouds without polygons), pose is mesh to scene.
+	void addPoints(const MeshVolume::VertexArrays & vertices, const rtabmap::Transform & pose);
+
+	// Integrate the height above the reference plane y = a*x + b*z + c, with
+	// plane = (a, b, c). If roi (x/z polygon) is not empty, only the cells
+	// with their center inside the polygon are used.
+	Stats volume(const Eigen::Vector3f & plane, const std::vector<Eigen::Vector2f> & roi = std::vector<Eigen::Vector2f>()) const;
+
+	// Inside/outside (255/0) mask of the roi polygon, same size as the grid.
+	cv::Mat roiMask(const std::vector<Eigen::Vector2f> & roi) const;
+
+	float cellSize() const {return cellSize_;}
+	const Eigen::Vector2f & origin() const {return origin_;} // x/z of the corner of cell (0,0)
+	int cols() const {return maxHeights_.cols;}              // along x
+	int rows() const {return maxHeights_.rows;}              // along z
+	const cv::Mat & maxHeights() const {return maxHeights_;} // CV_32FC1, NaN if not observed
+	const cv::Mat & minHeights() const {return minHeights_;} // CV_32FC1, NaN if not observed
+
+	// x/z bounds of the inputs in scene frame
+	static bool bounds(const std::vector<MeshVolume::Input> & inputs, Eigen::Vector2f & min, Eigen::Vector2f & max);
+	// Least-squares plane y = a*x + b*z + c, horizontal plane at mean height
+	// if there are less than 3 non-collinear points.
+	static Eigen::Vector3f fitPlane(const std::vector<Eigen::Vector3f> & points);
+
+	// Adaptive resolution volume of the roi (x/z polygon) above the plane.
+	// Height maps of the roi bounds are rasterized with the cell size halved
+	// from maxCellSize down to minCellSize, until two consecutive volumes
+	// differ by less than tolerance (relative). The polygons overlapping the
+	// roi are selected once, so smooth piles converge on coarse grids without
+	// paying for the full resolution.
+	static Solution solve(
+			const std::vector<MeshVolume::Input> & inputs,
+			const Eigen::Vector3f & plane,
+			const std::vector<Eigen::Vector2f> & roi,
+			float tolerance,
+			float minCellSize,
+			float maxCellSize,
+			int maxCells = 2048);
+
+private:
+	float cellSize_;
+	Eigen::Vector2f origin_;
+	cv::Mat maxHeights_;
+	cv::Mat minHeights_;
+};
+
+// Multi-resolution summed-area tables of a height map. Each level halves the
+// resolution of the previous one and keeps, per cell, the sums over the
+// observed cells of level 0 of: count, height, x, z, x^2, x*z and z^2. The
+// net volume (above minus below) relative to a plane or a quadratic surface
+// is linear in these sums, so the net volume of any polygon ROI is answered
+// by a scanline traversal of the polygon, with O(1) per row span, without
+// touching the meshes. On level l, the ROI is snapped to the blocks of
+// 2^l x 2^l cells of level 0 whose center is inside it.
+class HeightMapPyramid {
+public:
+	HeightMapPyramid() {}
+	explicit HeightMapPyramid(const HeightMap & heightMap, int maxLevels = 6);
+
+	bool empty() const {return levels_.empty();}
+	int levels() const {return (int)levels_.size();}
+
+	// Net volume (above minus below), footprint and number of the observed
+	// cells inside the roi (x/z polygon) relative to the plane (a, b, c).
+	// If level is -1, the finest level with at most maxRows rows across the
+	// roi is used. Only netVolume, footprint and cells are set: volume,
+	// volumeBelow and maxHeight are not linear in the sums.
+	HeightMap::Stats volume(
+			const Eigen::Vector3f & plane,
+			const std::vector<Eigen::Vector2f> & roi,
+			int level = -1,
+			int maxRows = 256) const;
+	// Same relative to the quadratic surface y = c0 + c1*dx + c2*dz +
+	// c3*dx^2 + c4*dx*dz + c5*dz^2, with (dx, dz) relative to center
+	// (see GroundReference::Surface::quadratic()).
+	HeightMap::Stats volume(
+			const Eigen::Matrix<float, 6, 1> & coefficients,
+			const Eigen::Vector2f & center,
+			const std::vector<Eigen::Vector2f> & roi,
+			int level = -1,
+			int maxRows = 256) const;
+
+	// Highest observed cell of level 0 inside the roi relative to the plane
+	// or the quadratic surface (0 if none), O(cells inside the roi).
+	float maxHeight(
+			const Eigen::Vector3f & plane,
+			const std::vector<Eigen::Vector2f> & roi) const;
+	float maxHeight(
+			const Eigen::Matrix<float, 6, 1> & coefficients,
+			const Eigen::Vector2f & center,
+			const std::vector<Eigen::Vector2f> & roi) const;
+
+	// Centers (x, max height, z) of the observed cells of level 0 inside
+	// the x/z box [min, max], appended to points.
+	void cells(const Eigen::Vector2f & min, const Eigen::Vector2f & max, std::vector<Eigen::Vector3f> & points) const;
+
+private:
+	struct Level {
+		float cellSize;
+		int rows;
+		int cols;
+		std::vector<double> sat;        // (rows+1)x(cols+1)x7: count, height, x, z, x^2, x*z, z^2 (x/z relative to origin)
+	};
+
+	// Coefficients of the surface with x/z relative to origin_
+	Eigen::Matrix<double, 6, 1> toOrigin(const Eigen::Matrix<float, 6, 1> & coefficients, const Eigen::Vector2f & center) const;
+
+	float cellSize0_;
+	Eigen::Vector2f origin_;
+	cv::Mat maxHeights0_;  // max heights of level 0, NaN if not observed
+	std::vector<Level> levels_;
+};
+
+#endif /* HEIGHT_MAP_H_ */
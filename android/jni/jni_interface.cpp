@@ -880,6 +880,377 @@ Java_com_introlab_rtabmap_RTABMapLib_postProcessing(
     }
 }
 
+JNIEXPORT double JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_calculateMeshVolume(
+        JNIEnv* env, jclass, jlong native_application)
+{
+    if(native_application)
+    {
+        return native(native_application)->calculateMeshVolume();
+    }
+    else
+    {
+        UERROR("native_application is null!");
+        return -1.0;
+    }
+}
+
+JNIEXPORT double JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_calculateMeshVolumePreview(
+        JNIEnv* env, jclass, jlong native_application)
+{
+    if(native_application)
+    {
+        return native(native_application)->calculateMeshVolumePreview();
+    }
+    else
+    {
+        UERROR("native_application is null!");
+        return -1.0;
+    }
+}
+
+JNIEXPORT double JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_calculateOptimizedMeshVolume(
+        JNIEnv* env, jclass, jlong native_application)
+{
+    if(native_application)
+    {
+        return native(native_application)->calculateOptimizedMeshVolume();
+    }
+    else
+    {
+        UERROR("native_application is null!");
+        return -1.0;
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_setVolumeMode(
+        JNIEnv*, jclass, jlong native_application, int mode, float heightMapCellSize)
+{
+    if(native_application)
+    {
+        return native(native_application)->setVolumeMode(mode, heightMapCellSize);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_setOnlineHeightMap(
+        JNIEnv*, jclass, jlong native_application, bool enabled, float cellSize)
+{
+    if(native_application)
+    {
+        return native(native_application)->setOnlineHeightMap(enabled, cellSize);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
+JNIEXPORT jdouble JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_getOnlineVolume(
+        JNIEnv*, jclass, jlong native_application)
+{
+    if(native_application)
+    {
+        return native(native_application)->getOnlineVolume();
+    }
+    else
+    {
+        UERROR("native_application is null!");
+        return -1.0;
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_setCropPreview(
+        JNIEnv*, jclass, jlong native_application, bool enabled)
+{
+    if(native_application)
+    {
+        return native(native_application)->setCropPreview(enabled);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_commitCrop(
+        JNIEnv*, jclass, jlong native_application)
+{
+    if(native_application)
+    {
+        return native(native_application)->commitCrop();
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_undoCrop(
+        JNIEnv*, jclass, jlong native_application)
+{
+    if(native_application)
+    {
+        return native(native_application)->undoCrop();
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_redoCrop(
+        JNIEnv*, jclass, jlong native_application)
+{
+    if(native_application)
+    {
+        return native(native_application)->redoCrop();
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
+JNIEXPORT bool JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_addRoi(
+        JNIEnv* env, jclass, jlong native_application, jstring name)
+{
+    if(native_application)
+    {
+        std::string nameC;
+        GetJStringContent(env,name,nameC);
+        return native(native_application)->addRoi(nameC);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+        return false;
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_removeRoi(
+        JNIEnv* env, jclass, jlong native_application, jstring name)
+{
+    if(native_application)
+    {
+        std::string nameC;
+        GetJStringContent(env,name,nameC);
+        return native(native_application)->removeRoi(nameC);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
+JNIEXPORT jdoubleArray JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_getRoiVolumes(
+        JNIEnv* env, jclass, jlong native_application, jobjectArray names)
+{
+    std::vector<std::string> namesC(names?env->GetArrayLength(names):0);
+    for(size_t i=0; i<namesC.size(); ++i)
+    {
+        jstring name = (jstring)env->GetObjectArrayElement(names, i);
+        GetJStringContent(env,name,namesC[i]);
+        env->DeleteLocalRef(name);
+    }
+    std::vector<double> volumes(namesC.size(), -1.0);
+    if(native_application)
+    {
+        volumes = native(native_application)->getRoiVolumes(namesC);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+    jdoubleArray result = env->NewDoubleArray(volumes.size());
+    if(result && !volumes.empty())
+    {
+        env->SetDoubleArrayRegion(result, 0, volumes.size(), volumes.data());
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_setPileSeparation(
+        JNIEnv*, jclass, jlong native_application, bool enabled, int minTriangles, float weldDistance)
+{
+    if(native_application)
+    {
+        return native(native_application)->setPileSeparation(enabled, minTriangles, weldDistance);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_setVolumeCapping(
+        JNIEnv*, jclass, jlong native_application, bool enabled)
+{
+    if(native_application)
+    {
+        return native(native_application)->setVolumeCapping(enabled);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
+JNIEXPORT bool JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_setCropRegion(
+        JNIEnv* env, jclass, jlong native_application, jfloatArray primitives)
+{
+    std::vector<float> primitivesC(primitives?env->GetArrayLength(primitives):0);
+    if(!primitivesC.empty())
+    {
+        env->GetFloatArrayRegion(primitives, 0, primitivesC.size(), primitivesC.data());
+    }
+    if(native_application)
+    {
+        return native(native_application)->setCropRegion(primitivesC);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+        return false;
+    }
+}
+
+JNIEXPORT jdoubleArray JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_getPiles(
+        JNIEnv* env, jclass, jlong native_application)
+{
+    std::vector<double> values;
+    if(native_application)
+    {
+        values = native(native_application)->getPiles();
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+    jdoubleArray result = env->NewDoubleArray(values.size());
+    if(result && !values.empty())
+    {
+        env->SetDoubleArrayRegion(result, 0, values.size(), values.data());
+    }
+    return result;
+}
+
+JNIEXPORT jdoubleArray JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_computeCutFill(
+        JNIEnv* env, jclass, jlong native_application, jstring databaseBefore, jstring databaseAfter, float cellSize)
+{
+    std::vector<double> values;
+    if(native_application)
+    {
+        std::string databaseBeforeC;
+        std::string databaseAfterC;
+        GetJStringContent(env,databaseBefore,databaseBeforeC);
+        GetJStringContent(env,databaseAfter,databaseAfterC);
+        values = native(native_application)->computeCutFill(databaseBeforeC, databaseAfterC, cellSize);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+    jdoubleArray result = env->NewDoubleArray(values.size());
+    if(result && !values.empty())
+    {
+        env->SetDoubleArrayRegion(result, 0, values.size(), values.data());
+    }
+    return result;
+}
+
+JNIEXPORT jdoubleArray JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_estimateVolumeUncertainty(
+        JNIEnv* env, jclass, jlong native_application, int samples, float referenceSigma)
+{
+    std::vector<double> values;
+    if(native_application)
+    {
+        values = native(native_application)->estimateVolumeUncertainty(samples, referenceSigma);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+    jdoubleArray result = env->NewDoubleArray(values.size());
+    if(result && !values.empty())
+    {
+        env->SetDoubleArrayRegion(result, 0, values.size(), values.data());
+    }
+    return result;
+}
+
+JNIEXPORT jdoubleArray JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_solveVolume(
+        JNIEnv* env, jclass, jlong native_application, jstring roi, float tolerance, float minCellSize, float maxCellSize)
+{
+    std::vector<double> values;
+    if(native_application)
+    {
+        std::string roiC;
+        GetJStringContent(env,roi,roiC);
+        values = native(native_application)->solveVolume(roiC, tolerance, minCellSize, maxCellSize);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+    jdoubleArray result = env->NewDoubleArray(values.size());
+    if(result && !values.empty())
+    {
+        env->SetDoubleArrayRegion(result, 0, values.size(), values.data());
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_setGroundReference(
+        JNIEnv*, jclass, jlong native_application, float band, float inlierDistance, bool quadratic)
+{
+    if(native_application)
+    {
+        return native(native_application)->setGroundReference(band, inlierDistance, quadratic);
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_introlab_rtabmap_RTABMapLib_clearCutFill(
+        JNIEnv*, jclass, jlong native_application)
+{
+    if(native_application)
+    {
+        return native(native_application)->clearCutFill();
+    }
+    else
+    {
+        UERROR("native_application is null!");
+    }
+}
+
 JNIEXPORT void JNICALL
 Java_com_introlab_rtabmap_RTABMapLib_postOdometryEvent(
         JNIEnv* env, jclass, jlong native_application,
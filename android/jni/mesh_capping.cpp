@@ -0,0 +1,236 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "mesh_capping.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <algorithm>
+
+namespace {
+
+inline double det(const Eigen::Vector3d & a, const Eigen::Vector3d & b, const Eigen::Vector3d & c)
+{
+	return a.dot(b.cross(c));
+}
+
+} // namespace
+
+MeshCapping::Boundary MeshCapping::extract(
+		const MeshVolume::VertexArrays & vertices,
+		const std::vector<pcl::Vertices> & polygons,
+		const std::vector<int> * labels)
+{
+	UASSERT(labels == 0 || labels->size() == polygons.size());
+	const unsigned int size = (unsigned int)vertices.size();
+
+	std::vector<bool> valid(polygons.size(), false);
+	for(size_t i=0; i<polygons.size(); ++i)
+	{
+		const std::vector<uint32_t> & v = polygons[i].vertices;
+		bool ok = v.size() >= 3 && (labels == 0 || labels->at(i) >= 0);
+		for(size_t j=0; j<v.size() && ok; ++j)
+		{
+			ok = v[j] < size;
+		}
+		valid[i] = ok;
+	}
+
+	// Half-edges indexed by source vertex
+	std::vector<int> start(size+1, 0);
+	for(size_t i=0; i<polygons.size(); ++i)
+	{
+		if(valid[i])
+		{
+			const std::vector<uint32_t> & v = polygons[i].vertices;
+			for(size_t j=0; j<v.size(); ++j)
+			{
+				++start[v[j]+1];
+			}
+		}
+	}
+	for(unsigned int i=0; i<size; ++i)
+	{
+		start[i+1] += start[i];
+	}
+	std::vector<uint32_t> targets(start[size]);
+	std::vector<int> owners(start[size]); // polygon of each half-edge
+	{
+		std::vector<int> cursor(start.begin(), start.end()-1);
+		for(size_t i=0; i<polygons.size(); ++i)
+		{
+			if(valid[i])
+			{
+				const std::vector<uint32_t> & v = polygons[i].vertices;
+				for(size_t j=0; j<v.size(); ++j)
+				{
+					int k = cursor[v[j]]++;
+					targets[k] = v[(j+1)%v.size()];
+					owners[k] = (int)i;
+				}
+			}
+		}
+	}
+
+	// Boundary half-edges: the target has no half-edge back to the source
+	std::vector<unsigned char> boundary(targets.size(), 0);
+	for(unsigned int a=0; a<size; ++a)
+	{
+		for(int k=start[a]; k<start[a+1]; ++k)
+		{
+			const uint32_t b = targets[k];
+			bool twin = false;
+			for(int l=start[b]; l<start[b+1] && !twin; ++l)
+			{
+				twin = targets[l] == a;
+			}
+			boundary[k] = twin?0:1;
+		}
+	}
+
+	// Chain the boundary half-edges, each one is used once
+	Boundary loops;
+	for(unsigned int a=0; a<size; ++a)
+	{
+		for(int k=start[a]; k<start[a+1]; ++k)
+		{
+			if(!boundary[k])
+			{
+				continue;
+			}
+			Loop loop;
+			loop.label = labels?labels->at(owners[k]):-1;
+			loop.points.push_back(Eigen::Vector3f(vertices.x[a], vertices.y[a], vertices.z[a]));
+			boundary[k] = 0;
+			uint32_t current = targets[k];
+			while(current != a)
+			{
+				int next = -1;
+				for(int l=start[current]; l<start[current+1] && next<0; ++l)
+				{
+					if(boundary[l])
+					{
+						next = l;
+					}
+				}
+				loop.points.push_back(Eigen::Vector3f(vertices.x[current], vertices.y[current], vertices.z[current]));
+				if(next < 0)
+				{
+					loop.closed = false;
+					break;
+				}
+				boundary[next] = 0;
+				current = targets[next];
+			}
+			loops.push_back(loop);
+		}
+	}
+	return loops;
+}
+
+std::vector<MeshCapping::Boundary> MeshCapping::extract(
+		const std::vector<MeshVolume::Input> & inputs,
+		const std::vector<std::vector<int> > * labels)
+{
+	UASSERT(labels == 0 || labels->size() == inputs.size());
+	std::vector<Boundary> boundaries(inputs.size());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int i=0; i<(int)inputs.size(); ++i)
+	{
+		UASSERT(inputs[i].vertices != 0 && inputs[i].polygons != 0);
+		boundaries[i] = extract(*inputs[i].vertices, *inputs[i].polygons, labels?&labels->at(i):0);
+	}
+	return boundaries;
+}
+
+double MeshCapping::signedVolume(
+		const Loop & loop,
+		const Eigen::Affine3d & meshToScene,
+		const GroundReference::Surface & ground,
+		const Eigen::Vector3d & reference,
+		double heightOffset)
+{
+	const size_t n = loop.points.size();
+	if(n < 3)
+	{
+		return 0.0;
+	}
+
+	// Loop and its projection on the ground, relative to the reference
+	std::vector<Eigen::Vector3d> top(n);
+	std::vector<Eigen::Vector3d> bottom(n);
+	Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+	for(size_t i=0; i<n; ++i)
+	{
+		Eigen::Vector3d p = meshToScene * loop.points[i].cast<double>();
+		centroid += p;
+		top[i] = p - reference;
+		bottom[i] = Eigen::Vector3d(p[0], ground.height(p[0], p[2]) + heightOffset, p[2]) - reference;
+	}
+	centroid /= double(n);
+	const Eigen::Vector3d g = Eigen::Vector3d(centroid[0], ground.height(centroid[0], centroid[2]) + heightOffset, centroid[2]) - reference;
+
+	// For the boundary half-edge a->b: wall (b, a, a') + (b, a', b') and
+	// cap (g, b', a'), so that each edge is shared by opposite half-edges.
+	double volume = 0.0;
+	for(size_t i=0; i<n; ++i)
+	{
+		const size_t j = (i+1)%n;
+		volume += det(top[j], top[i], bottom[i]);
+		volume += det(top[j], bottom[i], bottom[j]);
+		volume += det(g, bottom[j], bottom[i]);
+	}
+	return volume / 6.0;
+}
+
+double MeshCapping::signedVolume(
+		const Boundary & boundary,
+		const rtabmap::Transform & meshToScene,
+		const GroundReference::Surface & ground,
+		const Eigen::Vector3f & reference,
+		float heightOffset)
+{
+	Eigen::Affine3d transform = meshToScene.isNull()?Eigen::Affine3d::Identity():meshToScene.toEigen3d();
+	double volume = 0.0;
+	for(size_t i=0; i<boundary.size(); ++i)
+	{
+		volume += signedVolume(boundary[i], transform, ground, reference.cast<double>(), heightOffset);
+	}
+	return volume;
+}
+
+size_t MeshCapping::edges(const Boundary & boundary)
+{
+	size_t edges = 0;
+	for(size_t i=0; i<boundary.size(); ++i)
+	{
+		edges += boundary[i].points.size();
+	}
+	return edges;
+}
@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MESH_CAPPING_H_
+#define MESH_CAPPING_H_
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <pcl/Vertices.h>
+#include <rtabmap/core/Transform.h>
+#include "mesh_volume.h"
+#include "ground_reference.h"
+
+// Closes cropped (open) meshes down to the ground reference, so that their
+// signed volume no longer depends on the tetra apex. The boundary of the
+// polygons is made of the half-edges without opposite half-edge: they are
+// indexed per source vertex (CSR) and chained into loops, meshes are
+// processed in parallel. Each loop is closed by a wall (the loop projected
+// vertically on the ground) and a cap (triangle fan on the ground from the
+// loop centroid). Loops are kept in the mesh frame, so the volume of the
+// walls and caps can be evaluated for other poses or ground heights in
+// O(boundary) without touching the triangles.
+class MeshCapping {
+public:
+	struct Loop {
+		Loop() : label(-1), closed(true) {}
+		std::vector<Eigen::Vector3f> points; // boundary vertices in order (mesh frame)
+		int label;   // label of the polygon of the first edge (e.g., pile), -1 without labels
+		bool closed; // false if the chain stopped on a non-manifold vertex (capped anyway)
+	};
+	typedef std::vector<Loop> Boundary;
+
+	// Boundary loops of the polygons. If labels is not null (one per
+	// polygon), polygons with a negative label are ignored.
+	static Boundary extract(
+			const MeshVolume::VertexArrays & vertices,
+			const std::vector<pcl::Vertices> & polygons,
+			const std::vector<int> * labels = 0);
+	// One boundary per input, inputs are processed in parallel.
+	static std::vector<Boundary> extract(
+			const std::vector<MeshVolume::Input> & inputs,
+			const std::vector<std::vector<int> > * labels = 0);
+
+	// Signed volume of the walls and caps (same convention as
+	// MeshVolume::Stats::signedVolume) with respect to the reference point,
+	// to add to the signed volume of the polygons. heightOffset shifts the
+	// ground surface along y.
+	static double signedVolume(
+			const Loop & loop,
+			const Eigen::Affine3d & meshToScene,
+			const GroundReference::Surface & ground,
+			const Eigen::Vector3d & reference,
+			double heightOffset = 0.0);
+	static double signedVolume(
+			const Boundary & boundary,
+			const rtabmap::Transform & meshToScene,
+			const GroundReference::Surface & ground,
+			const Eigen::Vector3f & reference,
+			float heightOffset = 0.0f);
+
+	static size_t edges(const Boundary & boundary);
+};
+
+#endif /* MESH_CAPPING_H_ */
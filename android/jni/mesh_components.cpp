@@ -0,0 +1,391 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "mesh_components.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <algorithm>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <Eigen/Geometry>
+
+namespace {
+
+class UnionFind {
+public:
+	explicit UnionFind(size_t size) : parent_(size)
+	{
+		for(size_t i=0; i<size; ++i)
+		{
+			parent_[i] = (int)i;
+		}
+	}
+	int find(int i)
+	{
+		while(parent_[i] != i)
+		{
+			parent_[i] = parent_[parent_[i]]; // path halving
+			i = parent_[i];
+		}
+		return i;
+	}
+	void merge(int a, int b)
+	{
+		a = find(a);
+		b = find(b);
+		// smallest root kept, so that labels don't depend on the merge order
+		if(a < b)
+		{
+			parent_[b] = a;
+		}
+		else if(b < a)
+		{
+			parent_[a] = b;
+		}
+	}
+private:
+	std::vector<int> parent_;
+};
+
+// Components of one mesh, ordered by first polygon.
+struct LocalComponents {
+	std::vector<int> polygons; // component of each polygon, -1 if invalid
+	std::vector<MeshComponents::Component> components;
+	std::vector<int> boundaryComponents; // component of each boundary vertex
+	std::vector<Eigen::Vector3f> boundaryPoints; // boundary vertices (scene frame)
+};
+
+void labelMesh(const MeshVolume::Input & input, LocalComponents & out)
+{
+	UASSERT(input.vertices != 0 && input.polygons != 0);
+	const MeshVolume::VertexArrays & v = *input.vertices;
+	const std::vector<pcl::Vertices> & polygons = *input.polygons;
+	const unsigned int size = (unsigned int)v.size();
+	Eigen::Affine3f transform = input.pose.isNull()?Eigen::Affine3f::Identity():input.pose.toEigen3f();
+
+	// Union of the vertices of each polygon, edges kept to find the boundary
+	UnionFind uf(size);
+	std::vector<uint64_t> edges;
+	edges.reserve(polygons.size()*3);
+	out.polygons.assign(polygons.size(), -1);
+	for(size_t i=0; i<polygons.size(); ++i)
+	{
+		const std::vector<uint32_t> & vertices = polygons[i].vertices;
+		bool valid = vertices.size() >= 3;
+		for(size_t j=0; j<vertices.size() && valid; ++j)
+		{
+			valid = vertices[j] < size;
+		}
+		if(!valid)
+		{
+			continue;
+		}
+		out.polygons[i] = 0;
+		for(size_t j=0; j<vertices.size(); ++j)
+		{
+			uf.merge(vertices[0], vertices[j]);
+			uint32_t a = vertices[j];
+			uint32_t b = vertices[(j+1)%vertices.size()];
+			edges.push_back(a<b?(uint64_t(a)<<32 | b):(uint64_t(b)<<32 | a));
+		}
+	}
+
+	// Compact labels, bounds in scene frame
+	std::vector<int> rootComponents(size, -1);
+	std::vector<int> vertexComponents(size, -1);
+	for(size_t i=0; i<polygons.size(); ++i)
+	{
+		if(out.polygons[i] < 0)
+		{
+			continue;
+		}
+		const std::vector<uint32_t> & vertices = polygons[i].vertices;
+		int & c = rootComponents[uf.find(vertices[0])];
+		if(c < 0)
+		{
+			c = (int)out.components.size();
+			out.components.push_back(MeshComponents::Component());
+		}
+		out.polygons[i] = c;
+		MeshComponents::Component & component = out.components[c];
+		component.triangles += (int)vertices.size()-2;
+		for(size_t j=0; j<vertices.size(); ++j)
+		{
+			if(vertexComponents[vertices[j]] < 0)
+			{
+				vertexComponents[vertices[j]] = c;
+				Eigen::Vector3f p = transform * Eigen::Vector3f(v.x[vertices[j]], v.y[vertices[j]], v.z[vertices[j]]);
+				component.min = component.min.cwiseMin(p);
+				component.max = component.max.cwiseMax(p);
+			}
+		}
+	}
+
+	// Boundary vertices: on edges used by only one polygon
+	std::sort(edges.begin(), edges.end());
+	std::vector<bool> boundary(size, false);
+	for(size_t i=0; i<edges.size();)
+	{
+		size_t j = i+1;
+		while(j<edges.size() && edges[j] == edges[i])
+		{
+			++j;
+		}
+		if(j-i == 1)
+		{
+			boundary[edges[i]>>32] = true;
+			boundary[edges[i] & 0xFFFFFFFF] = true;
+		}
+		i = j;
+	}
+	for(unsigned int i=0; i<size; ++i)
+	{
+		if(boundary[i])
+		{
+			out.boundaryComponents.push_back(vertexComponents[i]);
+			out.boundaryPoints.push_back(transform * Eigen::Vector3f(v.x[i], v.y[i], v.z[i]));
+		}
+	}
+}
+
+// Below, the cells of the weld grid would be too small (and their
+// coordinates could overflow the int keys).
+const float kMinWeldDistance = 0.0001f; // m
+// Cells of the weld grid are kept within +-kMaxWeldCell (room for the
+// neighbor offsets), farther points are not welded.
+const float kMaxWeldCell = float(1<<30);
+
+inline uint64_t cellKey(int x, int y, int z)
+{
+	return (uint64_t(x & 0x1FFFFF) << 42) | (uint64_t(y & 0x1FFFFF) << 21) | uint64_t(z & 0x1FFFFF);
+}
+
+} // namespace
+
+std::vector<MeshComponents::Component> MeshComponents::label(
+		const std::vector<MeshVolume::Input> & inputs,
+		float weldDistance,
+		std::vector<std::vector<int> > & labels)
+{
+	std::vector<LocalComponents> locals(inputs.size());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int i=0; i<(int)inputs.size(); ++i)
+	{
+		labelMesh(inputs[i], locals[i]);
+	}
+
+	std::vector<int> offsets(inputs.size()+1, 0);
+	for(size_t i=0; i<inputs.size(); ++i)
+	{
+		offsets[i+1] = offsets[i] + (int)locals[i].components.size();
+	}
+	UnionFind uf(offsets.back());
+
+	// Weld boundary vertices closer than weldDistance, in the same mesh too
+	// (meshes with duplicated vertices, e.g., textured meshes)
+	if(weldDistance > 0.0f)
+	{
+		if(weldDistance < kMinWeldDistance)
+		{
+			UWARN("Weld distance (%g m) is too small, using %g m.", weldDistance, kMinWeldDistance);
+			weldDistance = kMinWeldDistance;
+		}
+		std::vector<int> nodes;
+		std::vector<Eigen::Vector3f> points;
+		for(size_t i=0; i<locals.size(); ++i)
+		{
+			for(size_t j=0; j<locals[i].boundaryPoints.size(); ++j)
+			{
+				nodes.push_back(offsets[i] + locals[i].boundaryComponents[j]);
+				points.push_back(locals[i].boundaryPoints[j]);
+			}
+		}
+		std::vector<Eigen::Vector3i> cells(points.size());
+		std::vector<bool> valid(points.size(), false);
+		std::unordered_map<uint64_t, std::vector<int> > grid;
+		grid.reserve(points.size());
+		for(size_t i=0; i<points.size(); ++i)
+		{
+			// range checked in float before the cast (NaN fails too)
+			Eigen::Array3f cell = (points[i] / weldDistance).array().floor();
+			if(!(cell.abs() < kMaxWeldCell).all())
+			{
+				continue;
+			}
+			cells[i] = cell.cast<int>();
+			valid[i] = true;
+			grid[cellKey(cells[i][0], cells[i][1], cells[i][2])].push_back((int)i);
+		}
+		const float squaredWeldDistance = weldDistance*weldDistance;
+		for(size_t i=0; i<points.size(); ++i)
+		{
+			if(!valid[i])
+			{
+				continue;
+			}
+			for(int dx=-1; dx<=1; ++dx)
+			{
+				for(int dy=-1; dy<=1; ++dy)
+				{
+					for(int dz=-1; dz<=1; ++dz)
+					{
+						std::unordered_map<uint64_t, std::vector<int> >::const_iterator iter =
+								grid.find(cellKey(cells[i][0]+dx, cells[i][1]+dy, cells[i][2]+dz));
+						if(iter == grid.end())
+						{
+							continue;
+						}
+						for(size_t k=0; k<iter->second.size(); ++k)
+						{
+							int j = iter->second[k];
+							if(j > (int)i &&
+							   nodes[j] != nodes[i] &&
+							   (points[j]-points[i]).squaredNorm() <= squaredWeldDistance)
+							{
+								uf.merge(nodes[i], nodes[j]);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// Global components, ordered by first polygon
+	std::vector<Component> components;
+	std::vector<int> rootComponents(offsets.back(), -1);
+	std::vector<int> localToGlobal(offsets.back(), -1);
+	for(size_t i=0; i<locals.size(); ++i)
+	{
+		for(size_t j=0; j<locals[i].components.size(); ++j)
+		{
+			int & c = rootComponents[uf.find(offsets[i]+(int)j)];
+			if(c < 0)
+			{
+				c = (int)components.size();
+				components.push_back(Component());
+			}
+			localToGlobal[offsets[i]+j] = c;
+			const Component & local = locals[i].components[j];
+			components[c].triangles += local.triangles;
+			components[c].min = components[c].min.cwiseMin(local.min);
+			components[c].max = components[c].max.cwiseMax(local.max);
+		}
+	}
+	labels.resize(inputs.size());
+	for(size_t i=0; i<locals.size(); ++i)
+	{
+		labels[i].swap(locals[i].polygons);
+		for(size_t j=0; j<labels[i].size(); ++j)
+		{
+			if(labels[i][j] >= 0)
+			{
+				labels[i][j] = localToGlobal[offsets[i]+labels[i][j]];
+			}
+		}
+	}
+	return components;
+}
+
+std::vector<MeshComponents::Component> MeshComponents::compute(
+		const std::vector<MeshVolume::Input> & inputs,
+		const Eigen::Vector3f & reference,
+		float weldDistance,
+		int minTriangles,
+		std::vector<std::vector<int> > * labels,
+		std::vector<MeshVolume::Moments> * moments)
+{
+	std::vector<std::vector<int> > polygonLabels;
+	std::vector<Component> components = label(inputs, weldDistance, polygonLabels);
+
+	// Small fragments are dropped before integration
+	std::vector<int> keptIndices(components.size(), -1);
+	std::vector<Component> kept;
+	for(size_t i=0; i<components.size(); ++i)
+	{
+		if(components[i].triangles >= minTriangles)
+		{
+			keptIndices[i] = (int)kept.size();
+			kept.push_back(components[i]);
+		}
+	}
+
+	// One input per mesh and component, all integrated in the same pass
+	std::list<std::vector<pcl::Vertices> > polygons;
+	std::vector<MeshVolume::Input> componentInputs;
+	std::vector<int> groups;
+	std::vector<int> origins;
+	for(size_t i=0; i<inputs.size(); ++i)
+	{
+		std::map<int, std::vector<pcl::Vertices> > componentPolygons;
+		for(size_t j=0; j<polygonLabels[i].size(); ++j)
+		{
+			int & c = polygonLabels[i][j];
+			c = c>=0?keptIndices[c]:-1;
+			if(c >= 0)
+			{
+				componentPolygons[c].push_back(inputs[i].polygons->at(j));
+			}
+		}
+		for(std::map<int, std::vector<pcl::Vertices> >::iterator iter=componentPolygons.begin(); iter!=componentPolygons.end(); ++iter)
+		{
+			polygons.push_back(std::vector<pcl::Vertices>());
+			polygons.back().swap(iter->second);
+			componentInputs.push_back(MeshVolume::Input(inputs[i].vertices, &polygons.back(), inputs[i].pose));
+			groups.push_back(iter->first);
+			origins.push_back((int)i);
+		}
+	}
+
+	std::vector<MeshVolume::Moments> componentMoments;
+	std::vector<MeshVolume::Stats> stats = MeshVolume::compute(
+			componentInputs,
+			groups,
+			std::vector<Eigen::Vector3f>(kept.size(), reference),
+			moments?&componentMoments:0);
+	for(size_t i=0; i<kept.size(); ++i)
+	{
+		kept[i].stats = stats[i];
+	}
+	if(moments)
+	{
+		moments->assign(inputs.size(), MeshVolume::Moments());
+		for(size_t i=0; i<componentMoments.size(); ++i)
+		{
+			moments->at(origins[i]) += componentMoments[i];
+		}
+	}
+	if(labels)
+	{
+		labels->swap(polygonLabels);
+	}
+	return kept;
+}
@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MESH_COMPONENTS_H_
+#define MESH_COMPONENTS_H_
+
+#include <vector>
+#include <limits>
+#include <Eigen/Core>
+#include "mesh_volume.h"
+
+// Connected components of the polygons of several meshes (e.g., separate
+// piles and floating debris in a cropped region). Inside each mesh,
+// polygons sharing a vertex are connected (union-find over the vertices,
+// meshes labeled in parallel). Meshes of different nodes don't share
+// vertices: their boundary vertices (on edges used by only one polygon)
+// are hashed in a uniform grid in the scene frame and vertices closer than
+// the weld distance (at least 0.1 mm) connect their components.
+class MeshComponents {
+public:
+	struct Component {
+		Component() :
+			triangles(0),
+			min(Eigen::Vector3f::Constant(std::numeric_limits<float>::max())),
+			max(Eigen::Vector3f::Constant(-std::numeric_limits<float>::max()))
+		{}
+		float height() const {return triangles?max[1]-min[1]:0.0f;}
+
+		int triangles;
+		Eigen::Vector3f min; // bounds of the vertices (scene frame)
+		Eigen::Vector3f max;
+		MeshVolume::Stats stats; // set by compute()
+	};
+
+	// labels[i][j] is the component of polygon j of inputs[i], -1 for
+	// invalid polygons. Components are ordered by first polygon.
+	static std::vector<Component> label(
+			const std::vector<MeshVolume::Input> & inputs,
+			float weldDistance,
+			std::vector<std::vector<int> > & labels);
+
+	// Components with less than minTriangles triangles are dropped, the
+	// others are integrated in the same parallel pass with respect to the
+	// reference point. Only the kept components are returned, labels are
+	// their indices (-1 for dropped polygons). If moments is not null, it is
+	// filled with the local moments of the kept polygons of each input.
+	static std::vector<Component> compute(
+			const std::vector<MeshVolume::Input> & inputs,
+			const Eigen::Vector3f & reference,
+			float weldDistance,
+			int minTriangles,
+			std::vector<std::vector<int> > * labels = 0,
+			std::vector<MeshVolume::Moments> * moments = 0);
+};
+
+#endif /* MESH_COMPONENTS_H_ */
@@ -0,0 +1,468 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "mesh_crop.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+inline float cross(const Eigen::Vector2f & a, const Eigen::Vector2f & b)
+{
+	return a[0]*b[1] - a[1]*b[0];
+}
+
+// Proper intersection of segments p0p1 and q0q1 (end points are half-open,
+// consistently with the even-odd rule).
+inline bool segmentsCross(const Eigen::Vector2f & p0, const Eigen::Vector2f & p1, const Eigen::Vector2f & q0, const Eigen::Vector2f & q1)
+{
+	const Eigen::Vector2f q = q1 - q0;
+	const Eigen::Vector2f p = p1 - p0;
+	return (cross(q, p0 - q0) > 0.0f) != (cross(q, p1 - q0) > 0.0f) &&
+		   (cross(p, q0 - p0) > 0.0f) != (cross(p, q1 - p0) > 0.0f);
+}
+
+// Segment ab touches the rectangle [min, max] (the bounding boxes are
+// assumed to overlap): the corners are not all on the same side of ab.
+inline bool segmentTouchesRect(const Eigen::Vector2f & a, const Eigen::Vector2f & b, const Eigen::Vector2f & min, const Eigen::Vector2f & max)
+{
+	const Eigen::Vector2f d = b - a;
+	float s0 = cross(d, Eigen::Vector2f(min[0], min[1]) - a);
+	float s1 = cross(d, Eigen::Vector2f(max[0], min[1]) - a);
+	float s2 = cross(d, Eigen::Vector2f(min[0], max[1]) - a);
+	float s3 = cross(d, Eigen::Vector2f(max[0], max[1]) - a);
+	return !((s0 > 0.0f && s1 > 0.0f && s2 > 0.0f && s3 > 0.0f) ||
+			 (s0 < 0.0f && s1 < 0.0f && s2 < 0.0f && s3 < 0.0f));
+}
+
+} // namespace
+
+MeshCrop::MeshCrop(const std::vector<Eigen::Vector2f> & polygon, int gridSize) :
+		polygon_(polygon),
+		gridSize_(0),
+		cellSizeX_(0.0f),
+		cellSizeZ_(0.0f)
+{
+	init(gridSize);
+}
+
+MeshCrop::MeshCrop(const std::vector<rtabmap::Transform> & polygon, int gridSize) :
+		gridSize_(0),
+		cellSizeX_(0.0f),
+		cellSizeZ_(0.0f)
+{
+	polygon_.resize(polygon.size());
+	for(size_t i=0; i<polygon.size(); ++i)
+	{
+		polygon_[i] = Eigen::Vector2f(polygon[i].x(), polygon[i].z());
+	}
+	init(gridSize);
+}
+
+void MeshCrop::init(int gridSize)
+{
+	if(empty())
+	{
+		return;
+	}
+	UASSERT(gridSize > 0);
+	min_ = max_ = polygon_[0];
+	for(size_t i=1; i<polygon_.size(); ++i)
+	{
+		min_ = min_.cwiseMin(polygon_[i]);
+		max_ = max_.cwiseMax(polygon_[i]);
+	}
+	gridSize_ = gridSize;
+	cellSizeX_ = std::max((max_[0] - min_[0]) / float(gridSize_), 1e-6f);
+	cellSizeZ_ = std::max((max_[1] - min_[1]) / float(gridSize_), 1e-6f);
+
+	// Edges crossing each cell (two passes: count, then fill)
+	const int cells = gridSize_*gridSize_;
+	const int edges = (int)polygon_.size();
+	std::vector<int> edgeCells;
+	std::vector<int> edgeCellEdge;
+	for(int e=0; e<edges; ++e)
+	{
+		const Eigen::Vector2f & a = polygon_[e];
+		const Eigen::Vector2f & b = polygon_[(e+1)%edges];
+		int x0 = std::max(0, std::min(gridSize_-1, int((std::min(a[0], b[0]) - min_[0]) / cellSizeX_)));
+		int x1 = std::max(0, std::min(gridSize_-1, int((std::max(a[0], b[0]) - min_[0]) / cellSizeX_)));
+		int z0 = std::max(0, std::min(gridSize_-1, int((std::min(a[1], b[1]) - min_[1]) / cellSizeZ_)));
+		int z1 = std::max(0, std::min(gridSize_-1, int((std::max(a[1], b[1]) - min_[1]) / cellSizeZ_)));
+		for(int cz=z0; cz<=z1; ++cz)
+		{
+			for(int cx=x0; cx<=x1; ++cx)
+			{
+				Eigen::Vector2f cmin(min_[0] + float(cx)*cellSizeX_, min_[1] + float(cz)*cellSizeZ_);
+				Eigen::Vector2f cmax(cmin[0] + cellSizeX_, cmin[1] + cellSizeZ_);
+				if(segmentTouchesRect(a, b, cmin, cmax))
+				{
+					edgeCells.push_back(cz*gridSize_ + cx);
+					edgeCellEdge.push_back(e);
+				}
+			}
+		}
+	}
+	cellEdgesStart_.assign(cells+1, 0);
+	for(size_t i=0; i<edgeCells.size(); ++i)
+	{
+		++cellEdgesStart_[edgeCells[i]+1];
+	}
+	for(int i=0; i<cells; ++i)
+	{
+		cellEdgesStart_[i+1] += cellEdgesStart_[i];
+	}
+	cellEdges_.resize(edgeCells.size());
+	std::vector<int> offsets(cellEdgesStart_.begin(), cellEdgesStart_.end()-1);
+	for(size_t i=0; i<edgeCells.size(); ++i)
+	{
+		cellEdges_[offsets[edgeCells[i]]++] = edgeCellEdge[i];
+	}
+
+	// Reference inside state at the center of each cell
+	centerInside_.resize(cells);
+	for(int cz=0; cz<gridSize_; ++cz)
+	{
+		for(int cx=0; cx<gridSize_; ++cx)
+		{
+			centerInside_[cz*gridSize_ + cx] = insideSlow(
+					min_[0] + (float(cx)+0.5f)*cellSizeX_,
+					min_[1] + (float(cz)+0.5f)*cellSizeZ_)?1:0;
+		}
+	}
+}
+
+bool MeshCrop::insideSlow(float x, float z) const
+{
+	bool inside = false;
+	for(size_t i=0, j=polygon_.size()-1; i<polygon_.size(); j=i++)
+	{
+		const Eigen::Vector2f & a = polygon_[i];
+		const Eigen::Vector2f & b = polygon_[j];
+		if((a[1] > z) != (b[1] > z) &&
+		   x < (b[0]-a[0]) * (z-a[1]) / (b[1]-a[1]) + a[0])
+		{
+			inside = !inside;
+		}
+	}
+	return inside;
+}
+
+int MeshCrop::cellIndex(float x, float z) const
+{
+	int cx = std::min(gridSize_-1, int((x - min_[0]) / cellSizeX_));
+	int cz = std::min(gridSize_-1, int((z - min_[1]) / cellSizeZ_));
+	return cz*gridSize_ + cx;
+}
+
+bool MeshCrop::inside(float x, float z) const
+{
+	// also rejects NaN
+	if(!(x >= min_[0] && x <= max_[0] && z >= min_[1] && z <= max_[1]))
+	{
+		return false;
+	}
+	const int index = cellIndex(x, z);
+	bool inside = centerInside_[index] != 0;
+	const int end = cellEdgesStart_[index+1];
+	if(cellEdgesStart_[index] == end)
+	{
+		return inside;
+	}
+	// Flip the state of the center for each edge between the center and the point
+	const Eigen::Vector2f center(
+			min_[0] + (float(index % gridSize_)+0.5f)*cellSizeX_,
+			min_[1] + (float(index / gridSize_)+0.5f)*cellSizeZ_);
+	const Eigen::Vector2f point(x, z);
+	const int edges = (int)polygon_.size();
+	for(int i=cellEdgesStart_[index]; i<end; ++i)
+	{
+		const int e = cellEdges_[i];
+		if(segmentsCross(center, point, polygon_[e], polygon_[(e+1)%edges]))
+		{
+			inside = !inside;
+		}
+	}
+	return inside;
+}
+
+int MeshCrop::classify(const Eigen::Vector2f & min, const Eigen::Vector2f & max) const
+{
+	if(empty() || !(min[0] <= max[0] && min[1] <= max[1]))
+	{
+		return 0;
+	}
+	if(max[0] < min_[0] || max[1] < min_[1] || min[0] > max_[0] || min[1] > max_[1])
+	{
+		return -1;
+	}
+	bool anyOutside = min[0] < min_[0] || min[1] < min_[1] || max[0] > max_[0] || max[1] > max_[1];
+	bool anyInside = false;
+	const int x0 = std::max(0, int((min[0] - min_[0]) / cellSizeX_));
+	const int z0 = std::max(0, int((min[1] - min_[1]) / cellSizeZ_));
+	const int x1 = std::min(gridSize_-1, int((max[0] - min_[0]) / cellSizeX_));
+	const int z1 = std::min(gridSize_-1, int((max[1] - min_[1]) / cellSizeZ_));
+	for(int cz=z0; cz<=z1; ++cz)
+	{
+		for(int cx=x0; cx<=x1; ++cx)
+		{
+			const int index = cz*gridSize_ + cx;
+			if(cellEdgesStart_[index] != cellEdgesStart_[index+1])
+			{
+				return 0;
+			}
+			if(centerInside_[index])
+			{
+				anyInside = true;
+			}
+			else
+			{
+				anyOutside = true;
+			}
+			if(anyInside && anyOutside)
+			{
+				return 0;
+			}
+		}
+	}
+	return anyInside?1:-1;
+}
+
+void MeshCrop::classifyVertices(
+		const MeshVolume::VertexArrays & vertices,
+		const rtabmap::Transform & meshToScene,
+		std::vector<unsigned int> & mask) const
+{
+	const int n = (int)vertices.size();
+	const int words = (n + 31) / 32;
+	mask.resize(words);
+	if(empty())
+	{
+		std::fill(mask.begin(), mask.end(), 0);
+		return;
+	}
+	// Only x and z in scene frame are needed
+	const Eigen::Matrix4f m = meshToScene.toEigen3f().matrix();
+	const float r00 = m(0,0), r01 = m(0,1), r02 = m(0,2), tx = m(0,3);
+	const float r20 = m(2,0), r21 = m(2,1), r22 = m(2,2), tz = m(2,3);
+	const float * vx = vertices.x.data();
+	const float * vy = vertices.y.data();
+	const float * vz = vertices.z.data();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for(int w=0; w<words; ++w)
+	{
+		const int begin = w*32;
+		const int end = std::min(begin+32, n);
+		unsigned int bits = 0;
+		for(int i=begin; i<end; ++i)
+		{
+			const float x = r00*vx[i] + r01*vy[i] + r02*vz[i] + tx;
+			const float z = r20*vx[i] + r21*vy[i] + r22*vz[i] + tz;
+			if(inside(x, z))
+			{
+				bits |= 1u << (i-begin);
+			}
+		}
+		mask[w] = bits;
+	}
+}
+
+void MeshCrop::classifyVertices(
+		const std::vector<const MeshCrop*> & crops,
+		const MeshVolume::VertexArrays & vertices,
+		const rtabmap::Transform & meshToScene,
+		std::vector<unsigned int> & masks)
+{
+	UASSERT(crops.size() <= 32);
+	const int n = (int)vertices.size();
+	masks.resize(n);
+	const int count = (int)crops.size();
+	const Eigen::Matrix4f m = meshToScene.toEigen3f().matrix();
+	const float r00 = m(0,0), r01 = m(0,1), r02 = m(0,2), tx = m(0,3);
+	const float r20 = m(2,0), r21 = m(2,1), r22 = m(2,2), tz = m(2,3);
+	const float * vx = vertices.x.data();
+	const float * vy = vertices.y.data();
+	const float * vz = vertices.z.data();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for(int i=0; i<n; ++i)
+	{
+		const float x = r00*vx[i] + r01*vy[i] + r02*vz[i] + tx;
+		const float z = r20*vx[i] + r21*vy[i] + r22*vz[i] + tz;
+		unsigned int bits = 0;
+		for(int k=0; k<count; ++k)
+		{
+			if(!crops[k]->empty() && crops[k]->inside(x, z))
+			{
+				bits |= 1u << k;
+			}
+		}
+		masks[i] = bits;
+	}
+}
+
+int MeshCrop::crop(
+		const MeshVolume::VertexArrays & vertices,
+		const rtabmap::Transform & meshToScene,
+		std::vector<pcl::Vertices> & polygons,
+		const Eigen::Vector3f * aabbMin,
+		const Eigen::Vector3f * aabbMax,
+		std::vector<int> * keptIndices) const
+{
+	if(keptIndices)
+	{
+		keptIndices->clear();
+	}
+	if(empty() || vertices.size() == 0)
+	{
+		polygons.clear();
+		return 0;
+	}
+
+	// Early accept/reject of the whole mesh
+	if(aabbMin && aabbMax)
+	{
+		Eigen::Vector2f min, max;
+		boundsXZ(*aabbMin, *aabbMax, meshToScene, min, max);
+		int c = classify(min, max);
+		if(c < 0)
+		{
+			polygons.clear();
+			return 0;
+		}
+		else if(c > 0)
+		{
+			if(keptIndices)
+			{
+				keptIndices->resize(polygons.size());
+				for(size_t i=0; i<polygons.size(); ++i)
+				{
+					(*keptIndices)[i] = (int)i;
+				}
+			}
+			return (int)polygons.size();
+		}
+	}
+
+	std::vector<unsigned int> mask;
+	classifyVertices(vertices, meshToScene, mask);
+
+	// In place, the order of the polygons is kept
+	const size_t n = vertices.size();
+	size_t kept = 0;
+	for(size_t i=0; i<polygons.size(); ++i)
+	{
+		const pcl::Vertices & polygon = polygons[i];
+		bool allInside = polygon.vertices.size() >= 3;
+		for(size_t j=0; j<polygon.vertices.size() && allInside; ++j)
+		{
+			// negative indices (signed index type) wrap and are rejected
+			const size_t v = (size_t)polygon.vertices[j];
+			allInside = v < n && (mask[v>>5] & (1u << (v&31))) != 0;
+		}
+		if(allInside)
+		{
+			if(kept != i)
+			{
+				polygons[kept].vertices.swap(polygons[i].vertices);
+			}
+			if(keptIndices)
+			{
+				keptIndices->push_back((int)i);
+			}
+			++kept;
+		}
+	}
+	polygons.resize(kept);
+	return (int)kept;
+}
+
+void MeshCrop::boundsXZ(
+		const Eigen::Vector3f & aabbMin,
+		const Eigen::Vector3f & aabbMax,
+		const rtabmap::Transform & meshToScene,
+		Eigen::Vector2f & min,
+		Eigen::Vector2f & max)
+{
+	const Eigen::Affine3f t = meshToScene.toEigen3f();
+	for(int i=0; i<8; ++i)
+	{
+		Eigen::Vector3f corner(
+				(i&1)?aabbMax[0]:aabbMin[0],
+				(i&2)?aabbMax[1]:aabbMin[1],
+				(i&4)?aabbMax[2]:aabbMin[2]);
+		Eigen::Vector3f p = t * corner;
+		Eigen::Vector2f pxz(p[0], p[2]);
+		if(i == 0)
+		{
+			min = max = pxz;
+		}
+		else
+		{
+			min = min.cwiseMin(pxz);
+			max = max.cwiseMax(pxz);
+		}
+	}
+}
+
+PolygonMask::PolygonMask(const std::vector<int> & indices, size_t polygons) :
+	bits_((polygons+31)/32, 0),
+	size_(polygons),
+	count_(indices.size())
+{
+	for(size_t i=0; i<indices.size(); ++i)
+	{
+		UASSERT(indices[i] >= 0 && indices[i] < (int)polygons);
+		bits_[indices[i]/32] |= 1u << (indices[i]%32);
+	}
+}
+
+std::vector<int> PolygonMask::indices() const
+{
+	std::vector<int> indices(count_);
+	size_t oi = 0;
+	for(size_t w=0; w<bits_.size(); ++w)
+	{
+		unsigned int word = bits_[w];
+		for(int b=0; word; ++b, word>>=1)
+		{
+			if(word & 1)
+			{
+				indices[oi++] = (int)(w*32 + b);
+			}
+		}
+	}
+	UASSERT(oi == count_);
+	return indices;
+}
@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MESH_CROP_H_
+#define MESH_CROP_H_
+
+#include <vector>
+#include <Eigen/Core>
+#include <pcl/Vertices.h>
+#include <rtabmap/core/Transform.h>
+#include "mesh_volume.h"
+
+// Crop engine for the marker polygon on the scene x/z plane. The polygon is
+// indexed once in a uniform grid over its bounds: each cell knows if its
+// center is inside and which edges cross it. A point is then classified by
+// counting the crossings between the center of its cell and the point, so
+// the cost per point does not depend on the number of markers.
+// Vertices are classified once (in parallel) into a bitmask, then polygons
+// are selected by looking up the bits of their vertices: O(V + T).
+class MeshCrop {
+public:
+	MeshCrop() : gridSize_(0), cellSizeX_(0.0f), cellSizeZ_(0.0f) {}
+	// polygon on the scene x/z plane, the grid has at most gridSize x gridSize cells
+	explicit MeshCrop(const std::vector<Eigen::Vector2f> & polygon, int gridSize = 64);
+	explicit MeshCrop(const std::vector<rtabmap::Transform> & polygon, int gridSize = 64);
+
+	bool empty() const {return polygon_.size() < 3;}
+
+	// Even-odd inside test of a point on the scene x/z plane.
+	bool inside(float x, float z) const;
+	// Rectangle on the scene x/z plane: 1 if fully inside, -1 if fully
+	// outside, 0 otherwise (or unknown).
+	int classify(const Eigen::Vector2f & min, const Eigen::Vector2f & max) const;
+
+	// Bit i%32 of word i/32 is set if vertex i is inside.
+	void classifyVertices(
+			const MeshVolume::VertexArrays & vertices,
+			const rtabmap::Transform & meshToScene,
+			std::vector<unsigned int> & mask) const;
+	// Several polygons at once: bit k of masks[i] is set if vertex i is
+	// inside crops[k] (at most 32 crops). Vertices are transformed once.
+	static void classifyVertices(
+			const std::vector<const MeshCrop*> & crops,
+			const MeshVolume::VertexArrays & vertices,
+			const rtabmap::Transform & meshToScene,
+			std::vector<unsigned int> & masks);
+
+	// Keep the polygons with all their vertices inside. If the bounds of the
+	// vertices (mesh frame) are provided, the polygons are kept or removed
+	// without classifying the vertices when the bounds are fully inside or
+	// outside. Returns the number of polygons kept. If keptIndices is not
+	// null, it is filled with the original indices of the polygons kept.
+	int crop(
+			const MeshVolume::VertexArrays & vertices,
+			const rtabmap::Transform & meshToScene,
+			std::vector<pcl::Vertices> & polygons,
+			const Eigen::Vector3f * aabbMin = 0,
+			const Eigen::Vector3f * aabbMax = 0,
+			std::vector<int> * keptIndices = 0) const;
+
+	// Bounds of a box (mesh frame) on the scene x/z plane.
+	static void boundsXZ(
+			const Eigen::Vector3f & aabbMin,
+			const Eigen::Vector3f & aabbMax,
+			const rtabmap::Transform & meshToScene,
+			Eigen::Vector2f & min,
+			Eigen::Vector2f & max);
+
+private:
+	void init(int gridSize);
+	bool insideSlow(float x, float z) const;
+	int cellIndex(float x, float z) const;
+
+private:
+	std::vector<Eigen::Vector2f> polygon_;
+	Eigen::Vector2f min_;
+	Eigen::Vector2f max_;
+	int gridSize_;
+	float cellSizeX_;
+	float cellSizeZ_;
+	std::vector<unsigned char> centerInside_; // per cell
+	std::vector<int> cellEdgesStart_;         // per cell + 1, offsets in cellEdges_
+	std::vector<int> cellEdges_;              // edges crossing each cell
+};
+
+// Polygons of a mesh kept by a crop, one bit per polygon (bit i%32 of word
+// i/32), used to store crop results compactly.
+class PolygonMask {
+public:
+	PolygonMask() : size_(0), count_(0) {}
+	// indices: kept polygons (sorted or not) of a mesh with "polygons" polygons
+	PolygonMask(const std::vector<int> & indices, size_t polygons);
+
+	size_t size() const {return size_;}   // polygons of the mesh
+	size_t count() const {return count_;} // polygons kept
+	bool test(size_t i) const {return (bits_[i/32] >> (i%32)) & 1;}
+	// kept polygons in increasing order
+	std::vector<int> indices() const;
+	size_t memoryUsed() const {return bits_.size()*sizeof(unsigned int);}
+
+private:
+	std::vector<unsigned int> bits_;
+	size_t size_;
+	size_t count_;
+};
+
+#endif /* MESH_CROP_H_ */
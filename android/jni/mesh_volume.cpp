@@ -0,0 +1,443 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "mesh_volume.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <Eigen/Geometry>
+
+namespace {
+
+const int kBlockSize = 256; // triangles per vectorized block
+
+typedef Eigen::Array<float, kBlockSize, 1> BlockArray;
+
+// Per-thread scratch buffers for one block of triangles.
+struct TriangleBlock {
+	BlockArray x[3];
+	BlockArray y[3];
+	BlockArray z[3];
+	int count;
+};
+
+// A range of polygons of one input, unit of work for the threads.
+struct WorkUnit {
+	int input;
+	size_t begin;
+	size_t end;
+};
+
+const size_t kPolygonsPerUnit = 16*kBlockSize;
+
+std::vector<WorkUnit> splitInputs(const std::vector<MeshVolume::Input> & inputs)
+{
+	std::vector<WorkUnit> units;
+	for(size_t i=0; i<inputs.size(); ++i)
+	{
+		UASSERT(inputs[i].vertices != 0 && inputs[i].polygons != 0);
+		const size_t polygons = inputs[i].polygons->size();
+		for(size_t j=0; j<polygons; j+=kPolygonsPerUnit)
+		{
+			WorkUnit unit;
+			unit.input = (int)i;
+			unit.begin = j;
+			unit.end = std::min(j+kPolygonsPerUnit, polygons);
+			units.push_back(unit);
+		}
+	}
+	return units;
+}
+
+void accumulateMoments(const TriangleBlock & block, MeshVolume::Moments & moments)
+{
+	const int n = block.count;
+	const BlockArray & x0 = block.x[0];
+	const BlockArray & y0 = block.y[0];
+	const BlockArray & z0 = block.z[0];
+	const BlockArray & x1 = block.x[1];
+	const BlockArray & y1 = block.y[1];
+	const BlockArray & z1 = block.z[1];
+	const BlockArray & x2 = block.x[2];
+	const BlockArray & y2 = block.y[2];
+	const BlockArray & z2 = block.z[2];
+
+	// v1 x v2, det = v0 . (v1 x v2)
+	BlockArray cx12 = y1*z2 - z1*y2;
+	BlockArray cy12 = z1*x2 - x1*z2;
+	BlockArray cz12 = x1*y2 - y1*x2;
+	BlockArray det = x0*cx12 + y0*cy12 + z0*cz12;
+	// v0 x v1 + v1 x v2 + v2 x v0
+	BlockArray cx = cx12 + (y0*z1 - z0*y1) + (y2*z0 - z2*y0);
+	BlockArray cy = cy12 + (z0*x1 - x0*z1) + (z2*x0 - x2*z0);
+	BlockArray cz = cz12 + (x0*y1 - y0*x1) + (x2*y0 - y2*x0);
+
+	moments.det += det.head(n).cast<double>().sum();
+	moments.cross[0] += cx.head(n).cast<double>().sum();
+	moments.cross[1] += cy.head(n).cast<double>().sum();
+	moments.cross[2] += cz.head(n).cast<double>().sum();
+	moments.triangles += n;
+}
+
+void integrateBlock(
+		TriangleBlock & block,
+		const Eigen::Matrix3f & R,
+		const Eigen::Vector3f & t,
+		MeshVolume::Stats & stats,
+		MeshVolume::Moments * moments)
+{
+	const int n = block.count;
+	if(n == 0)
+	{
+		return;
+	}
+
+	// Local moments, before the corners are transformed
+	if(moments)
+	{
+		accumulateMoments(block, *moments);
+	}
+
+	// Transform the corners to scene frame, relative to the reference point
+	for(int k=0; k<3; ++k)
+	{
+		BlockArray lx = block.x[k];
+		BlockArray ly = block.y[k];
+		BlockArray lz = block.z[k];
+		block.x[k] = R(0,0)*lx + R(0,1)*ly + R(0,2)*lz + t[0];
+		block.y[k] = R(1,0)*lx + R(1,1)*ly + R(1,2)*lz + t[1];
+		block.z[k] = R(2,0)*lx + R(2,1)*ly + R(2,2)*lz + t[2];
+	}
+
+	const BlockArray & x0 = block.x[0];
+	const BlockArray & y0 = block.y[0];
+	const BlockArray & z0 = block.z[0];
+	const BlockArray & x1 = block.x[1];
+	const BlockArray & y1 = block.y[1];
+	const BlockArray & z1 = block.z[1];
+	const BlockArray & x2 = block.x[2];
+	const BlockArray & y2 = block.y[2];
+	const BlockArray & z2 = block.z[2];
+
+	// det(v0, v1, v2) = v0 . (v1 x v2)
+	BlockArray det = x0*(y1*z2 - z1*y2) + y0*(z1*x2 - x1*z2) + z0*(x1*y2 - y1*x2);
+
+	// (v1-v0) x (v2-v0)
+	BlockArray ex1 = x1-x0, ey1 = y1-y0, ez1 = z1-z0;
+	BlockArray ex2 = x2-x0, ey2 = y2-y0, ez2 = z2-z0;
+	BlockArray nx = ey1*ez2 - ez1*ey2;
+	BlockArray ny = ez1*ex2 - ex1*ez2;
+	BlockArray nz = ex1*ey2 - ey1*ex2;
+	BlockArray area = (nx*nx + ny*ny + nz*nz).sqrt();
+
+	// ny is the normal component along the up axis: twice the projected area on x/z
+	stats.signedVolume += det.head(n).cast<double>().sum() / 6.0;
+	stats.volume += det.head(n).abs().cast<double>().sum() / 6.0;
+	double blockArea = area.head(n).cast<double>().sum() * 0.5;
+	stats.area += blockArea;
+	if(moments)
+	{
+		moments->area += blockArea;
+	}
+	stats.footprint += ny.head(n).abs().cast<double>().sum() * 0.5;
+	float maxY = y0.head(n).max(y1.head(n)).max(y2.head(n)).maxCoeff();
+	if(stats.triangles == 0 || maxY > stats.maxHeight)
+	{
+		stats.maxHeight = maxY;
+	}
+	stats.triangles += n;
+	block.count = 0;
+}
+
+void integrateUnit(
+		const MeshVolume::Input & input,
+		size_t begin,
+		size_t end,
+		const Eigen::Vector3f & reference,
+		MeshVolume::Stats & stats,
+		MeshVolume::Moments * moments)
+{
+	const MeshVolume::VertexArrays & v = *input.vertices;
+	const std::vector<pcl::Vertices> & polygons = *input.polygons;
+	const float * X = v.x.data();
+	const float * Y = v.y.data();
+	const float * Z = v.z.data();
+	const unsigned int size = (unsigned int)v.size();
+
+	Eigen::Affine3f transform = input.pose.isNull()?Eigen::Affine3f::Identity():input.pose.toEigen3f();
+	Eigen::Matrix3f R = transform.linear();
+	Eigen::Vector3f t = transform.translation() - reference;
+
+	TriangleBlock block;
+	block.count = 0;
+	for(size_t i=begin; i<end; ++i)
+	{
+		const std::vector<uint32_t> & vertices = polygons[i].vertices;
+		// triangle fan for polygons with more than 3 vertices
+		for(size_t j=1; j+1<vertices.size(); ++j)
+		{
+			const uint32_t i0 = vertices[0];
+			const uint32_t i1 = vertices[j];
+			const uint32_t i2 = vertices[j+1];
+			if(i0 >= size || i1 >= size || i2 >= size)
+			{
+				continue;
+			}
+			const int k = block.count++;
+			block.x[0][k] = X[i0]; block.y[0][k] = Y[i0]; block.z[0][k] = Z[i0];
+			block.x[1][k] = X[i1]; block.y[1][k] = Y[i1]; block.z[1][k] = Z[i1];
+			block.x[2][k] = X[i2]; block.y[2][k] = Y[i2]; block.z[2][k] = Z[i2];
+			if(block.count == kBlockSize)
+			{
+				integrateBlock(block, R, t, stats, moments);
+			}
+		}
+	}
+	integrateBlock(block, R, t, stats, moments);
+}
+
+} // namespace
+
+MeshVolume::Stats & MeshVolume::Stats::operator+=(const Stats & s)
+{
+	if(s.triangles)
+	{
+		maxHeight = triangles?std::max(maxHeight, s.maxHeight):s.maxHeight;
+	}
+	volume += s.volume;
+	signedVolume += s.signedVolume;
+	area += s.area;
+	footprint += s.footprint;
+	triangles += s.triangles;
+	return *this;
+}
+
+MeshVolume::Moments & MeshVolume::Moments::operator+=(const Moments & m)
+{
+	det += m.det;
+	cross += m.cross;
+	area += m.area;
+	triangles += m.triangles;
+	return *this;
+}
+
+double MeshVolume::Moments::signedVolume(const rtabmap::Transform & meshToScene, const Eigen::Vector3f & reference) const
+{
+	return signedVolume(meshToScene.isNull()?Eigen::Affine3d::Identity():meshToScene.toEigen3d(), reference.cast<double>());
+}
+
+double MeshVolume::Moments::signedVolume(const Eigen::Affine3d & meshToScene, const Eigen::Vector3d & reference) const
+{
+	// w = R*v + t, det(w0-c, w1-c, w2-c) = det(v0+s, v1+s, v2+s) with s = R^T*(t-c)
+	Eigen::Vector3d s = meshToScene.linear().transpose() * (meshToScene.translation() - reference);
+	return (det + s.dot(cross)) / 6.0;
+}
+
+MeshVolume::VertexArrays::VertexArrays(const pcl::PointCloud<pcl::PointXYZRGB> & cloud)
+{
+	x.resize(cloud.size());
+	y.resize(cloud.size());
+	z.resize(cloud.size());
+	for(size_t i=0; i<cloud.size(); ++i)
+	{
+		const pcl::PointXYZRGB & pt = cloud.points[i];
+		x[i] = pt.x;
+		y[i] = pt.y;
+		z[i] = pt.z;
+	}
+}
+
+MeshVolume::VertexArrays::VertexArrays(const pcl::PCLPointCloud2 & cloud)
+{
+	int offsets[3] = {-1, -1, -1};
+	const char * names[3] = {"x", "y", "z"};
+	for(size_t i=0; i<cloud.fields.size(); ++i)
+	{
+		for(int j=0; j<3; ++j)
+		{
+			if(cloud.fields[i].name.compare(names[j]) == 0 &&
+			   cloud.fields[i].datatype == pcl::PCLPointField::FLOAT32)
+			{
+				offsets[j] = cloud.fields[i].offset;
+			}
+		}
+	}
+	if(offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0)
+	{
+		UERROR("Cloud doesn't have float x/y/z fields!");
+		return;
+	}
+
+	UASSERT(cloud.data.size() >= (size_t)cloud.height * cloud.row_step);
+	size_t size = (size_t)cloud.width * cloud.height;
+	x.resize(size);
+	y.resize(size);
+	z.resize(size);
+	size_t i = 0;
+	for(uint32_t r=0; r<cloud.height; ++r)
+	{
+		const uint8_t * pt = cloud.data.data() + r*cloud.row_step;
+		for(uint32_t c=0; c<cloud.width; ++c, ++i, pt+=cloud.point_step)
+		{
+			memcpy(&x[i], pt + offsets[0], sizeof(float));
+			memcpy(&y[i], pt + offsets[1], sizeof(float));
+			memcpy(&z[i], pt + offsets[2], sizeof(float));
+		}
+	}
+}
+
+rtabmap::Transform MeshVolume::meshToScene(const rtabmap::Mesh & mesh, const rtabmap::Transform & drawablePose)
+{
+	if(!drawablePose.isNull() && !mesh.pose.isNull())
+	{
+		return drawablePose * mesh.pose;
+	}
+	else if(!mesh.pose.isNull())
+	{
+		return mesh.pose;
+	}
+	return rtabmap::Transform::getIdentity();
+}
+
+MeshVolume::Stats MeshVolume::compute(
+		const std::vector<Input> & inputs,
+		const Eigen::Vector3f & reference,
+		std::vector<Moments> * moments)
+{
+	std::vector<WorkUnit> units = splitInputs(inputs);
+
+	std::vector<Stats> results(units.size());
+	std::vector<Moments> unitMoments(moments?units.size():0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int i=0; i<(int)units.size(); ++i)
+	{
+		integrateUnit(inputs[units[i].input], units[i].begin, units[i].end, reference, results[i], moments?&unitMoments[i]:0);
+	}
+
+	// Deterministic reduction order
+	Stats stats;
+	for(size_t i=0; i<results.size(); ++i)
+	{
+		stats += results[i];
+	}
+	if(moments)
+	{
+		moments->assign(inputs.size(), Moments());
+		for(size_t i=0; i<unitMoments.size(); ++i)
+		{
+			moments->at(units[i].input) += unitMoments[i];
+		}
+	}
+	return stats;
+}
+
+std::vector<MeshVolume::Stats> MeshVolume::compute(
+		const std::vector<Input> & inputs,
+		const std::vector<int> & groups,
+		const std::vector<Eigen::Vector3f> & references,
+		std::vector<Moments> * moments)
+{
+	UASSERT(inputs.size() == groups.size());
+	for(size_t i=0; i<groups.size(); ++i)
+	{
+		UASSERT(groups[i] >= 0 && groups[i] < (int)references.size());
+	}
+	std::vector<WorkUnit> units = splitInputs(inputs);
+
+	std::vector<Stats> results(units.size());
+	std::vector<Moments> unitMoments(moments?units.size():0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int i=0; i<(int)units.size(); ++i)
+	{
+		integrateUnit(inputs[units[i].input], units[i].begin, units[i].end, references[groups[units[i].input]], results[i], moments?&unitMoments[i]:0);
+	}
+
+	// Deterministic reduction order
+	std::vector<Stats> stats(references.size());
+	for(size_t i=0; i<results.size(); ++i)
+	{
+		stats[groups[units[i].input]] += results[i];
+	}
+	if(moments)
+	{
+		moments->assign(inputs.size(), Moments());
+		for(size_t i=0; i<unitMoments.size(); ++i)
+		{
+			moments->at(units[i].input) += unitMoments[i];
+		}
+	}
+	return stats;
+}
+
+MeshVolume::Stats MeshVolume::compute(
+		const rtabmap::Mesh & mesh,
+		const rtabmap::Transform & drawablePose,
+		const Eigen::Vector3f & reference)
+{
+	if(mesh.cloud.get() == 0 || mesh.cloud->empty() || mesh.polygons.empty())
+	{
+		return Stats();
+	}
+	VertexArrays vertices(*mesh.cloud);
+	std::vector<Input> inputs(1, Input(&vertices, &mesh.polygons.get(), meshToScene(mesh, drawablePose)));
+	return compute(inputs, reference);
+}
+
+MeshVolume::Stats MeshVolume::compute(const pcl::TextureMesh & mesh)
+{
+	VertexArrays vertices(mesh.cloud);
+	if(vertices.size() == 0 || mesh.tex_polygons.empty())
+	{
+		return Stats();
+	}
+
+	Eigen::Array3f minPt = Eigen::Array3f::Constant(std::numeric_limits<float>::max());
+	Eigen::Array3f maxPt = Eigen::Array3f::Constant(std::numeric_limits<float>::lowest());
+	for(size_t i=0; i<vertices.size(); ++i)
+	{
+		Eigen::Array3f v(vertices.x[i], vertices.y[i], vertices.z[i]);
+		minPt = minPt.min(v);
+		maxPt = maxPt.max(v);
+	}
+
+	std::vector<Input> inputs;
+	inputs.reserve(mesh.tex_polygons.size());
+	for(size_t i=0; i<mesh.tex_polygons.size(); ++i)
+	{
+		if(!mesh.tex_polygons[i].empty())
+		{
+			inputs.push_back(Input(&vertices, &mesh.tex_polygons[i], rtabmap::Transform::getIdentity()));
+		}
+	}
+	return compute(inputs, ((minPt + maxPt) * 0.5f).matrix());
+}
@@ -0,0 +1,141 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MESH_VOLUME_H_
+#define MESH_VOLUME_H_
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/Vertices.h>
+#include <pcl/PCLPointCloud2.h>
+#include <pcl/TextureMesh.h>
+#include <rtabmap/core/Transform.h>
+#include "util.h"
+
+// Surface-integral volume kernel. Vertex positions are read as packed
+// structure-of-arrays floats, the mesh-to-scene transform is applied inside
+// the triangle loop and triangles are processed in fixed-size blocks with
+// Eigen array expressions so that the tetra determinants are vectorized
+// (NEON/SSE/AVX depending on the target). Blocks of all meshes are
+// distributed over OpenMP threads when available.
+class MeshVolume {
+public:
+	struct Stats {
+		Stats() :
+			volume(0.0),
+			signedVolume(0.0),
+			area(0.0),
+			footprint(0.0),
+			maxHeight(0.0f),
+			triangles(0)
+		{}
+		Stats & operator+=(const Stats & s);
+
+		double volume;       // sum of |tetra| with the reference point as apex (m^3)
+		double signedVolume; // sum of signed tetras (m^3)
+		double area;         // surface area (m^2)
+		double footprint;    // area projected on the ground plane x/z (m^2)
+		float maxHeight;     // highest vertex above the reference point, along y (m)
+		int triangles;
+	};
+
+	// Surface moments of a mesh in its local frame. The signed tetra sum with
+	// respect to a reference point c is affine in c:
+	//   det(v0-c, v1-c, v2-c) = det(v0, v1, v2) - c.(v0 x v1 + v1 x v2 + v2 x v0)
+	// so the signed volume of the mesh can be re-evaluated for any pose and
+	// reference in O(1) without touching the triangles.
+	struct Moments {
+		Moments() :
+			det(0.0),
+			cross(Eigen::Vector3d::Zero()),
+			area(0.0),
+			triangles(0)
+		{}
+		Moments & operator+=(const Moments & m);
+		double signedVolume(const rtabmap::Transform & meshToScene, const Eigen::Vector3f & reference) const;
+		double signedVolume(const Eigen::Affine3d & meshToScene, const Eigen::Vector3d & reference) const;
+
+		double det;            // sum of det(v0, v1, v2)
+		Eigen::Vector3d cross; // sum of v0 x v1 + v1 x v2 + v2 x v0
+		double area;           // surface area (m^2), invariant to pose
+		int triangles;
+	};
+
+	// Positions of a cloud as separate x/y/z arrays (mesh local frame).
+	struct VertexArrays {
+		VertexArrays() {}
+		explicit VertexArrays(const pcl::PointCloud<pcl::PointXYZRGB> & cloud);
+		// Copies the x/y/z float fields, whatever the other fields are.
+		explicit VertexArrays(const pcl::PCLPointCloud2 & cloud);
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		size_t size() const {return x.size();}
+	};
+
+	struct Input {
+		Input() : vertices(0), polygons(0) {}
+		Input(const VertexArrays * vertices, const std::vector<pcl::Vertices> * polygons, const rtabmap::Transform & pose) :
+			vertices(vertices), polygons(polygons), pose(pose) {}
+		const VertexArrays * vertices;
+		const std::vector<pcl::Vertices> * polygons;
+		rtabmap::Transform pose; // mesh to scene
+	};
+
+	// Mesh to scene transform: drawablePose * mesh.pose (either can be null).
+	static rtabmap::Transform meshToScene(const rtabmap::Mesh & mesh, const rtabmap::Transform & drawablePose);
+
+	// If moments is not null, it is filled with the local moments of each input (same order).
+	static Stats compute(
+			const std::vector<Input> & inputs,
+			const Eigen::Vector3f & reference,
+			std::vector<Moments> * moments = 0);
+	// Batched evaluation: input i is integrated with respect to
+	// references[groups[i]], the stats of each group are returned. All
+	// groups are distributed in the same parallel pass. If moments is not
+	// null, it is filled with the local moments of each input.
+	static std::vector<Stats> compute(
+			const std::vector<Input> & inputs,
+			const std::vector<int> & groups,
+			const std::vector<Eigen::Vector3f> & references,
+			std::vector<Moments> * moments = 0);
+	static Stats compute(
+			const rtabmap::Mesh & mesh,
+			const rtabmap::Transform & drawablePose,
+			const Eigen::Vector3f & reference);
+	// Volume of a mesh with several materials (e.g., the optimized mesh),
+	// all tex_polygons are integrated in the same parallel pass in the mesh
+	// frame. The reference is the center of the vertex bounds: for a closed
+	// mesh, signedVolume is then the exact enclosed volume (its sign follows
+	// the winding) and does not depend on the reference.
+	static Stats compute(const pcl::TextureMesh & mesh);
+};
+
+#endif /* MESH_VOLUME_H_ */
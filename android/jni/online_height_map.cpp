@@ -0,0 +1,318 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "online_height_map.h"
+
+#include <rtabmap/core/util3d.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UThread.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const float kMaxWeight = 100.0f; // running mean becomes a moving average after this number of points
+const long long kMaxRoiCells = 4096*4096;
+
+} // namespace
+
+OnlineHeightMap::OnlineHeightMap() :
+		thread_(0),
+		stop_(false),
+		resetRequested_(false),
+		pending_(0),
+		roiRevision_(0),
+		cellSize_(0.05f),
+		minObservations_(3),
+		frames_(0)
+{
+}
+
+OnlineHeightMap::~OnlineHeightMap()
+{
+	stop();
+}
+
+bool OnlineHeightMap::start(float cellSize, int minObservations)
+{
+	if(!(cellSize > 0.0f)) // NaN too
+	{
+		UWARN("Online height map: cell size (%f m) should be > 0.", cellSize);
+		return false;
+	}
+	stop();
+	cellSize_ = cellSize;
+	minObservations_ = std::max(1, minObservations);
+	frames_ = 0;
+	tiles_.clear();
+	resetRequested_ = false;
+	stop_ = false;
+	LOGI("Online height map started (cell=%f m)", cellSize_);
+	thread_ = new boost::thread(&OnlineHeightMap::mainLoop, this);
+	return true;
+}
+
+void OnlineHeightMap::stop()
+{
+	if(thread_)
+	{
+		stop_ = true;
+		thread_->join();
+		delete thread_;
+		thread_ = 0;
+		LOGI("Online height map stopped (frames=%d, tiles=%d)", frames_, (int)tiles_.size());
+	}
+	delete pending_.exchange(0);
+	tiles_.clear();
+}
+
+void OnlineHeightMap::addFrame(const rtabmap::SensorData & data, const rtabmap::Transform & pose, int decimation, float minDepth, float maxDepth)
+{
+	if(pose.isNull() || data.depthRaw().empty() || data.cameraModels().empty())
+	{
+		return;
+	}
+	// The frame shares the images (cv::Mat), replace the pending one
+	Frame * frame = new Frame;
+	frame->data = data;
+	frame->pose = pose;
+	frame->decimation = std::max(1, decimation);
+	frame->minDepth = minDepth;
+	frame->maxDepth = maxDepth;
+	delete pending_.exchange(frame);
+}
+
+void OnlineHeightMap::setRoi(const std::vector<Eigen::Vector3f> & polygon, const Eigen::Vector3f * plane)
+{
+	Roi roi;
+	roi.revision = ++roiRevision_;
+	if(polygon.size() >= 3)
+	{
+		roi.polygon.resize(polygon.size());
+		for(size_t i=0; i<polygon.size(); ++i)
+		{
+			roi.polygon[i] = Eigen::Vector2f(polygon[i][0], polygon[i][2]);
+		}
+		roi.plane = plane?*plane:HeightMap::fitPlane(polygon);
+	}
+	roiBuffer_.write(roi);
+}
+
+bool OnlineHeightMap::estimate(Estimate & estimate)
+{
+	return estimateBuffer_.read(estimate);
+}
+
+void OnlineHeightMap::mainLoop()
+{
+	Roi roi;
+	bool dirty = true;
+	while(!stop_)
+	{
+		if(resetRequested_.exchange(false))
+		{
+			tiles_.clear();
+			frames_ = 0;
+			dirty = true;
+		}
+
+		Frame * frame = pending_.exchange(0);
+		if(frame)
+		{
+			integrate(*frame);
+			delete frame;
+			++frames_;
+			dirty = true;
+		}
+
+		if(roiBuffer_.read(roi))
+		{
+			dirty = true;
+		}
+
+		if(dirty)
+		{
+			UTimer time;
+			Estimate estimate;
+			estimate.frames = frames_;
+			estimate.roiRevision = roi.revision;
+			if(roi.polygon.size() >= 3)
+			{
+				estimate.stats = volume(roi, &estimate.volumeError);
+			}
+			estimateBuffer_.write(estimate);
+			dirty = false;
+			LOGD("Online height map: volume=%f m^3 (+-%f), cells=%d, frames=%d, tiles=%d (%fs)",
+					estimate.stats.volume, estimate.volumeError, estimate.stats.cells, frames_, (int)tiles_.size(), time.ticks());
+		}
+		else if(!frame)
+		{
+			uSleep(10);
+		}
+	}
+}
+
+void OnlineHeightMap::integrate(const Frame & frame)
+{
+	// Same unprojection than util3d::cloudRGBFromSensorData(), without colors
+	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = rtabmap::util3d::cloudFromSensorData(
+			frame.data, frame.decimation, frame.maxDepth, frame.minDepth);
+	const Eigen::Affine3f t = frame.pose.toEigen3f();
+	const float invCellSize = 1.0f / cellSize_;
+	for(size_t i=0; i<cloud->size(); ++i)
+	{
+		const pcl::PointXYZ & pt = cloud->at(i);
+		if(!std::isfinite(pt.x) || !std::isfinite(pt.y) || !std::isfinite(pt.z))
+		{
+			continue;
+		}
+		Eigen::Vector3f p = t * pt.getVector3fMap();
+		Cell & c = cellRef((int)std::floor(p[0]*invCellSize), (int)std::floor(p[2]*invCellSize));
+
+		// Welford update of the height, the weight is capped so that the
+		// cell follows changes of the surface.
+		const float y = p[1];
+		if(c.count < kMaxWeight)
+		{
+			c.count += 1.0f;
+		}
+		else
+		{
+			c.m2 *= (c.count - 1.0f) / c.count;
+		}
+		const float delta = y - c.mean;
+		c.mean += delta / c.count;
+		c.m2 += delta * (y - c.mean);
+	}
+}
+
+HeightMap::Stats OnlineHeightMap::volume(const Roi & roi, double * volumeError) const
+{
+	HeightMap::Stats stats;
+	if(roi.polygon.size() < 3)
+	{
+		return stats;
+	}
+
+	Eigen::Vector2f min = roi.polygon[0];
+	Eigen::Vector2f max = roi.polygon[0];
+	for(size_t i=1; i<roi.polygon.size(); ++i)
+	{
+		min = min.cwiseMin(roi.polygon[i]);
+		max = max.cwiseMax(roi.polygon[i]);
+	}
+	const float cellSize = cellSize_;
+	const int rowMin = (int)std::floor(min[1]/cellSize);
+	const int rowMax = (int)std::floor(max[1]/cellSize);
+	const int colMin = (int)std::floor(min[0]/cellSize);
+	const int colMax = (int)std::floor(max[0]/cellSize);
+	if((long long)(rowMax-rowMin+1) * (long long)(colMax-colMin+1) > kMaxRoiCells)
+	{
+		UWARN("ROI too large for the online height map (%dx%d cells)", colMax-colMin+1, rowMax-rowMin+1);
+		return stats;
+	}
+
+	const double cellArea = double(cellSize)*double(cellSize);
+	const Eigen::Vector3f & plane = roi.plane;
+	double variance = 0.0;
+	std::vector<float> crossings;
+	for(int row=rowMin; row<=rowMax; ++row)
+	{
+		// Cells with their center inside the polygon (even-odd rule)
+		const float z = (float(row)+0.5f)*cellSize;
+		crossings.clear();
+		for(size_t i=0; i<roi.polygon.size(); ++i)
+		{
+			const Eigen::Vector2f & a = roi.polygon[i];
+			const Eigen::Vector2f & b = roi.polygon[(i+1)%roi.polygon.size()];
+			if((a[1] <= z) != (b[1] <= z))
+			{
+				crossings.push_back(a[0] + (z-a[1])*(b[0]-a[0])/(b[1]-a[1]));
+			}
+		}
+		std::sort(crossings.begin(), crossings.end());
+		for(size_t i=0; i+1<crossings.size(); i+=2)
+		{
+			const int colStart = (int)std::ceil(crossings[i]/cellSize - 0.5f);
+			const int colEnd = (int)std::floor(crossings[i+1]/cellSize - 0.5f);
+			for(int col=colStart; col<=colEnd; ++col)
+			{
+				const Cell * c = cell(col, row);
+				if(c == 0 || c->count < float(minObservations_))
+				{
+					continue;
+				}
+				const float x = (float(col)+0.5f)*cellSize;
+				const float h = c->mean - (plane[0]*x + plane[1]*z + plane[2]);
+				if(h > 0.0f)
+				{
+					stats.volume += double(h)*cellArea;
+				}
+				else
+				{
+					stats.volumeBelow -= double(h)*cellArea;
+				}
+				stats.maxHeight = std::max(stats.maxHeight, h);
+				stats.footprint += cellArea;
+				++stats.cells;
+				// variance of the mean height of the cell
+				variance += double(c->m2) / (double(c->count) * double(c->count));
+			}
+		}
+	}
+	stats.netVolume = stats.volume - stats.volumeBelow;
+	if(volumeError)
+	{
+		*volumeError = std::sqrt(variance)*cellArea;
+	}
+	return stats;
+}
+
+const OnlineHeightMap::Cell * OnlineHeightMap::cell(int col, int row) const
+{
+	const int mask = (1<<kTileBits)-1;
+	std::unordered_map<long long, std::vector<Cell> >::const_iterator iter = tiles_.find(tileKey(col>>kTileBits, row>>kTileBits));
+	if(iter == tiles_.end())
+	{
+		return 0;
+	}
+	return &iter->second[((row & mask) << kTileBits) + (col & mask)];
+}
+
+OnlineHeightMap::Cell & OnlineHeightMap::cellRef(int col, int row)
+{
+	const int mask = (1<<kTileBits)-1;
+	std::vector<Cell> & tile = tiles_[tileKey(col>>kTileBits, row>>kTileBits)];
+	if(tile.empty())
+	{
+		tile.resize(1<<(2*kTileBits));
+	}
+	return tile[((row & mask) << kTileBits) + (col & mask)];
+}
@@ -0,0 +1,165 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef ONLINE_HEIGHT_MAP_H_
+#define ONLINE_HEIGHT_MAP_H_
+
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include <boost/thread/thread.hpp>
+#include <Eigen/Core>
+#include <rtabmap/core/SensorData.h>
+#include <rtabmap/core/Transform.h>
+#include "height_map.h"
+
+// Single-producer/single-consumer triple buffer: write() and read() never
+// block and always exchange the latest complete value.
+template<typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : writeIndex_(0), middle_(1), readIndex_(2) {}
+
+	// Writer side only
+	void write(const T & value)
+	{
+		buffers_[writeIndex_] = value;
+		writeIndex_ = middle_.exchange(writeIndex_ | kDirty) & kIndex;
+	}
+	// Reader side only. Returns true if the value changed since the last read.
+	bool read(T & value)
+	{
+		bool updated = false;
+		if(middle_.load() & kDirty)
+		{
+			readIndex_ = middle_.exchange(readIndex_) & kIndex;
+			updated = true;
+		}
+		value = buffers_[readIndex_];
+		return updated;
+	}
+
+private:
+	static const int kIndex = 3;
+	static const int kDirty = 4;
+	T buffers_[3];
+	int writeIndex_;
+	std::atomic<int> middle_;
+	int readIndex_;
+};
+
+// Height map (DEM) accumulated directly from the depth frames while scanning,
+// without meshing. Each depth frame is unprojected with the camera models of
+// the sensor data (like util3d::cloudRGBFromSensorData) and the points are
+// binned on the scene x/z plane, each cell keeping running statistics of
+// the height (mean and variance). Cells are stored in square tiles created
+// on demand, so the grid follows the scanned area.
+//
+// The integration runs on its own thread. The OpenGL thread only exchanges
+// data through atomics: addFrame() replaces the pending frame (older frames
+// are dropped), setRoi() and estimate() go through triple buffers, so the
+// rendering never waits on the integration.
+class OnlineHeightMap {
+public:
+	struct Estimate {
+		Estimate() : volumeError(0.0), frames(0), roiRevision(0) {}
+		HeightMap::Stats stats; // volume of the cells inside the roi
+		double volumeError;     // standard error of the volume from the cell height variances (m^3)
+		int frames;             // integrated frames
+		int roiRevision;        // roi used for the stats
+	};
+
+public:
+	OnlineHeightMap();
+	~OnlineHeightMap();
+
+	// start() and stop() should be called from the same thread. Returns
+	// false (and keeps the current state) if cellSize is not > 0.
+	bool start(float cellSize = 0.05f, int minObservations = 3);
+	void stop();
+	bool isRunning() const {return thread_ != 0;}
+
+	// Non-blocking, pose is the sensor data base frame in scene frame (OpenGL world).
+	void addFrame(const rtabmap::SensorData & data, const rtabmap::Transform & pose, int decimation, float minDepth, float maxDepth);
+	// Non-blocking, clear the grid before the next frame.
+	void reset() {resetRequested_ = true;}
+
+	// Non-blocking, polygon of the roi in scene frame. The reference plane
+	// (a, b, c) is the ground plane if set, otherwise it is fitted on the
+	// polygon vertices (see HeightMap::fitPlane()). An empty polygon
+	// disables the estimate.
+	void setRoi(const std::vector<Eigen::Vector3f> & polygon, const Eigen::Vector3f * plane = 0);
+	// Non-blocking, latest estimate. Returns true if it changed since the last call.
+	bool estimate(Estimate & estimate);
+
+private:
+	struct Frame {
+		rtabmap::SensorData data;
+		rtabmap::Transform pose;
+		int decimation;
+		float minDepth;
+		float maxDepth;
+	};
+	struct Roi {
+		Roi() : revision(0), plane(Eigen::Vector3f::Zero()) {}
+		int revision;
+		std::vector<Eigen::Vector2f> polygon; // x/z
+		Eigen::Vector3f plane;
+	};
+	struct Cell {
+		Cell() : count(0), mean(0.0f), m2(0.0f) {}
+		float count;
+		float mean;
+		float m2;
+	};
+	static const int kTileBits = 5; // 32x32 cells
+
+	void mainLoop();
+	void integrate(const Frame & frame);
+	HeightMap::Stats volume(const Roi & roi, double * volumeError = 0) const;
+	const Cell * cell(int col, int row) const;
+	Cell & cellRef(int col, int row);
+	static long long tileKey(int tileCol, int tileRow) {return ((long long)tileCol << 32) | (unsigned int)tileRow;}
+
+private:
+	boost::thread * thread_;
+	std::atomic<bool> stop_;
+	std::atomic<bool> resetRequested_;
+	std::atomic<Frame*> pending_;
+	TripleBuffer<Roi> roiBuffer_;
+	TripleBuffer<Estimate> estimateBuffer_;
+	int roiRevision_; // OpenGL thread
+
+	// Worker thread
+	float cellSize_;
+	int minObservations_;
+	int frames_;
+	std::unordered_map<long long, std::vector<Cell> > tiles_;
+};
+
+#endif /* ONLINE_HEIGHT_MAP_H_ */
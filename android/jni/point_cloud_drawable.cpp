@@ -56,9 +56,51 @@ enum PointCloudShaders
     kTextureLighting = 6,
     kTextureLightingBlending = 7,
 
-    kDepthPacking = 8
+    kDepthPacking = 8,
+
+    kCropPreview = 9 // offset of the crop preview variants of the shaders above
 };
 
+// Crop preview: the shaders compiled with CROP_PREVIEW discard the fragments
+// outside the marker polygon (scene x/z plane, even-odd rule), so the crop
+// can be previewed without updating the buffers.
+#define CROP_PREVIEW_MAX_SIZE_STR "32" // PointCloudDrawable::kMaxCropPolygonSize
+#define CROP_PREVIEW_VERTEX_DECL \
+    "#ifdef CROP_PREVIEW\n" \
+    "uniform mat4 uModel;\n" \
+    "varying vec2 vCropXZ;\n" \
+    "#endif\n"
+#define CROP_PREVIEW_VERTEX_MAIN \
+    "#ifdef CROP_PREVIEW\n" \
+    "  vCropXZ = (uModel*vec4(aVertex.x, aVertex.y, aVertex.z, 1.0)).xz;\n" \
+    "#endif\n"
+#define CROP_PREVIEW_FRAGMENT_DECL \
+    "#ifdef CROP_PREVIEW\n" \
+    "uniform vec2 uCropPolygon[" CROP_PREVIEW_MAX_SIZE_STR "];\n" \
+    "uniform int uCropPolygonSize;\n" \
+    "varying vec2 vCropXZ;\n" \
+    "bool cropEdgeCrossed(vec2 p, vec2 a, vec2 b) {\n" \
+    "  return (a.y > p.y) != (b.y > p.y) && p.x < (b.x-a.x)*(p.y-a.y)/(b.y-a.y)+a.x;\n" \
+    "}\n" \
+    "bool insideCropPolygon(vec2 p) {\n" \
+    "  bool inside = false;\n" \
+    "  vec2 first = uCropPolygon[0];\n" \
+    "  vec2 previous = first;\n" \
+    "  for(int i=1; i<" CROP_PREVIEW_MAX_SIZE_STR "; ++i) {\n" \
+    "    if(i >= uCropPolygonSize) break;\n" \
+    "    vec2 current = uCropPolygon[i];\n" \
+    "    if(cropEdgeCrossed(p, previous, current)) inside = !inside;\n" \
+    "    previous = current;\n" \
+    "  }\n" \
+    "  if(cropEdgeCrossed(p, previous, first)) inside = !inside;\n" \
+    "  return inside;\n" \
+    "}\n" \
+    "#endif\n"
+#define CROP_PREVIEW_FRAGMENT_MAIN \
+    "#ifdef CROP_PREVIEW\n" \
+    "  if(!insideCropPolygon(vCropXZ)) discard;\n" \
+    "#endif\n"
+
 // PointCloud shaders
 const std::string kPointCloudVertexShader =
     "precision highp float;\n"
@@ -67,6 +109,7 @@ const std::string kPointCloudVertexShader =
     "attribute vec3 aColor;\n"
 
     "uniform mat4 uMVP;\n"
+    CROP_PREVIEW_VERTEX_DECL
     "uniform float uPointSize;\n"
 
     "varying vec3 vColor;\n"
@@ -74,6 +117,7 @@ const std::string kPointCloudVertexShader =
 
     "void main() {\n"
     "  gl_Position = uMVP*vec4(aVertex.x, aVertex.y, aVertex.z, 1.0);\n"
+    CROP_PREVIEW_VERTEX_MAIN
     "  gl_PointSize = uPointSize;\n"
     "  vLightWeighting = 1.0;\n"
     "  vColor = aColor;\n"
@@ -86,6 +130,7 @@ const std::string kPointCloudLightingVertexShader =
     "attribute vec3 aColor;\n"
 
     "uniform mat4 uMVP;\n"
+    CROP_PREVIEW_VERTEX_DECL
     "uniform mat3 uN;\n"
     "uniform vec3 uLightingDirection;\n"
     "uniform float uPointSize;\n"
@@ -95,6 +140,7 @@ const std::string kPointCloudLightingVertexShader =
 
     "void main() {\n"
     "  gl_Position = uMVP*vec4(aVertex.x, aVertex.y, aVertex.z, 1.0);\n"
+    CROP_PREVIEW_VERTEX_MAIN
     "  gl_PointSize = uPointSize;\n"
     "  vec3 transformedNormal = uN * aNormal;\n"
     "  vLightWeighting = max(dot(transformedNormal, uLightingDirection)*0.5+0.5, 0.0);\n"
@@ -111,7 +157,9 @@ const std::string kPointCloudFragmentShader =
     "uniform float uGainB;\n"
     "varying vec3 vColor;\n"
     "varying float vLightWeighting;\n"
+    CROP_PREVIEW_FRAGMENT_DECL
     "void main() {\n"
+    CROP_PREVIEW_FRAGMENT_MAIN
     "  vec4 textureColor = vec4(vColor.z, vColor.y, vColor.x, 1.0);\n"
     "  gl_FragColor = vec4(textureColor.r * uGainR * vLightWeighting, textureColor.g * uGainG * vLightWeighting, textureColor.b * uGainB * vLightWeighting, textureColor.a);\n"
     "}\n";
@@ -127,7 +175,9 @@ const std::string kPointCloudBlendingFragmentShader =
     "uniform vec2 uScreenScale;\n"
     "varying vec3 vColor;\n"
     "varying float vLightWeighting;\n"
+    CROP_PREVIEW_FRAGMENT_DECL
     "void main() {\n"
+    CROP_PREVIEW_FRAGMENT_MAIN
     "  vec4 textureColor = vec4(vColor.z, vColor.y, vColor.x, 1.0);\n"
     "  float alpha = 1.0;\n"
     "  vec2 coord = uScreenScale * gl_FragCoord.xy;\n;"
@@ -150,15 +200,19 @@ const std::string kPointCloudDepthPackingVertexShader =
     "precision mediump int;\n"
     "attribute vec3 aVertex;\n"
     "uniform mat4 uMVP;\n"
+    CROP_PREVIEW_VERTEX_DECL
     "uniform float uPointSize;\n"
     "void main() {\n"
     "  gl_Position = uMVP*vec4(aVertex.x, aVertex.y, aVertex.z, 1.0);\n"
+    CROP_PREVIEW_VERTEX_MAIN
     "  gl_PointSize = uPointSize;\n"
     "}\n";
 const std::string kPointCloudDepthPackingFragmentShader =
     "precision highp float;\n"
     "precision mediump int;\n"
+    CROP_PREVIEW_FRAGMENT_DECL
     "void main() {\n"
+    CROP_PREVIEW_FRAGMENT_MAIN
     "  vec4 enc = vec4(1.,255.,65025.,16581375.) * gl_FragCoord.z;\n"
     "  enc = fract(enc);\n"
     "  enc -= enc.yzww * vec2(1./255., 0.).xxxy;\n"
@@ -173,12 +227,14 @@ const std::string kTextureMeshVertexShader =
     "attribute vec2 aTexCoord;\n"
 
     "uniform mat4 uMVP;\n"
+    CROP_PREVIEW_VERTEX_DECL
 
     "varying vec2 vTexCoord;\n"
     "varying float vLightWeighting;\n"
 
     "void main() {\n"
     "  gl_Position = uMVP*vec4(aVertex.x, aVertex.y, aVertex.z, 1.0);\n"
+    CROP_PREVIEW_VERTEX_MAIN
 
     "  if(aTexCoord.x < 0.0) {\n"
     "    vTexCoord.x = 1.0;\n"
@@ -197,6 +253,7 @@ const std::string kTextureMeshLightingVertexShader =
     "attribute vec2 aTexCoord;\n"
 
     "uniform mat4 uMVP;\n"
+    CROP_PREVIEW_VERTEX_DECL
     "uniform mat3 uN;\n"
     "uniform vec3 uLightingDirection;\n"
 
@@ -205,6 +262,7 @@ const std::string kTextureMeshLightingVertexShader =
 
     "void main() {\n"
     "  gl_Position = uMVP*vec4(aVertex.x, aVertex.y, aVertex.z, 1.0);\n"
+    CROP_PREVIEW_VERTEX_MAIN
 
     "  if(aTexCoord.x < 0.0) {\n"
     "    vTexCoord.x = 1.0;\n"
@@ -228,7 +286,9 @@ const std::string kTextureMeshFragmentShader =
     "varying vec2 vTexCoord;\n"
     "varying float vLightWeighting;\n"
     ""
+    CROP_PREVIEW_FRAGMENT_DECL
     "void main() {\n"
+    CROP_PREVIEW_FRAGMENT_MAIN
     "  vec4 textureColor = texture2D(uTexture, vTexCoord);\n"
     "  gl_FragColor = vec4(textureColor.r * uGainR * vLightWeighting, textureColor.g * uGainG * vLightWeighting, textureColor.b * uGainB * vLightWeighting, textureColor.a);\n"
     "}\n";
@@ -246,7 +306,9 @@ const std::string kTextureMeshBlendingFragmentShader =
     "varying vec2 vTexCoord;\n"
     "varying float vLightWeighting;\n"
     ""
+    CROP_PREVIEW_FRAGMENT_DECL
     "void main() {\n"
+    CROP_PREVIEW_FRAGMENT_MAIN
     "  vec4 textureColor = texture2D(uTexture, vTexCoord);\n"
     "  float alpha = 1.0;\n"
     "  vec2 coord = uScreenScale * gl_FragCoord.xy;\n;"
@@ -270,28 +332,29 @@ void PointCloudDrawable::createShaderPrograms()
 {
     if(shaderPrograms_.empty())
     {
-        shaderPrograms_.resize(9);
-
-        shaderPrograms_[kPointCloud] = tango_gl::util::CreateProgram(kPointCloudVertexShader.c_str(), kPointCloudFragmentShader.c_str());
-        UASSERT(shaderPrograms_[kPointCloud] != 0);
-        shaderPrograms_[kPointCloudBlending] = tango_gl::util::CreateProgram(kPointCloudVertexShader.c_str(), kPointCloudBlendingFragmentShader.c_str());
-        UASSERT(shaderPrograms_[kPointCloudBlending] != 0);
-        shaderPrograms_[kPointCloudLighting] = tango_gl::util::CreateProgram(kPointCloudLightingVertexShader.c_str(), kPointCloudFragmentShader.c_str());
-        UASSERT(shaderPrograms_[kPointCloudLighting] != 0);
-        shaderPrograms_[kPointCloudLightingBlending] = tango_gl::util::CreateProgram(kPointCloudLightingVertexShader.c_str(), kPointCloudBlendingFragmentShader.c_str());
-        UASSERT(shaderPrograms_[kPointCloudLightingBlending] != 0);
-
-        shaderPrograms_[kTexture] = tango_gl::util::CreateProgram(kTextureMeshVertexShader.c_str(), kTextureMeshFragmentShader.c_str());
-        UASSERT(shaderPrograms_[kTexture] != 0);
-        shaderPrograms_[kTextureBlending] = tango_gl::util::CreateProgram(kTextureMeshVertexShader.c_str(), kTextureMeshBlendingFragmentShader.c_str());
-        UASSERT(shaderPrograms_[kTextureBlending] != 0);
-        shaderPrograms_[kTextureLighting] = tango_gl::util::CreateProgram(kTextureMeshLightingVertexShader.c_str(), kTextureMeshFragmentShader.c_str());
-        UASSERT(shaderPrograms_[kTextureLighting] != 0);
-        shaderPrograms_[kTextureLightingBlending] = tango_gl::util::CreateProgram(kTextureMeshLightingVertexShader.c_str(), kTextureMeshBlendingFragmentShader.c_str());
-        UASSERT(shaderPrograms_[kTextureLightingBlending] != 0);
-
-        shaderPrograms_[kDepthPacking] = tango_gl::util::CreateProgram(kPointCloudDepthPackingVertexShader.c_str(), kPointCloudDepthPackingFragmentShader.c_str());
-        UASSERT(shaderPrograms_[kDepthPacking] != 0);
+        // vertex and fragment shaders, in PointCloudShaders order
+        const std::string * shaders[kCropPreview][2] = {
+            {&kPointCloudVertexShader, &kPointCloudFragmentShader},
+            {&kPointCloudVertexShader, &kPointCloudBlendingFragmentShader},
+            {&kPointCloudLightingVertexShader, &kPointCloudFragmentShader},
+            {&kPointCloudLightingVertexShader, &kPointCloudBlendingFragmentShader},
+            {&kTextureMeshVertexShader, &kTextureMeshFragmentShader},
+            {&kTextureMeshVertexShader, &kTextureMeshBlendingFragmentShader},
+            {&kTextureMeshLightingVertexShader, &kTextureMeshFragmentShader},
+            {&kTextureMeshLightingVertexShader, &kTextureMeshBlendingFragmentShader},
+            {&kPointCloudDepthPackingVertexShader, &kPointCloudDepthPackingFragmentShader}};
+
+        const std::string cropPreviewDefine = "#define CROP_PREVIEW\n";
+        shaderPrograms_.resize(kCropPreview*2);
+        for(int i=0; i<kCropPreview; ++i)
+        {
+            shaderPrograms_[i] = tango_gl::util::CreateProgram(shaders[i][0]->c_str(), shaders[i][1]->c_str());
+            UASSERT(shaderPrograms_[i] != 0);
+            shaderPrograms_[kCropPreview+i] = tango_gl::util::CreateProgram(
+                    (cropPreviewDefine + *shaders[i][0]).c_str(),
+                    (cropPreviewDefine + *shaders[i][1]).c_str());
+            UASSERT(shaderPrograms_[kCropPreview+i] != 0);
+        }
     }
 }
 void PointCloudDrawable::releaseShaderPrograms()
@@ -316,6 +379,8 @@ PointCloudDrawable::PointCloudDrawable(
                 poseGl_(1.0f),
                 visible_(true),
                 hasNormals_(false),
+                cornerVertices_(false),
+                cropped_(false),
                 gainR_(gainR),
                 gainG_(gainG),
                 gainB_(gainB)
@@ -335,6 +400,8 @@ PointCloudDrawable::PointCloudDrawable(
                 poseGl_(1.0f),
                 visible_(true),
                 hasNormals_(false),
+                cornerVertices_(false),
+                cropped_(false),
                 gainR_(1.0f),
                 gainG_(1.0f),
                 gainB_(1.0f)
@@ -374,6 +441,18 @@ PointCloudDrawable::~PointCloudDrawable()
 
 void PointCloudDrawable::updatePolygons(const std::vector<pcl::Vertices> & polygons, const std::vector<pcl::Vertices> & polygonsLowRes, bool createWireframe)
 {
+    if(mesh_.cloud.get() && !cornerVertices_)
+    {
+        // keep polygon indices of cropPolygons() valid
+        mesh_.polygons = polygons;
+    }
+    uploadPolygons(polygons, polygonsLowRes, createWireframe);
+}
+
+void PointCloudDrawable::uploadPolygons(const std::vector<pcl::Vertices> & polygons, const std::vector<pcl::Vertices> & polygonsLowRes, bool createWireframe)
+{
+    cropped_ = false;
+    croppedPolygons_.clear();
     for(int i=0; i<4; ++i)
     {
         if(index_buffers_[i])
@@ -468,6 +547,7 @@ void PointCloudDrawable::updateCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Pt
 {
     UASSERT(cloud.get() && !cloud->empty());
     nPoints_ = 0;
+    cornerVertices_ = false;
     aabbMinModel_ = aabbMinWorld_ = pcl::PointXYZ(1000,1000,1000);
     aabbMaxModel_ = aabbMaxWorld_ = pcl::PointXYZ(-1000,-1000,-1000);
     
@@ -634,6 +714,7 @@ void PointCloudDrawable::updateMesh(const rtabmap::Mesh & mesh, bool createWiref
     nPoints_ = 0;
     aabbMinModel_ = aabbMinWorld_ = pcl::PointXYZ(1000,1000,1000);
     aabbMaxModel_ = aabbMaxWorld_ = pcl::PointXYZ(-1000,-1000,-1000);
+    cornerVertices_ = false;
     
     mesh_ = mesh;
 
@@ -825,6 +906,7 @@ void PointCloudDrawable::updateMesh(const rtabmap::Mesh & mesh, bool createWiref
             //  polygon vertices. Points linked to multiple different texCoords (different textures) should
             //  be duplicated.
             totalPoints = (int)mesh.texCoords.size();
+            cornerVertices_ = true;
             int items = hasNormals_?9:6;
             vertices = std::vector<float>(mesh.texCoords.size()*items);
             organizedToDenseIndices_ = std::vector<unsigned int>(totalPoints, -1);
@@ -960,7 +1042,7 @@ void PointCloudDrawable::updateMesh(const rtabmap::Mesh & mesh, bool createWiref
 
     nPoints_ = totalPoints;
 
-    updatePolygons(polygons, polygonsLowRes, createWireframe);
+    uploadPolygons(polygons, polygonsLowRes, createWireframe);
 
     if(!pose_.isNull())
     {
@@ -968,6 +1050,70 @@ void PointCloudDrawable::updateMesh(const rtabmap::Mesh & mesh, bool createWiref
     }
 }
 
+void PointCloudDrawable::cropPolygons(const std::vector<int> & polygonIndices, bool createWireframe)
+{
+    const std::vector<pcl::Vertices> & meshPolygons = mesh_.polygons.get();
+    std::vector<pcl::Vertices> polygons(polygonIndices.size());
+    for(size_t i=0; i<polygonIndices.size(); ++i)
+    {
+        UASSERT(polygonIndices[i] >= 0 && polygonIndices[i] < (int)meshPolygons.size());
+        const pcl::Vertices & polygon = meshPolygons[polygonIndices[i]];
+        if(cornerVertices_)
+        {
+            // vertices were uploaded in polygon order, see updateMesh()
+            unsigned int polygonSize = (unsigned int)polygon.vertices.size();
+            polygons[i].vertices.resize(polygonSize);
+            for(unsigned int j=0; j<polygonSize; ++j)
+            {
+                polygons[i].vertices[j] = polygonIndices[i]*polygonSize + j;
+            }
+        }
+        else
+        {
+            polygons[i] = polygon;
+        }
+    }
+    // low res polygons are not cropped, only full resolution is drawn
+    uploadPolygons(polygons, std::vector<pcl::Vertices>(), createWireframe);
+    croppedPolygons_ = polygonIndices;
+    cropped_ = true;
+}
+
+void PointCloudDrawable::uncropPolygons(bool createWireframe)
+{
+    if(cornerVertices_)
+    {
+        std::vector<int> polygonIndices(mesh_.polygons.size());
+        for(size_t i=0; i<polygonIndices.size(); ++i)
+        {
+            polygonIndices[i] = (int)i;
+        }
+        cropPolygons(polygonIndices, createWireframe);
+        cropped_ = false;
+        croppedPolygons_.clear();
+    }
+    else
+    {
+        uploadPolygons(mesh_.polygons, mesh_.cloud->isOrganized()?mesh_.polygonsLowRes.get():std::vector<pcl::Vertices>(), createWireframe);
+    }
+}
+
+rtabmap::Mesh PointCloudDrawable::getCroppedMesh() const
+{
+    if(!cropped_)
+    {
+        return mesh_;
+    }
+    std::vector<pcl::Vertices> polygons(croppedPolygons_.size());
+    for(size_t i=0; i<croppedPolygons_.size(); ++i)
+    {
+        polygons[i] = mesh_.polygons[croppedPolygons_[i]];
+    }
+    rtabmap::Mesh mesh = mesh_; // shares the cloud and texture coordinates
+    mesh.polygons = std::move(polygons);
+    return mesh;
+}
+
 void PointCloudDrawable::setPose(const rtabmap::Transform & pose)
 {
     UASSERT(!pose.isNull());
@@ -1020,9 +1166,11 @@ void PointCloudDrawable::Render(
         float nearClipPlane,
         float farClipPlane,
         bool packDepthToColorChannel,
-        bool wireFrame) const
+        bool wireFrame,
+        const std::vector<glm::vec2> & cropPolygon) const
 {
-    if(vertex_buffer_ && nPoints_ && visible_ && !shaderPrograms_.empty())
+    // a mesh cropped to nothing should not fall back to points
+    if(vertex_buffer_ && nPoints_ && visible_ && !shaderPrograms_.empty() && !(cropped_ && croppedPolygons_.empty()))
     {
         if(packDepthToColorChannel || !hasNormals_)
         {
@@ -1034,37 +1182,56 @@ void PointCloudDrawable::Render(
             textureRendering = false;
         }
 
-        GLuint program;
+        int programIndex;
         if(packDepthToColorChannel)
         {
-            program = shaderPrograms_[kDepthPacking];
+            programIndex = kDepthPacking;
         }
         else if(textureRendering)
         {
             if(lighting)
             {
-                program = shaderPrograms_[depthTexture>0?kTextureLightingBlending:kTextureLighting];
+                programIndex = depthTexture>0?kTextureLightingBlending:kTextureLighting;
             }
             else
             {
-                program = shaderPrograms_[depthTexture>0?kTextureBlending:kTexture];
+                programIndex = depthTexture>0?kTextureBlending:kTexture;
             }
         }
         else
         {
             if(lighting)
             {
-                program = shaderPrograms_[depthTexture>0?kPointCloudLightingBlending:kPointCloudLighting];
+                programIndex = depthTexture>0?kPointCloudLightingBlending:kPointCloudLighting;
             }
             else
             {
-                program = shaderPrograms_[depthTexture>0?kPointCloudBlending:kPointCloud];
+                programIndex = depthTexture>0?kPointCloudBlending:kPointCloud;
             }
         }
 
+        bool cropPreview = cropPolygon.size() >= 3 && cropPolygon.size() <= (size_t)kMaxCropPolygonSize;
+        if(cropPreview)
+        {
+            // same program compiled with CROP_PREVIEW
+            programIndex += kCropPreview;
+        }
+        GLuint program = shaderPrograms_[programIndex];
+
         glUseProgram(program);
         tango_gl::util::CheckGlError("Pointcloud::Render() set program");
 
+        if(cropPreview)
+        {
+            GLuint model_handle = glGetUniformLocation(program, "uModel");
+            glUniformMatrix4fv(model_handle, 1, GL_FALSE, glm::value_ptr(poseGl_));
+            GLuint cropPolygon_handle = glGetUniformLocation(program, "uCropPolygon");
+            glUniform2fv(cropPolygon_handle, (GLsizei)cropPolygon.size(), glm::value_ptr(cropPolygon[0]));
+            GLuint cropPolygonSize_handle = glGetUniformLocation(program, "uCropPolygonSize");
+            glUniform1i(cropPolygonSize_handle, (int)cropPolygon.size());
+            tango_gl::util::CheckGlError("Pointcloud::Render() crop preview");
+        }
+
         GLuint mvp_handle = glGetUniformLocation(program, "uMVP");
         glm::mat4 mv_mat = viewMatrix * poseGl_;
         glm::mat4 mvp_mat = projectionMatrix * mv_mat;
@@ -43,6 +43,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // PointCloudDrawable is responsible for the point cloud rendering.
 class PointCloudDrawable {
 public:
+    static const int kMaxCropPolygonSize = 32; // crop preview in shaders
     static void createShaderPrograms();
     static void releaseShaderPrograms();
 
@@ -64,13 +65,18 @@ private:
   void updatePolygons(const std::vector<pcl::Vertices> & polygons, const std::vector<pcl::Vertices> & polygonsLowRes = std::vector<pcl::Vertices>(), bool createWireframe = false);
   void updateCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud, const pcl::IndicesPtr & indices);
   void updateMesh(const rtabmap::Mesh & mesh, bool createWireframe = false);
+  // Index-only crop: draw only the polygons of the mesh at these indices (in
+  // getMesh().polygons), the vertex buffer is not rewritten.
+  void cropPolygons(const std::vector<int> & polygonIndices, bool createWireframe = false);
+  void uncropPolygons(bool createWireframe = false);
+  bool isCropped() const {return cropped_;}
   void setPose(const rtabmap::Transform & pose);
   void setVisible(bool visible) {visible_=visible;}
   void setGains(float gainR, float gainG, float gainB) {gainR_ = gainR; gainG_ = gainG; gainB_ = gainB;}
   rtabmap::Transform getPose() const {return pose_;}
   const glm::mat4 & getPoseGl() const {return poseGl_;}
   bool isVisible() const {return visible_;}
-  bool hasMesh() const {return index_buffers_[0] != 0;}
+  bool hasMesh() const {return index_buffers_[0] != 0 || cropped_;}
   bool hasTexture() const {return texture_ != 0;}
   float getMinHeight() const {return minHeight_;}
   const pcl::PointXYZ & aabbMinModel() const {return aabbMinModel_;}
@@ -98,9 +104,11 @@ private:
           float nearClipPlane = 0, // nonnull if depthTexture>0
           float farClipPlane = 0,  // nonnull if depthTexture>0
           bool packDepthToColorChannel = false,
-          bool wireFrame = false) const;
+          bool wireFrame = false,
+          const std::vector<glm::vec2> & cropPolygon = std::vector<glm::vec2>()) const; // x/z scene frame, crop preview if not empty
     
     const rtabmap::Mesh & getMesh() const { return mesh_; }
+    rtabmap::Mesh getCroppedMesh() const; // mesh with only the polygons drawn
 
  private:
   template<class PointT>
@@ -114,6 +122,7 @@ private:
       if(pt.z>max.z) max.z = pt.z;
   }
   void updateAABBWorld(const rtabmap::Transform & pose);
+  void uploadPolygons(const std::vector<pcl::Vertices> & polygons, const std::vector<pcl::Vertices> & polygonsLowRes, bool createWireframe);
 
  private:
   // Vertex buffer of the point cloud geometry.
@@ -127,6 +136,9 @@ private:
   bool visible_;
   bool hasNormals_;
   std::vector<unsigned int> organizedToDenseIndices_;
+  bool cornerVertices_; // one vertex per polygon corner (dense textured mesh)
+  bool cropped_;
+  std::vector<int> croppedPolygons_;
   float minHeight_; // odom frame
 
   float gainR_;
@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "pose_buffer.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <boost/thread/thread_time.hpp>
+#include <Eigen/Geometry>
+
+PoseBuffer::PoseBuffer(int capacity) :
+	buffer_(capacity),
+	first_(0),
+	size_(0)
+{
+	UASSERT(capacity >= 2);
+}
+
+void PoseBuffer::add(double stamp, const rtabmap::Transform & pose)
+{
+	UASSERT(!pose.isNull());
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if(size_ > 0 && stamp <= at(size_-1).stamp)
+		{
+			if(stamp < at(size_-1).stamp)
+			{
+				UWARN("Ignoring pose at time %f, older than the latest one (%f).", stamp, at(size_-1).stamp);
+			}
+			return;
+		}
+		Entry * entry;
+		if(size_ < (int)buffer_.size())
+		{
+			entry = &buffer_[(first_ + size_++) % buffer_.size()];
+		}
+		else
+		{
+			// full, overwrite the oldest
+			entry = &buffer_[first_];
+			first_ = (first_ + 1) % buffer_.size();
+		}
+		entry->stamp = stamp;
+		Eigen::Map<Eigen::Matrix<float, 3, 4, Eigen::RowMajor> >(entry->data) = pose.toEigen3f().matrix().topRows<3>();
+	}
+	condition_.notify_all();
+}
+
+void PoseBuffer::clear()
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	first_ = 0;
+	size_ = 0;
+}
+
+rtabmap::Transform PoseBuffer::getPose(double stamp, double maxWaitTime) const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	if(size_ == 0)
+	{
+		return rtabmap::Transform();
+	}
+
+	if(maxWaitTime > 0.0 && at(size_-1).stamp < stamp)
+	{
+		const boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds((long)(maxWaitTime*1000000.0));
+		while(size_ > 0 && at(size_-1).stamp < stamp)
+		{
+			if(!condition_.timed_wait(lock, deadline))
+			{
+				break;
+			}
+		}
+		if(size_ == 0)
+		{
+			return rtabmap::Transform();
+		}
+	}
+
+	if(at(size_-1).stamp < stamp)
+	{
+		if(maxWaitTime > 0.0)
+		{
+			UWARN("Could not find poses to interpolate at time %f after waiting %d ms (latest is %f)...", stamp, int(maxWaitTime*1000), at(size_-1).stamp);
+		}
+		else
+		{
+			UWARN("Could not find poses to interpolate at time %f (latest is %f)...", stamp, at(size_-1).stamp);
+		}
+		return rtabmap::Transform();
+	}
+
+	// first pose with stamp >= stamp
+	int low = 0;
+	int high = size_-1;
+	while(low < high)
+	{
+		int mid = (low + high) / 2;
+		if(at(mid).stamp < stamp)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	const Entry & b = at(low);
+	if(b.stamp == stamp)
+	{
+		return rtabmap::Transform(
+				b.data[0], b.data[1], b.data[2], b.data[3],
+				b.data[4], b.data[5], b.data[6], b.data[7],
+				b.data[8], b.data[9], b.data[10], b.data[11]);
+	}
+	if(low == 0)
+	{
+		UWARN("Could not find pose data to interpolate at time %f (earliest is %f). Are sensors synchronized?", stamp, b.stamp);
+		return rtabmap::Transform();
+	}
+
+	// same as Transform::interpolate()
+	const Entry & a = at(low-1);
+	typedef Eigen::Map<const Eigen::Matrix<float, 3, 4, Eigen::RowMajor> > PoseMap;
+	PoseMap poseA(a.data);
+	PoseMap poseB(b.data);
+	const float t = (stamp - a.stamp) / (b.stamp - a.stamp);
+	Eigen::Quaternionf qa(Eigen::Matrix3f(poseA.leftCols<3>()));
+	Eigen::Quaternionf qb(Eigen::Matrix3f(poseB.leftCols<3>()));
+	Eigen::Quaternionf q = qa.slerp(t, qb);
+	Eigen::Vector3f p = poseA.col(3) + t*(poseB.col(3) - poseA.col(3));
+	return rtabmap::Transform(p[0], p[1], p[2], q.x(), q.y(), q.z(), q.w());
+}
@@ -0,0 +1,70 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef POSE_BUFFER_H_
+#define POSE_BUFFER_H_
+
+#include <vector>
+#include <rtabmap/core/Transform.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+// Fixed capacity ring of stamped poses, written by the thread receiving the
+// poses of the AR framework and read by the capture thread to get the pose of
+// an image. Poses are stored as raw 3x4 matrices so that adding or looking up
+// a pose does not allocate. Stamps are expected to be increasing, poses not
+// newer than the latest one are ignored. Readers waiting for a pose newer than the latest one
+// are woken up on insertion instead of polling.
+class PoseBuffer {
+public:
+	PoseBuffer(int capacity = 1000);
+
+	void add(double stamp, const rtabmap::Transform & pose);
+	void clear();
+
+	// Pose interpolated at stamp. If stamp is after the latest pose, wait up
+	// to maxWaitTime (sec) for a newer one. Returns a null transform if the
+	// buffer is empty or the stamp is out of its range.
+	rtabmap::Transform getPose(double stamp, double maxWaitTime = 0.0) const;
+
+private:
+	struct Entry {
+		double stamp;
+		float data[12];
+	};
+	const Entry & at(int i) const {return buffer_[(first_ + i) % buffer_.size()];}
+
+private:
+	mutable boost::mutex mutex_;
+	mutable boost::condition_variable condition_;
+	std::vector<Entry> buffer_;
+	int first_; // index of the oldest pose
+	int size_;
+};
+
+#endif /* POSE_BUFFER_H_ */
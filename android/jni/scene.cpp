@@ -29,6 +29,9 @@
 #include <opencv2/imgproc/imgproc.hpp> // cv::pointPolygonTest()
 #include <cmath> // fabs, sqrt
 #include <numeric> // std::accumulate
+#include <list>
+#include <algorithm> // std::find
+#include <limits>
 
 #include <glm/gtx/transform.hpp>
 
@@ -69,8 +72,6 @@ const std::string kGraphFragmentShader =
     "  gl_FragColor = vec4(v_color.z, v_color.y, v_color.x, 1.0);\n"
     "}\n";
 
-double totalVolume = 0.0;
-
 Scene::Scene() :
         background_renderer_(0),
         gesture_camera_(0),
@@ -78,6 +79,7 @@ Scene::Scene() :
         frustum_(0),
         grid_(0),
         box_(0),
+        cutFillOverlay_(0),
         trace_(0),
         graph_(0),
         graphVisible_(true),
@@ -106,7 +108,40 @@ Scene::Scene() :
         doubleTapOn_(false),
         croppingOn_(false),
         lineWidth_(10.0f),
-        polygonClosed_(false)
+        polygonClosed_(false),
+        volumeThread_(0),
+        cropRevision_(0),
+        volumeJobRevision_(0),
+        volumeJobRunning_(false),
+        croppedRevision_(0),
+        croppedAppliedRevision_(0),
+        cropPreview_(true),
+        cropUploaded_(false),
+        cropCommitRevision_(0),
+        cropHistoryIndex_(-1),
+        cropHistoryRevision_(0),
+        cropHistoryRequest_(0),
+        croppedPosesChanged_(false),
+        croppedReference_(0.0f, 0.0f, 0.0f),
+        volumeCapping_(true),
+        cropRegionEmpty_(true),
+        pileMinTriangles_(-1),
+        pileWeldDistance_(0.02f),
+        previewRevision_(0),
+        volumeMode_(kVolumeSurface),
+        heightMapCellSize_(0.02f),
+        heightMapThread_(0),
+        meshRevision_(0),
+        heightMapJobRevision_(0),
+        heightMapJobCropRevision_(0),
+        heightMapJobRunning_(false),
+        heightMapPyramidRevision_(0),
+        heightMapStatsRevision_(0),
+        roiRevision_(0),
+        roiThread_(0),
+        roiJobRevision_(0),
+        roiJobMeshRevision_(0),
+        roiJobRunning_(false)
 {
     depthTexture_ = 0;
     gesture_camera_ = new tango_gl::GestureCamera();
@@ -115,6 +150,9 @@ Scene::Scene() :
 }
 
 Scene::~Scene() {
+    cancelVolumeJob();
+    cancelHeightMapJob();
+    cancelRoiJob();
     DeleteResources();
     delete gesture_camera_;
     delete currentPose_;
@@ -171,6 +209,8 @@ void Scene::DeleteResources() {
         delete background_renderer_;
         background_renderer_ = 0;
     }
+    delete cutFillOverlay_;
+    cutFillOverlay_ = 0;
 
     PointCloudDrawable::releaseShaderPrograms();
 
@@ -196,6 +236,8 @@ void Scene::DeleteResources() {
 void Scene::clear()
 {
     LOGI("Scene::clear()");
+    ++cropRevision_;
+    ++meshRevision_;
     for(std::map<int, PointCloudDrawable*>::iterator iter=pointClouds_.begin(); iter!=pointClouds_.end(); ++iter)
     {
         delete iter->second;
@@ -213,8 +255,17 @@ void Scene::clear()
         delete graph_;
         graph_ = 0;
     }
+    nodeCovariances_.clear();
     pointClouds_.clear();
     markers_.clear();
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        groundCache_.clear();
+        bvhCache_.clear();
+    }
+    cropUploaded_ = false;
+    cropHistory_.clear();
+    cropHistoryIndex_ = -1;
     if(grid_)
     {
         grid_->SetPosition(kHeightOffset);
@@ -469,6 +520,31 @@ int Scene::Render(const float * uvsTransformed, glm::mat4 arViewMatrix, glm::mat
     }
     cloudsToDraw.resize(oi);
 
+    int cropHistoryStep = cropHistoryRequest_.exchange(0);
+    if(cropHistoryStep != 0)
+    {
+        stepCropHistory(cropHistoryStep);
+    }
+
+    // Crop preview of the meshes while the polygon is edited
+    std::vector<glm::vec2> cropPolygon;
+    std::vector<glm::vec2> noCropPolygon;
+    if(isCropPreviewActive())
+    {
+        if(cropUploaded_ && croppedAppliedRevision_ != cropRevision_)
+        {
+            uncropMeshes();
+        }
+        if(!cropUploaded_)
+        {
+            cropPolygon.resize(markerPoses_.size());
+            for(size_t i=0; i<markerPoses_.size(); ++i)
+            {
+                cropPolygon[i] = glm::vec2(markerPoses_[i].x(), markerPoses_[i].z());
+            }
+        }
+    }
+
     // First rendering to get depth texture
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
@@ -514,7 +590,7 @@ int Scene::Render(const float * uvsTransformed, glm::mat4 arViewMatrix, glm::mat
                       (*iter)->getPose().y() - openglCamera.y(),
                       (*iter)->getPose().z() - openglCamera.z());
             float distanceToCameraSqr = cloudToCamera[0]*cloudToCamera[0] + cloudToCamera[1]*cloudToCamera[1] + cloudToCamera[2]*cloudToCamera[2];
-            (*iter)->Render(projectionMatrix, viewMatrix, meshRendering_, pointSize_, false, false, distanceToCameraSqr, 0, 0, 0, 0, 0, true);
+            (*iter)->Render(projectionMatrix, viewMatrix, meshRendering_, pointSize_, false, false, distanceToCameraSqr, 0, 0, 0, 0, 0, true, false, (*iter)->hasMesh()?cropPolygon:noCropPolygon);
         }
         
         if(!meshRendering_ && occlusionMesh.cloud.get() && occlusionMesh.cloud->size())
@@ -541,7 +617,8 @@ int Scene::Render(const float * uvsTransformed, glm::mat4 arViewMatrix, glm::mat
                       (*iter)->getPose().z() - openglCamera.z());
             float distanceToCameraSqr = cloudToCamera[0]*cloudToCamera[0] + cloudToCamera[1]*cloudToCamera[1] + cloudToCamera[2]*cloudToCamera[2];
             
-            (*iter)->Render(projectionMatrix, viewMatrix, meshRendering_, pointSize_*10.0f, false, false, distanceToCameraSqr, 0, 0, 0, 0, 0, true);
+            // pick what is displayed: same crop preview as the main pass
+            (*iter)->Render(projectionMatrix, viewMatrix, meshRendering_, pointSize_*10.0f, false, false, distanceToCameraSqr, 0, 0, 0, 0, 0, true, false, (*iter)->hasMesh()?cropPolygon:noCropPolygon);
         }
 
         GLubyte zValue[4];
@@ -568,6 +645,7 @@ int Scene::Render(const float * uvsTransformed, glm::mat4 arViewMatrix, glm::mat
                         {
                             // 첫 마커를 재클릭 → 도형 닫힘
                             polygonClosed_ = true;
+                            ++cropRevision_;
                             LOGI("Polygon closed!");
 
                             doubleTapOn_ = false;
@@ -591,29 +669,32 @@ int Scene::Render(const float * uvsTransformed, glm::mat4 arViewMatrix, glm::mat
     // ★★ polygon이 닫혔는지 확인
     if(polygonClosed_ && markerPoses_.size() >= 3)
     {
-        LOGI("Polygon closed! We will filter all meshes inside polygon...");
-
-        // 2D 폴리곤 좌표들
-        std::vector<rtabmap::Transform> polygon2D = markerPoses_;
+        // Upload the last crop result, then restart the job only if
+        // markers, meshes or poses changed since it was started.
+        applyVolumeJobResult();
+        if(volumeJobRevision_ != cropRevision_ && !isVolumeJobRunning())
+        {
+            startVolumeJob();
+        }
+        else if(croppedPosesChanged_)
+        {
+            updateCroppedVolumeFromPoses();
+        }
 
-        // (A) createdMeshes_ 전체 순회 후 내부 필터링
-        for(auto & kv : pointClouds_)
+        if(volumeMode_ == kVolumeHeightMap)
         {
-            PointCloudDrawable * cloudDrawable = kv.second;
-            if(cloudDrawable && cloudDrawable->hasMesh())
+            if((heightMapJobRevision_ != meshRevision_ || heightMapJobCropRevision_ != cropRevision_) && !isHeightMapJobRunning())
             {
-                // 1) 가져오기
-                rtabmap::Mesh mesh = cloudDrawable->getMesh();
-                // 2) 필터링
-                filterMeshInsidePolygon(polygon2D, mesh, cloudDrawable->getPose());
-                // 3) 업데이트
-                cloudDrawable->updateMesh(mesh);
-                // 4) 볼륨 계산
-                totalVolume = calculateMeshVolume(kv.first);
+                startHeightMapJob();
             }
         }
     }
 
+    if((roiJobRevision_ != roiRevision_ || roiJobMeshRevision_ != meshRevision_) && !isRoiJobRunning())
+    {
+        startRoiJob();
+    }
+
     glClearColor(r_, g_, b_, 1.0f);
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
     
@@ -690,7 +771,12 @@ int Scene::Render(const float * uvsTransformed, glm::mat4 arViewMatrix, glm::mat
                 cloud->getPose().z() - openglCamera.z());
         float distanceToCameraSqr = cloudToCamera[0]*cloudToCamera[0] + cloudToCamera[1]*cloudToCamera[1] + cloudToCamera[2]*cloudToCamera[2];
 
-        cloud->Render(projectionMatrix, viewMatrix, meshRendering_, pointSize_, meshRenderingTexture_, lighting_, distanceToCameraSqr, onlineBlending?depthTexture_:0, screenWidth_, screenHeight_, gesture_camera_->getNearClipPlane(), gesture_camera_->getFarClipPlane(), false, wireFrame_);
+        cloud->Render(projectionMatrix, viewMatrix, meshRendering_, pointSize_, meshRenderingTexture_, lighting_, distanceToCameraSqr, onlineBlending?depthTexture_:0, screenWidth_, screenHeight_, gesture_camera_->getNearClipPlane(), gesture_camera_->getFarClipPlane(), false, wireFrame_, cloud->hasMesh()?cropPolygon:noCropPolygon);
+    }
+
+    if(cutFillOverlay_)
+    {
+        cutFillOverlay_->Render(projectionMatrix, viewMatrix, true, pointSize_, false, false);
     }
 
     if(onlineBlending)
@@ -873,6 +959,30 @@ void Scene::updateGraph(
     UASSERT(graph_shader_program_ != 0);
     delete graph_;
     graph_ = new GraphDrawable(graph_shader_program_, poses, links);
+
+    // Node covariances for the volume uncertainty: mean of their links
+    std::map<int, int> counts;
+    nodeCovariances_.clear();
+    for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+    {
+        const rtabmap::Link & link = iter->second;
+        if(link.from() < 0 || link.to() < 0 || link.infMatrix().empty() || cv::determinant(link.infMatrix()) <= 0.0)
+        {
+            continue; // landmarks or invalid information
+        }
+        cv::Mat covariance = link.infMatrix().inv();
+        int ids[2] = {link.from(), link.to()};
+        for(int i=0; i<2; ++i)
+        {
+            cv::Mat & nodeCovariance = nodeCovariances_[ids[i]];
+            nodeCovariance = nodeCovariance.empty()?covariance.clone():nodeCovariance+covariance;
+            ++counts[ids[i]];
+        }
+    }
+    for(std::map<int, cv::Mat>::iterator iter=nodeCovariances_.begin(); iter!=nodeCovariances_.end(); ++iter)
+    {
+        iter->second /= double(counts.at(iter->first));
+    }
 }
 
 void Scene::setGraphVisible(bool visible)
@@ -950,6 +1060,7 @@ void Scene::addMarker2(int id, const rtabmap::Transform & pose)
     // 순서/좌표 기록
     markerOrder_.push_back(id);
     markerPoses_.push_back(pose);
+    ++cropRevision_;
 
     LOGI("Added marker %d at pose (%f,%f,%f)",
          id, pose.x(), pose.y(), pose.z());
@@ -966,6 +1077,18 @@ void Scene::setMarkerPose(int id, const rtabmap::Transform & pose)
         glm::quat rotation(quat.w(), quat.x(), quat.y(), quat.z());
         iter->second->SetPosition(position);
         iter->second->SetRotation(rotation);
+
+        // Moving a polygon vertex (dragging) updates the ROI
+        std::vector<int>::iterator jter = std::find(markerOrder_.begin(), markerOrder_.end(), id);
+        if(jter != markerOrder_.end())
+        {
+            rtabmap::Transform & markerPose = markerPoses_[jter - markerOrder_.begin()];
+            if(markerPose != pose)
+            {
+                markerPose = pose;
+                ++cropRevision_;
+            }
+        }
     }
 }
 bool Scene::hasMarker(int id) const
@@ -986,20 +1109,22 @@ void Scene::removeMarkerAll()
 {
     LOGI("Removing all markers...");
 
-    // [추가] 먼저, 필터링된 메쉬를 '원본'으로 복원
-    for(auto & kv : originalMeshes_)
+    cancelVolumeJob();
     {
-        int id = kv.first;
-        // Scene 내부에 해당 메쉬가 존재한다면
-        auto iter = pointClouds_.find(id);
-        if(iter != pointClouds_.end() && iter->second->hasMesh())
-        {
-//            setWireframe(true);
-            // 원본 메쉬로 업데이트
-            iter->second->updateMesh(kv.second, true);
-        }
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        croppedMasks_.clear();
+        croppedMoments_.clear();
+        croppedBoundaries_.clear();
+        croppedPiles_.clear();
+        croppedStats_ = MeshVolume::Stats();
+        previewStats_ = MeshVolume::Stats();
+        heightMapRoi_.clear();
+        heightMapStats_ = HeightMap::Stats();
     }
 
+    // [추가] 먼저, 필터링된 메쉬를 '원본'으로 복원 (index buffers only)
+    uncropMeshes(true);
+
     // 마커들 삭제 (기존 로직)
     while (!markers_.empty())
     {
@@ -1012,6 +1137,7 @@ void Scene::removeMarkerAll()
 
     // 폴리곤도 닫힘 상태 해제
     polygonClosed_ = false;
+    ++cropRevision_;
     Render();
 }
 
@@ -1055,6 +1181,12 @@ void Scene::addMesh(
     }
     //기존 메쉬 보관
     originalMeshes_[id] = mesh;
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        bvhCache_.erase(id);
+    }
+    ++cropRevision_;
+    ++meshRevision_;
 
     PointCloudDrawable * drawable = new PointCloudDrawable(mesh, createWireframe);
     drawable->setPose(pose);
@@ -1119,6 +1251,11 @@ void Scene::setCloudPose(int id, const rtabmap::Transform & pose)
     std::map<int, PointCloudDrawable*>::iterator iter=pointClouds_.find(id);
     if(iter != pointClouds_.end())
     {
+        if(iter->second->getPose() != pose)
+        {
+            croppedPosesChanged_ = true;
+            ++meshRevision_;
+        }
         iter->second->setPose(pose);
     }
 }
@@ -1158,6 +1295,19 @@ void Scene::updateCloudPolygons(int id, const std::vector<pcl::Vertices> & polyg
     if(iter != pointClouds_.end())
     {
         iter->second->updatePolygons(polygons);
+        std::map<int, rtabmap::Mesh>::iterator jter = originalMeshes_.find(id);
+        if(jter != originalMeshes_.end())
+        {
+            jter->second.polygons = polygons;
+        }
+        {
+            boost::mutex::scoped_lock lock(volumeMutex_);
+            croppedMoments_.erase(id);
+            croppedBoundaries_.erase(id);
+            bvhCache_.erase(id);
+        }
+        ++cropRevision_;
+        ++meshRevision_;
     }
 }
 
@@ -1167,6 +1317,14 @@ void Scene::updateMesh(int id, const rtabmap::Mesh & mesh)
     if(iter != pointClouds_.end())
     {
         originalMeshes_[id] = mesh;
+        {
+            boost::mutex::scoped_lock lock(volumeMutex_);
+            croppedMoments_.erase(id);
+            croppedBoundaries_.erase(id);
+            bvhCache_.erase(id);
+        }
+        ++cropRevision_;
+        ++meshRevision_;
         
         iter->second->updateMesh(mesh);
     }
@@ -1200,207 +1358,1473 @@ void Scene::filterMeshInsidePolygon(
         return;
     }
 
-    // (1) 2D 폴리곤 (씬 좌표계)
-    std::vector<cv::Point2f> polyPoints;
-    polyPoints.reserve(polygon2D.size());
-    for(const auto & t : polygon2D)
+    // (1) 메쉬 로컬 → 씬 좌표 (Drawable Pose * mesh.pose)
+    rtabmap::Transform meshToScene = MeshVolume::meshToScene(mesh, drawablePose);
+
+    // (2) 정점마다 한 번만 폴리곤 내부 판별 후, 삼각형은 비트마스크로 선택
+    MeshCrop crop(polygon2D);
+    std::vector<pcl::Vertices> newPolygons = mesh.polygons;
+    crop.crop(MeshVolume::VertexArrays(*mesh.cloud), meshToScene, newPolygons);
+
+    LOGI("filterMeshInsidePolygon() -> original polygons=%d, filtered=%d",
+         int(mesh.polygons.size()),
+         int(newPolygons.size()));
+
+    // (3) 결과 반영
+    mesh.polygons = newPolygons;
+}
+
+/**
+ * @brief Scene::computeMeshVolume
+ *  reference 점(Scene 좌표계)을 기준으로 메쉬(이미 crop된 상태)의
+ *  삼각형 테트라볼륨을 누적 계산한다. GL 상태를 사용하지 않으므로
+ *  worker thread에서도 호출 가능.
+ *
+ * @param mesh : 로컬 좌표계 메쉬
+ * @param drawablePose : drawable pose (Scene 좌표계)
+ * @param reference : 테트라 기준점 c (Scene 좌표계)
+ * @return 계산된 부피 (양수)
+ */
+double Scene::computeMeshVolume(
+        const rtabmap::Mesh & mesh,
+        const rtabmap::Transform & drawablePose,
+        const pcl::PointXYZ & reference)
+{
+    return MeshVolume::compute(mesh, drawablePose, Eigen::Vector3f(reference.x, reference.y, reference.z)).volume;
+}
+
+/**
+ * @brief Scene::computeMarkerPolygonCentroid
+ *  crop에 사용된 폴리곤(마커들)의 x,y,z 평균점을 구한다.
+ *  - polygonClosed_ 등이 true/false이든, markerPoses_만 있으면 계산 가능
+ * @return centroid (pcl::PointXYZ). 마커가 없으면 (0,0,0)
+ */
+pcl::PointXYZ Scene::computeMarkerPolygonCentroid() const
+{
+    return computePolygonCentroid(markerPoses_);
+}
+
+pcl::PointXYZ Scene::computePolygonCentroid(const std::vector<rtabmap::Transform> & polygon)
+{
+    pcl::PointXYZ centroid(0.0f, 0.0f, 0.0f);
+    if(polygon.empty())
+    {
+        return centroid;
+    }
+
+    for(const auto & pose : polygon)
     {
-        polyPoints.push_back(cv::Point2f(t.x(), t.z()));
+        centroid.x += pose.x();
+        centroid.y += pose.y();
+        centroid.z += pose.z();
     }
+    centroid.x /= float(polygon.size());
+    centroid.y /= float(polygon.size());
+    centroid.z /= float(polygon.size());
+
+    return centroid;
+}
+
+void Scene::setVolumeCallback(const std::function<void(double)> & callback)
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    volumeCallback_ = callback;
+}
+
+void Scene::setVolumeRefinedCallback(const std::function<void(double, double)> & callback)
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    volumeRefinedCallback_ = callback;
+}
 
-    // (2) 메쉬 로컬 → 씬 좌표
-    //     - Drawable Pose * mesh.pose
-    rtabmap::Transform meshToScene = rtabmap::Transform::getIdentity();
-    if(!drawablePose.isNull() && !mesh.pose.isNull())
+double Scene::getCroppedVolumePreview(bool waitJob)
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    while(waitJob && volumeJobRunning_ &&
+          croppedRevision_ != cropRevision_ &&
+          previewRevision_ != cropRevision_)
     {
-        meshToScene = drawablePose * mesh.pose;
+        volumeCondition_.wait(lock);
     }
-    else if(!mesh.pose.isNull())
+    if(volumeMode_ == kVolumeSurface && croppedRevision_ != cropRevision_ && previewRevision_ == cropRevision_)
     {
-        // fallback: mesh.pose만 사용
-        meshToScene = mesh.pose;
+        return std::fabs(previewStats_.signedVolume);
     }
-    Eigen::Affine3f meshToSceneEigen = meshToScene.toEigen3f();
+    lock.unlock();
+    return getCroppedVolume();
+}
 
-    // (3) 폴리곤 내부 판별
-    std::vector<pcl::Vertices> newPolygons;
-    newPolygons.reserve(mesh.polygons.size());
+double Scene::getCroppedVolume(bool waitJob)
+{
+    // Signed sum, it can be updated from the moments and
+    // doesn't double count folded surfaces
+    bool current = false;
+    MeshVolume::Stats stats = getCroppedVolumeStats(waitJob, &current);
+    return current?std::fabs(stats.signedVolume):-1.0;
+}
 
-    for(const auto & poly : mesh.polygons)
+MeshVolume::Stats Scene::getCroppedVolumeStats(bool waitJob, bool * current)
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    while(waitJob && (volumeJobRunning_ || heightMapJobRunning_))
     {
-        bool allInside = true;
-        for(unsigned int i=0; i<poly.vertices.size(); ++i)
-        {
-            int idx = poly.vertices[i];
-            if(idx < 0 || idx >= int(mesh.cloud->size()))
-            {
-                allInside = false;
-                break;
-            }
-            // 로컬 점
-            const pcl::PointXYZRGB & ptLocal = mesh.cloud->at(idx);
-            // 씬 좌표로
-            pcl::PointXYZRGB ptScene =
-                pcl::transformPoint(ptLocal, meshToSceneEigen);
-            // 2D만 사용
-            cv::Point2f pt2D(ptScene.x, ptScene.z);
-            // OpenCV 폴리곤 내부 여부
-            double inside = cv::pointPolygonTest(polyPoints, pt2D, false);
-            if(inside < 0)
-            {
-                allInside = false;
-                break;
-            }
-        }
-        if(allInside)
+        volumeCondition_.wait(lock);
+    }
+    if(current)
+    {
+        // the jobs only run on a closed polygon, and any change of the
+        // polygon increments cropRevision_
+        *current = polygonClosed_ &&
+                (volumeMode_ == kVolumeHeightMap?
+                        heightMapRoi_.size() >= 3 && heightMapStatsRevision_ == cropRevision_:
+                        croppedRevision_ == cropRevision_);
+    }
+    MeshVolume::Stats stats = croppedStats_;
+    if(volumeMode_ == kVolumeHeightMap)
+    {
+        HeightMap::Stats heightMapStats = heightMapStats_;
+        if(heightMapPyramid_.get() && heightMapRoi_.size() >= 3)
         {
-            newPolygons.push_back(poly);
+            // the height map may be newer than the last query (markers moved
+            // during the job), the max height is the one of the last query
+            heightMapStats = heightMapPyramid_->volume(heightMapGround_.quadratic(), heightMapGround_.center, heightMapRoi_);
+            heightMapStats.maxHeight = heightMapStats_.maxHeight;
         }
+        // net volume, like the signed volume of the surface mode
+        stats.volume = heightMapStats.netVolume;
+        stats.signedVolume = heightMapStats.netVolume;
+        stats.footprint = heightMapStats.footprint;
+        stats.maxHeight = heightMapStats.maxHeight;
     }
-
-    LOGI("filterMeshInsidePolygon() -> original polygons=%d, filtered=%d",
-         int(mesh.polygons.size()),
-         int(newPolygons.size()));
-
-    // (4) 결과 반영
-    mesh.polygons = newPolygons;
+    return stats;
 }
 
-/**
- * @brief Scene::calculateMeshVolumeByPolygon
- *  crop에 사용된 폴리곤(마커)들의 3D 중심점을 기준으로,
- *  해당 meshId의 메쉬 (이미 crop된 상태)를 대상으로 부피를 계산한다.
- *
- *  - (A) 폴리곤(마커) 중심점 = 모든 마커 x,y,z 평균
- *  - (B) 위 점을 기준점 c로 하여, 삼각형 테트라볼륨을 누적 계산
- *
- * @param meshId : pointClouds_에 등록된 메쉬 ID
- * @return 계산된 부피 (양수)
- */
-double Scene::calculateMeshVolume(int meshId)
+void Scene::setVolumeMode(VolumeMode mode, float heightMapCellSize)
 {
-    totalVolume = 0.0;
-    // (1) pointClouds_에서 대상 메쉬 찾기
-    auto iter = pointClouds_.find(meshId);
-    if(iter == pointClouds_.end())
+    // Values from the UI, an invalid one keeps the previous setting
+    if(mode != kVolumeSurface && mode != kVolumeHeightMap)
+    {
+        UWARN("Invalid volume mode %d, keeping mode %d.", (int)mode, (int)volumeMode_);
+        mode = volumeMode_;
+    }
+    if(!(heightMapCellSize > 0.0f)) // NaN too
+    {
+        UWARN("Height map cell size (%f m) should be > 0, keeping %f m.", heightMapCellSize, heightMapCellSize_);
+        heightMapCellSize = heightMapCellSize_;
+    }
+    if(volumeMode_ != mode || heightMapCellSize_ != heightMapCellSize)
     {
-        UERROR("calculateMeshVolumeByPolygon() -> Cannot find mesh with id=%d", meshId);
-        return 0.0;
+        LOGI("Volume mode=%d, height map cell size=%f m", (int)mode, heightMapCellSize);
+        volumeMode_ = mode;
+        heightMapCellSize_ = heightMapCellSize;
+        ++cropRevision_;
+        ++meshRevision_;
     }
-    PointCloudDrawable * drawable = iter->second;
-    if(!drawable->hasMesh())
+}
+
+void Scene::setVolumeCapping(bool enabled)
+{
+    if(volumeCapping_ != enabled)
     {
-        UERROR("calculateMeshVolumeByPolygon() -> This drawable (id=%d) has no mesh!", meshId);
-        return 0.0;
+        LOGI("Volume capping=%s", enabled?"true":"false");
+        volumeCapping_ = enabled;
+        ++cropRevision_;
+        ++roiRevision_;
     }
+}
 
-    // (2) crop된(업데이트된) 메쉬 가져오기
-    rtabmap::Mesh mesh = drawable->getMesh();
-    if(mesh.polygons.empty())
+void Scene::setCropRegion(const CropRegion & region)
+{
+    LOGI("Crop region: %d primitives", (int)region.primitives().size());
     {
-        UWARN("calculateMeshVolumeByPolygon() -> mesh has no polygons (id=%d).", meshId);
-        return 0.0;
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        cropRegion_ = region;
+        cropRegionEmpty_ = region.empty();
     }
+    ++cropRevision_;
+}
 
-    // (3) Scene 좌표계로 변환
-    //     - drawable 자체 pose * mesh.pose
-    rtabmap::Transform meshToScene = rtabmap::Transform::getIdentity();
-    if(!drawable->getPose().isNull() && !mesh.pose.isNull())
+void Scene::setPileSeparation(bool enabled, int minTriangles, float weldDistance)
+{
+    // Values from the UI, clamped instead of asserted
+    if(enabled && minTriangles < 0)
+    {
+        UWARN("Pile separation: min triangles (%d) should be >= 0, using 0.", minTriangles);
+        minTriangles = 0;
+    }
+    if(!(weldDistance >= 0.0f)) // NaN too
     {
-        meshToScene = drawable->getPose() * mesh.pose;
+        UWARN("Pile separation: weld distance (%f m) should be >= 0, using 0.", weldDistance);
+        weldDistance = 0.0f;
     }
-    else if(!mesh.pose.isNull())
+    int pileMinTriangles = enabled?minTriangles:-1;
+    if(pileMinTriangles_ != pileMinTriangles || pileWeldDistance_ != weldDistance)
     {
-        meshToScene = mesh.pose;
+        LOGI("Pile separation=%s, min triangles=%d, weld distance=%f m", enabled?"true":"false", minTriangles, weldDistance);
+        pileMinTriangles_ = pileMinTriangles;
+        pileWeldDistance_ = weldDistance;
+        ++cropRevision_;
     }
-    Eigen::Affine3f meshToSceneEigen = meshToScene.toEigen3f();
+}
 
-    // (4) 메쉬 정점을 Scene 좌표로 변환
-    std::vector<pcl::PointXYZ> sceneVertices;
-    sceneVertices.reserve(mesh.cloud->size());
+std::vector<MeshComponents::Component> Scene::getPiles(bool waitJob)
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    while(waitJob && volumeJobRunning_)
+    {
+        volumeCondition_.wait(lock);
+    }
+    return croppedPiles_;
+}
 
-    for(size_t i=0; i<mesh.cloud->size(); ++i)
+//Should only be called in OpenGL thread!
+void Scene::setCutFillOverlay(const rtabmap::Mesh & mesh)
+{
+    delete cutFillOverlay_;
+    cutFillOverlay_ = 0;
+    if(mesh.cloud.get() && !mesh.cloud->empty() && !mesh.polygons.empty())
     {
-        const pcl::PointXYZRGB & ptLocal = mesh.cloud->at(i);
+        cutFillOverlay_ = new PointCloudDrawable(mesh);
+        cutFillOverlay_->setPose(rtabmap::Transform::getIdentity());
+        LOGI("Cut/fill overlay: %d vertices, %d polygons", (int)mesh.cloud->size(), (int)mesh.polygons.size());
+    }
+}
 
-        // PointXYZRGB로 먼저 변환
-        pcl::PointXYZRGB ptColored = pcl::transformPoint(ptLocal, meshToSceneEigen);
+void Scene::setGroundSeeds(const std::vector<GroundReference::Seed> & seeds)
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    groundSeeds_ = seeds;
+}
 
-        // x,y,z만 사용
-        pcl::PointXYZ ptScene;
-        ptScene.x = ptColored.x;
-        ptScene.y = ptColored.y;
-        ptScene.z = ptColored.z;
-        
-        sceneVertices.push_back(ptScene);
+void Scene::setGroundParameters(const GroundReference::Parameters & parameters)
+{
+    // written so that NaN values are rejected too
+    if(!(parameters.band >= 0.0f && parameters.inlierDistance > 0.0f && parameters.maxPoints > 0))
+    {
+        UERROR("Invalid ground reference parameters (band=%f m, inlier distance=%f m, max points=%d), keeping the previous ones.",
+                parameters.band, parameters.inlierDistance, parameters.maxPoints);
+        return;
     }
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        if(groundParameters_ == parameters)
+        {
+            return;
+        }
+        groundParameters_ = parameters;
+        groundCache_.clear();
+    }
+    LOGI("Ground reference: band=%f m, inlier distance=%f m, max slope=%f deg, iterations=%d, quadratic=%s",
+            parameters.band, parameters.inlierDistance, parameters.maxSlope, parameters.iterations, parameters.quadratic?"true":"false");
+    ++cropRevision_;
+    ++roiRevision_;
+}
 
-    // (5) 폴리곤(마커) 중심점(Scene 좌표계) 구하기
-    pcl::PointXYZ polyCentroid = computeMarkerPolygonCentroid();
-
-    // (6) 모든 삼각형에 대해, polyCentroid를 기준점 c로 하는 테트라볼륨 누적
-    for(const auto & polygon : mesh.polygons)
+bool Scene::getGroundSurface(GroundReference::Surface & surface, const std::string & roi) const
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    std::map<GroundKey, GroundCache>::const_iterator iter = groundCache_.find(GroundKey(kGroundMeshes, roi));
+    if(iter != groundCache_.end() &&
+       (!roi.empty() ||
+        (iter->second.polygon.size() == markerPoses_.size() &&
+         std::equal(markerPoses_.begin(), markerPoses_.end(), iter->second.polygon.begin()))))
     {
-        if(polygon.vertices.size() < 3) continue;
+        surface = iter->second.surface;
+        return true;
+    }
+    return false;
+}
+
+GroundReference::Surface Scene::groundSurface(
+        const GroundKey & key,
+        const std::vector<rtabmap::Transform> & polygon,
+        unsigned int meshRevision,
+        const std::function<void(GroundReference &)> & addSamples)
+{
+    std::vector<GroundReference::Seed> seeds;
+    GroundReference::Parameters parameters;
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        std::map<GroundKey, GroundCache>::const_iterator iter = groundCache_.find(key);
+        if(iter != groundCache_.end() &&
+           iter->second.meshRevision == meshRevision &&
+           iter->second.parameters == groundParameters_ &&
+           iter->second.polygon.size() == polygon.size() &&
+           std::equal(polygon.begin(), polygon.end(), iter->second.polygon.begin()))
+        {
+            return iter->second.surface;
+        }
+        seeds = groundSeeds_;
+        parameters = groundParameters_;
+    }
+
+    UTimer time;
+    std::vector<Eigen::Vector3f> markers(polygon.size());
+    for(size_t i=0; i<polygon.size(); ++i)
+    {
+        markers[i] = Eigen::Vector3f(polygon[i].x(), polygon[i].y(), polygon[i].z());
+    }
+    GroundReference reference(markers, parameters);
+    addSamples(reference);
+    GroundCache cache;
+    cache.polygon = polygon;
+    cache.meshRevision = meshRevision;
+    cache.parameters = parameters;
+    cache.surface = reference.fit(seeds);
+    LOGI("Ground of \"%s\" (%s): model=%d, plane=(%f, %f, %f), inliers=%d/%d, rmse=%f m, seeded=%s (%d seeds): %fs",
+            key.second.c_str(), key.first==kGroundHeightMap?"height map":"meshes", (int)cache.surface.model,
+            cache.surface.plane[0], cache.surface.plane[1], cache.surface.plane[2],
+            cache.surface.inliers, cache.surface.samples, cache.surface.rmse,
+            cache.surface.seeded?"true":"false", (int)seeds.size(), time.ticks());
+
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    groundCache_[key] = cache;
+    return cache.surface;
+}
 
-        for(size_t i=1; i+1<polygon.vertices.size(); ++i)
+GroundReference::Surface Scene::groundSurface(
+        const std::string & roi,
+        const std::vector<rtabmap::Transform> & polygon,
+        unsigned int meshRevision,
+        const std::map<int, MeshSnapshot> & meshes)
+{
+    return groundSurface(GroundKey(kGroundMeshes, roi), polygon, meshRevision, [&meshes](GroundReference & reference) {
+        for(std::map<int, MeshSnapshot>::const_iterator iter=meshes.begin(); iter!=meshes.end(); ++iter)
         {
-            int i0 = polygon.vertices[0];
-            int i1 = polygon.vertices[i];
-            int i2 = polygon.vertices[i+1];
-            if( i0<0 || i1<0 || i2<0 ||
-                i0>=int(sceneVertices.size()) ||
-                i1>=int(sceneVertices.size()) ||
-                i2>=int(sceneVertices.size()) )
+            rtabmap::Transform meshToScene = MeshVolume::meshToScene(iter->second.mesh, iter->second.pose);
+            Eigen::Vector2f min, max;
+            MeshCrop::boundsXZ(iter->second.aabbMin, iter->second.aabbMax, meshToScene, min, max);
+            if(iter->second.mesh.cloud.get() && reference.overlaps(min, max))
             {
-                continue;
+                reference.addPoints(*iter->second.mesh.cloud, meshToScene);
+            }
+        }
+    });
+}
+
+Eigen::Vector3f Scene::groundApex(const GroundReference::Surface & surface, const std::vector<rtabmap::Transform> & polygon)
+{
+    pcl::PointXYZ centroid = computePolygonCentroid(polygon);
+    return Eigen::Vector3f(centroid.x, surface.height(centroid.x, centroid.z), centroid.z);
+}
+
+bool Scene::getVolumeUncertaintyNodes(
+        std::vector<VolumeUncertainty::Node> & nodes,
+        Eigen::Vector3f & reference,
+        GroundReference::Surface & ground) const
+{
+    nodes.clear();
+    if(volumeMode_ != kVolumeSurface || !polygonClosed_ || markerPoses_.size() < 3)
+    {
+        return false;
+    }
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    if(croppedRevision_ != cropRevision_)
+    {
+        return false;
+    }
+    reference = croppedReference_;
+    ground = croppedGround_;
+    for(std::map<int, MeshVolume::Moments>::const_iterator iter=croppedMoments_.begin(); iter!=croppedMoments_.end(); ++iter)
+    {
+        std::map<int, PointCloudDrawable*>::const_iterator jter = pointClouds_.find(iter->first);
+        std::map<int, rtabmap::Mesh>::const_iterator kter = originalMeshes_.find(iter->first);
+        if(jter != pointClouds_.end() && kter != originalMeshes_.end())
+        {
+            VolumeUncertainty::Node node;
+            node.moments = iter->second;
+            node.drawablePose = jter->second->getPose();
+            node.meshPose = kter->second.pose;
+            std::map<int, cv::Mat>::const_iterator lter = nodeCovariances_.find(iter->first);
+            if(lter != nodeCovariances_.end())
+            {
+                node.covariance = lter->second;
+            }
+            std::map<int, MeshCapping::Boundary>::const_iterator mter = croppedBoundaries_.find(iter->first);
+            if(mter != croppedBoundaries_.end())
+            {
+                node.boundary = mter->second;
             }
+            nodes.push_back(node);
+        }
+    }
+    return true;
+}
 
-            const pcl::PointXYZ & v0 = sceneVertices[i0];
-            const pcl::PointXYZ & v1 = sceneVertices[i1];
-            const pcl::PointXYZ & v2 = sceneVertices[i2];
+bool Scene::getVolumeSolverInputs(
+        const std::string & roi,
+        std::vector<rtabmap::Mesh> & meshes,
+        std::vector<rtabmap::Transform> & meshToScene,
+        std::vector<Eigen::Vector2f> & polygon,
+        Eigen::Vector3f & plane) const
+{
+    meshes.clear();
+    meshToScene.clear();
+    polygon.clear();
+    std::vector<rtabmap::Transform> markers;
+    if(roi.empty())
+    {
+        if(!polygonClosed_ || markerPoses_.size() < 3)
+        {
+            return false;
+        }
+        markers = markerPoses_;
+    }
+    else
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        std::map<std::string, std::vector<rtabmap::Transform> >::const_iterator iter = rois_.find(roi);
+        if(iter == rois_.end())
+        {
+            return false;
+        }
+        markers = iter->second;
+    }
 
-            Eigen::Vector3f vec0(v0.x - polyCentroid.x,
-                                 v0.y - polyCentroid.y,
-                                 v0.z - polyCentroid.z);
-            Eigen::Vector3f vec1(v1.x - polyCentroid.x,
-                                 v1.y - polyCentroid.y,
-                                 v1.z - polyCentroid.z);
-            Eigen::Vector3f vec2(v2.x - polyCentroid.x,
-                                 v2.y - polyCentroid.y,
-                                 v2.z - polyCentroid.z);
+    std::vector<Eigen::Vector3f> points(markers.size());
+    for(size_t i=0; i<markers.size(); ++i)
+    {
+        points[i] = Eigen::Vector3f(markers[i].x(), markers[i].y(), markers[i].z());
+        polygon.push_back(Eigen::Vector2f(markers[i].x(), markers[i].z()));
+    }
+    GroundReference::Surface ground;
+    plane = getGroundSurface(ground, roi)?ground.plane:HeightMap::fitPlane(points);
 
-            Eigen::Vector3f crossVal = vec0.cross(vec1);
-            double signedVolume = crossVal.dot(vec2) / 6.0;
-            totalVolume += std::fabs(signedVolume);
+    MeshCrop crop(markers);
+    std::map<int, MeshSnapshot> snapshots = snapshotMeshes();
+    for(std::map<int, MeshSnapshot>::iterator iter=snapshots.begin(); iter!=snapshots.end(); ++iter)
+    {
+        rtabmap::Transform t = MeshVolume::meshToScene(iter->second.mesh, iter->second.pose);
+        Eigen::Vector2f min, max;
+        MeshCrop::boundsXZ(iter->second.aabbMin, iter->second.aabbMax, t, min, max);
+        if(!iter->second.mesh.polygons.empty() && crop.classify(min, max) >= 0)
+        {
+            meshes.push_back(iter->second.mesh);
+            meshToScene.push_back(t);
         }
     }
-    return totalVolume;
+    return true;
 }
 
-/**
- * @brief Scene::computeMarkerPolygonCentroid
- *  crop에 사용된 폴리곤(마커들)의 x,y,z 평균점을 구한다.
- *  - polygonClosed_ 등이 true/false이든, markerPoses_만 있으면 계산 가능
- * @return centroid (pcl::PointXYZ). 마커가 없으면 (0,0,0)
- */
-pcl::PointXYZ Scene::computeMarkerPolygonCentroid() const
+bool Scene::isVolumeJobRunning() const
 {
-    pcl::PointXYZ centroid(0.0f, 0.0f, 0.0f);
-    if(markerPoses_.empty())
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    return volumeJobRunning_;
+}
+
+//Should only be called in OpenGL thread!
+void Scene::startVolumeJob()
+{
+    if(volumeThread_)
     {
-        return centroid;
+        volumeThread_->join();
+        delete volumeThread_;
+        volumeThread_ = 0;
     }
 
-    for(const auto & pose : markerPoses_)
+    std::map<int, MeshSnapshot> meshes = snapshotMeshes();
+    volumeJobRevision_ = cropRevision_;
+    CropRegion region;
     {
-        centroid.x += pose.x();
-        centroid.y += pose.y();
-        centroid.z += pose.z();
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        volumeJobRunning_ = true;
+        region = cropRegion_;
     }
-    centroid.x /= float(markerPoses_.size());
-    centroid.y /= float(markerPoses_.size());
-    centroid.z /= float(markerPoses_.size());
+    LOGI("Starting crop/volume job (revision=%d, meshes=%d)", (int)volumeJobRevision_, (int)meshes.size());
+    volumeThread_ = new boost::thread(&Scene::volumeJob, this, volumeJobRevision_, markerPoses_, meshes, volumeMode_, pileMinTriangles_, pileWeldDistance_, volumeCapping_, region, (unsigned int)meshRevision_);
+}
 
-    return centroid;
+// Worker thread
+void Scene::volumeJob(
+        unsigned int revision,
+        std::vector<rtabmap::Transform> polygon,
+        std::map<int, MeshSnapshot> meshes,
+        VolumeMode mode,
+        int pileMinTriangles,
+        float pileWeldDistance,
+        bool capping,
+        CropRegion region,
+        unsigned int meshRevision)
+{
+    UTimer time;
+    std::map<int, std::vector<pcl::Vertices> > polygons;
+    std::map<int, PolygonMask> masks;
+    std::map<int, MeshVolume::VertexArrays> vertices;
+    std::vector<MeshVolume::Input> inputs;
+    std::vector<int> inputIds;
+    std::vector<std::vector<int> > inputKept; // original indices of the cropped polygons
+    MeshCrop crop(polygon);
+    if(!region.empty())
+    {
+        region.add(CropRegion::prism(polygon, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max()));
+    }
+
+    // Meshes outside the polygon are rejected on their bounds, the
+    // vertices are converted only once for both resolutions, the crop and
+    // the volume.
+    std::vector<std::pair<std::map<int, MeshSnapshot>::iterator, int> > candidates; // with region class
+    bool hasLowRes = false;
+    for(std::map<int, MeshSnapshot>::iterator iter=meshes.begin();
+        iter!=meshes.end() && revision == cropRevision_;
+        ++iter)
+    {
+        const rtabmap::Mesh & mesh = iter->second.mesh;
+        rtabmap::Transform meshToScene = MeshVolume::meshToScene(mesh, iter->second.pose);
+        masks[iter->first] = PolygonMask(std::vector<int>(), mesh.polygons.size());
+
+        Eigen::Vector2f min, max;
+        MeshCrop::boundsXZ(iter->second.aabbMin, iter->second.aabbMax, meshToScene, min, max);
+        if(crop.classify(min, max) < 0)
+        {
+            continue;
+        }
+        int regionClass = 1;
+        if(!region.empty())
+        {
+            // Whole meshes inside or outside the primitives don't need their BVH
+            const Eigen::Affine3f t = meshToScene.toEigen3f();
+            const Eigen::Vector3f center = t * ((iter->second.aabbMin + iter->second.aabbMax) * 0.5f);
+            const Eigen::Vector3f halfSize = t.linear().cwiseAbs() * ((iter->second.aabbMax - iter->second.aabbMin) * 0.5f);
+            regionClass = region.classify(center - halfSize, center + halfSize);
+            if(regionClass < 0)
+            {
+                continue;
+            }
+        }
+        vertices.insert(std::make_pair(iter->first, MeshVolume::VertexArrays(*mesh.cloud)));
+        candidates.push_back(std::make_pair(iter, regionClass));
+        hasLowRes = hasLowRes || !mesh.polygonsLowRes.empty();
+    }
+
+    // Tetra apex on the ground under the polygon centroid
+    GroundReference::Surface ground;
+    Eigen::Vector3f reference = Eigen::Vector3f::Zero();
+    if(revision == cropRevision_)
+    {
+        ground = groundSurface("", polygon, meshRevision, meshes);
+        reference = groundApex(ground, polygon);
+    }
+
+    // Progressive volume: the low resolution polygons are cropped and
+    // integrated first (full resolution for meshes without them), then
+    // reported right away. Pile separation is done on the full resolution only.
+    bool previewPublished = false;
+    double previewVolume = 0.0;
+    if(revision == cropRevision_ && mode == kVolumeSurface && hasLowRes)
+    {
+        std::list<std::vector<pcl::Vertices> > lowResPolygons;
+        std::vector<MeshVolume::Input> lowResInputs;
+        for(size_t i=0; i<candidates.size() && revision == cropRevision_; ++i)
+        {
+            const MeshSnapshot & snapshot = candidates[i].first->second;
+            const MeshVolume::VertexArrays & v = vertices.at(candidates[i].first->first);
+            rtabmap::Transform meshToScene = MeshVolume::meshToScene(snapshot.mesh, snapshot.pose);
+            lowResPolygons.push_back(snapshot.mesh.polygonsLowRes.empty()?snapshot.mesh.polygons.get():snapshot.mesh.polygonsLowRes.get());
+            int count = candidates[i].second > 0?
+                    crop.crop(v, meshToScene, lowResPolygons.back(), &snapshot.aabbMin, &snapshot.aabbMax):
+                    region.crop(v, meshToScene, lowResPolygons.back());
+            if(count)
+            {
+                lowResInputs.push_back(MeshVolume::Input(&v, &lowResPolygons.back(), meshToScene));
+            }
+        }
+        MeshVolume::Stats lowResStats = MeshVolume::compute(lowResInputs, reference);
+        if(capping)
+        {
+            std::vector<MeshCapping::Boundary> boundaries = MeshCapping::extract(lowResInputs);
+            for(size_t i=0; i<lowResInputs.size(); ++i)
+            {
+                lowResStats.signedVolume += MeshCapping::signedVolume(boundaries[i], lowResInputs[i].pose, ground, reference);
+            }
+        }
+        previewVolume = std::fabs(lowResStats.signedVolume);
+
+        std::function<void(double)> callback;
+        {
+            boost::mutex::scoped_lock lock(volumeMutex_);
+            if(revision == cropRevision_)
+            {
+                previewStats_ = lowResStats;
+                previewRevision_ = revision;
+                callback = volumeCallback_;
+                previewPublished = true;
+            }
+        }
+        volumeCondition_.notify_all();
+        if(previewPublished)
+        {
+            LOGI("Crop/volume job preview (revision=%d): volume=%f m^3, triangles=%d: %fs",
+                    (int)revision, previewVolume, lowResStats.triangles, time.elapsed());
+            if(callback)
+            {
+                callback(previewVolume);
+            }
+        }
+    }
+
+    std::map<int, std::shared_ptr<const TriangleBvh> > builtBvhs;
+    for(size_t i=0; i<candidates.size() && revision == cropRevision_; ++i)
+    {
+        const int id = candidates[i].first->first;
+        const MeshSnapshot & snapshot = candidates[i].first->second;
+        const rtabmap::Mesh & mesh = snapshot.mesh;
+        rtabmap::Transform meshToScene = MeshVolume::meshToScene(mesh, snapshot.pose);
+        const MeshVolume::VertexArrays & v = vertices.at(id);
+        std::vector<pcl::Vertices> & cropped = polygons[id];
+        cropped = mesh.polygons.get(); // cropped in place, copy the shared polygons
+        std::vector<int> kept;
+        int count = 0;
+        if(candidates[i].second > 0)
+        {
+            count = crop.crop(v, meshToScene, cropped, &snapshot.aabbMin, &snapshot.aabbMax, &kept);
+        }
+        else
+        {
+            std::shared_ptr<const TriangleBvh> bvh = snapshot.bvh;
+            if(bvh.get() == 0)
+            {
+                bvh.reset(new TriangleBvh(v, mesh.polygons));
+                builtBvhs.insert(std::make_pair(id, bvh));
+            }
+            count = region.crop(v, *bvh, meshToScene, cropped, &kept);
+        }
+        if(count)
+        {
+            masks[id] = PolygonMask(kept, mesh.polygons.size());
+            inputs.push_back(MeshVolume::Input(&v, &cropped, meshToScene));
+            inputIds.push_back(id);
+            inputKept.push_back(std::vector<int>());
+            inputKept.back().swap(kept);
+        }
+    }
+    if(!builtBvhs.empty())
+    {
+        size_t memory = 0;
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        if(meshRevision == meshRevision_)
+        {
+            for(std::map<int, std::shared_ptr<const TriangleBvh> >::iterator iter=builtBvhs.begin(); iter!=builtBvhs.end(); ++iter)
+            {
+                BvhCache & cache = bvhCache_[iter->first];
+                cache.mesh = meshes.at(iter->first).mesh;
+                cache.bvh = iter->second;
+                memory += iter->second->memoryUsed();
+            }
+        }
+        LOGI("Built %d mesh BVHs (%ld bytes)", (int)builtBvhs.size(), (long)memory);
+    }
+    double cropTime = time.ticks();
+
+    // All meshes are integrated in a single parallel pass
+    MeshVolume::Stats stats;
+    std::vector<MeshVolume::Moments> moments;
+    std::vector<MeshComponents::Component> piles;
+    std::vector<std::vector<int> > labels;
+    if(revision == cropRevision_ && pileMinTriangles >= 0)
+    {
+        // Debris is removed from the crop, only the piles are integrated
+        piles = MeshComponents::compute(
+                inputs,
+                reference,
+                pileWeldDistance,
+                pileMinTriangles,
+                &labels,
+                &moments);
+        for(size_t i=0; i<piles.size(); ++i)
+        {
+            stats += piles[i].stats;
+        }
+        for(size_t i=0; i<inputs.size(); ++i)
+        {
+            std::vector<int> kept;
+            for(size_t j=0; j<labels[i].size(); ++j)
+            {
+                if(labels[i][j] >= 0)
+                {
+                    kept.push_back(inputKept[i][j]);
+                }
+            }
+            PolygonMask & mask = masks[inputIds[i]];
+            mask = PolygonMask(kept, mask.size());
+        }
+        LOGI("Pile separation: %d piles (min %d triangles, weld %f m): %fs",
+                (int)piles.size(), pileMinTriangles, pileWeldDistance, time.ticks());
+    }
+    else if(revision == cropRevision_)
+    {
+        stats = MeshVolume::compute(inputs, reference, &moments);
+    }
+
+    // Close the cropped polygons down to the ground, the walls and caps of
+    // a loop are added to its pile
+    std::map<int, MeshCapping::Boundary> boundaries;
+    if(revision == cropRevision_ && capping)
+    {
+        std::vector<MeshCapping::Boundary> loops = MeshCapping::extract(inputs, labels.empty()?0:&labels);
+        int count = 0;
+        int edges = 0;
+        int open = 0;
+        for(size_t i=0; i<inputs.size(); ++i)
+        {
+            const Eigen::Affine3d meshToScene = inputs[i].pose.toEigen3d();
+            for(size_t j=0; j<loops[i].size(); ++j)
+            {
+                const MeshCapping::Loop & loop = loops[i][j];
+                double v = MeshCapping::signedVolume(loop, meshToScene, ground, reference.cast<double>());
+                stats.signedVolume += v;
+                if(loop.label >= 0 && loop.label < (int)piles.size())
+                {
+                    piles[loop.label].stats.signedVolume += v;
+                }
+                ++count;
+                edges += (int)loop.points.size();
+                open += loop.closed?0:1;
+            }
+            if(!loops[i].empty())
+            {
+                boundaries[inputIds[i]].swap(loops[i]);
+            }
+        }
+        LOGI("Capping: %d loops (%d not closed), %d edges: %fs", count, open, edges, time.ticks());
+    }
+
+    std::function<void(double)> callback;
+    std::function<void(double, double)> refinedCallback;
+    bool published = false;
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        if(revision == cropRevision_)
+        {
+            croppedMasks_.swap(masks);
+            croppedRevision_ = revision;
+            croppedStats_ = stats;
+            croppedPiles_.swap(piles);
+            croppedReference_ = reference;
+            croppedBoundaries_.swap(boundaries);
+            croppedGround_ = ground;
+            croppedMoments_.clear();
+            for(size_t i=0; i<moments.size(); ++i)
+            {
+                croppedMoments_.insert(std::make_pair(inputIds[i], moments[i]));
+            }
+            callback = volumeCallback_;
+            refinedCallback = previewPublished?volumeRefinedCallback_:std::function<void(double, double)>();
+            published = true;
+        }
+        volumeJobRunning_ = false;
+    }
+    volumeCondition_.notify_all();
+
+    if(published)
+    {
+        LOGI("Crop/volume job done (revision=%d): volume=%f m^3, area=%f m^2, footprint=%f m^2, max height=%f m, "
+                "triangles=%d, meshes=%d, crop=%fs, volume=%fs",
+                (int)revision, std::fabs(stats.signedVolume), stats.area, stats.footprint, stats.maxHeight,
+                stats.triangles, (int)meshes.size(), cropTime, time.ticks());
+        if(callback && mode == kVolumeSurface)
+        {
+            callback(std::fabs(stats.signedVolume));
+        }
+        if(refinedCallback && mode == kVolumeSurface)
+        {
+            refinedCallback(std::fabs(stats.signedVolume), std::fabs(stats.signedVolume) - previewVolume);
+        }
+    }
+    else
+    {
+        LOGI("Crop/volume job outdated (revision=%d), dropped after %fs", (int)revision, time.ticks());
+    }
+}
+
+//Should only be called in OpenGL thread!
+void Scene::applyVolumeJobResult()
+{
+    CropState state;
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        if(croppedRevision_ != cropRevision_ || croppedAppliedRevision_ == croppedRevision_)
+        {
+            return;
+        }
+        if(isCropPreviewActive() && cropCommitRevision_ != croppedRevision_)
+        {
+            // previewed in shaders until committed
+            return;
+        }
+        state.masks.swap(croppedMasks_);
+        state.stats = croppedStats_;
+        state.moments = croppedMoments_;
+        state.piles = croppedPiles_;
+        state.reference = croppedReference_;
+        state.boundaries = croppedBoundaries_;
+        state.ground = croppedGround_;
+        croppedAppliedRevision_ = croppedRevision_;
+    }
+
+    // Only the index buffers are uploaded, the vertices are not modified
+    UTimer time;
+    for(std::map<int, PolygonMask>::iterator iter=state.masks.begin(); iter!=state.masks.end(); ++iter)
+    {
+        std::map<int, PointCloudDrawable*>::iterator jter = pointClouds_.find(iter->first);
+        if(jter != pointClouds_.end() && jter->second->hasMesh())
+        {
+            jter->second->cropPolygons(iter->second.indices());
+        }
+    }
+    cropUploaded_ = true;
+    LOGI("Crop uploaded (revision=%d, meshes=%d): %fs", (int)croppedAppliedRevision_, (int)state.masks.size(), time.ticks());
+
+    state.markerIds = markerOrder_;
+    state.markerPoses = markerPoses_;
+    pushCropState(state);
+}
+
+//Should only be called in OpenGL thread!
+void Scene::pushCropState(const CropState & state)
+{
+    if(cropHistoryIndex_ >= 0 && cropHistoryRevision_ == croppedAppliedRevision_)
+    {
+        // crop of a restored state done again (meshes changed)
+        cropHistory_[cropHistoryIndex_] = state;
+    }
+    else
+    {
+        cropHistory_.erase(cropHistory_.begin()+(cropHistoryIndex_+1), cropHistory_.end());
+        cropHistory_.push_back(state);
+        if(cropHistory_.size() > 32)
+        {
+            cropHistory_.pop_front();
+        }
+        cropHistoryIndex_ = (int)cropHistory_.size()-1;
+    }
+    cropHistoryRevision_ = croppedAppliedRevision_;
+
+    size_t memory = 0;
+    for(size_t i=0; i<cropHistory_.size(); ++i)
+    {
+        for(std::map<int, PolygonMask>::const_iterator iter=cropHistory_[i].masks.begin(); iter!=cropHistory_[i].masks.end(); ++iter)
+        {
+            memory += iter->second.memoryUsed();
+        }
+    }
+    LOGI("Crop history: %d/%d states, masks=%ld bytes", cropHistoryIndex_+1, (int)cropHistory_.size(), (long)memory);
+}
+
+//Should only be called in OpenGL thread!
+void Scene::stepCropHistory(int steps)
+{
+    if(cropHistory_.empty())
+    {
+        return;
+    }
+    bool edited = cropHistoryRevision_ != cropRevision_;
+    int index = cropHistoryIndex_ + steps;
+    if(steps < 0 && edited)
+    {
+        // first undo discards the edits since the last crop
+        ++index;
+    }
+    index = std::max(-1, std::min(index, (int)cropHistory_.size()-1));
+    if(index != cropHistoryIndex_ || edited)
+    {
+        restoreCropState(index);
+    }
+}
+
+//Should only be called in OpenGL thread!
+void Scene::restoreCropState(int index)
+{
+    UASSERT(index >= -1 && index < (int)cropHistory_.size());
+    LOGI("Restoring crop %d/%d", index+1, (int)cropHistory_.size());
+
+    cancelVolumeJob();
+    while (!markers_.empty())
+    {
+        std::map<int, tango_gl::Axis*>::iterator iter = markers_.begin();
+        delete iter->second;
+        markers_.erase(iter);
+    }
+    markerOrder_.clear();
+    markerPoses_.clear();
+    polygonClosed_ = false;
+
+    bool valid = false;
+    if(index >= 0)
+    {
+        const CropState & state = cropHistory_[index];
+        for(size_t i=0; i<state.markerIds.size(); ++i)
+        {
+            addMarker2(state.markerIds[i], state.markerPoses[i]);
+        }
+        polygonClosed_ = true;
+        ++cropRevision_;
+
+        // The masks are valid only if the meshes did not change since
+        valid = true;
+        for(std::map<int, PointCloudDrawable*>::iterator iter=pointClouds_.begin(); valid && iter!=pointClouds_.end(); ++iter)
+        {
+            std::map<int, rtabmap::Mesh>::const_iterator jter = originalMeshes_.find(iter->first);
+            if(iter->second->hasMesh() && jter != originalMeshes_.end())
+            {
+                std::map<int, PolygonMask>::const_iterator kter = state.masks.find(iter->first);
+                valid = kter != state.masks.end() && kter->second.size() == jter->second.polygons.size();
+            }
+        }
+        if(valid)
+        {
+            for(std::map<int, PolygonMask>::const_iterator iter=state.masks.begin(); iter!=state.masks.end(); ++iter)
+            {
+                std::map<int, PointCloudDrawable*>::iterator jter = pointClouds_.find(iter->first);
+                if(jter != pointClouds_.end() && jter->second->hasMesh())
+                {
+                    jter->second->cropPolygons(iter->second.indices());
+                }
+            }
+            cropUploaded_ = true;
+
+            boost::mutex::scoped_lock lock(volumeMutex_);
+            croppedMasks_.clear();
+            croppedStats_ = state.stats;
+            croppedMoments_ = state.moments;
+            croppedPiles_ = state.piles;
+            croppedReference_ = state.reference;
+            croppedBoundaries_ = state.boundaries;
+            croppedGround_ = state.ground;
+            croppedRevision_ = cropRevision_;
+            croppedAppliedRevision_ = cropRevision_;
+            volumeJobRevision_ = cropRevision_;
+            // volume updated from the moments with the current poses
+            croppedPosesChanged_ = true;
+        }
+        else
+        {
+            LOGW("Meshes changed since crop %d, cropping again", index+1);
+        }
+    }
+    else
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        croppedMasks_.clear();
+        croppedMoments_.clear();
+        croppedBoundaries_.clear();
+        croppedPiles_.clear();
+        croppedStats_ = MeshVolume::Stats();
+        previewStats_ = MeshVolume::Stats();
+        heightMapRoi_.clear();
+        heightMapStats_ = HeightMap::Stats();
+    }
+    if(!valid)
+    {
+        uncropMeshes();
+    }
+    // no need to commit the restored crop again
+    cropCommitRevision_ = (unsigned int)cropRevision_;
+    cropHistoryIndex_ = index;
+    cropHistoryRevision_ = cropRevision_;
+}
+
+bool Scene::isCropPreviewActive() const
+{
+    // The shaders only discard outside the marker polygon, the crop
+    // primitives and the pile separation are in the job mask only
+    return cropPreview_ &&
+           polygonClosed_ &&
+           markerPoses_.size() >= 3 &&
+           markerPoses_.size() <= (size_t)PointCloudDrawable::kMaxCropPolygonSize &&
+           cropRegionEmpty_ &&
+           pileMinTriangles_ < 0;
+}
+
+//Should only be called in OpenGL thread!
+void Scene::uncropMeshes(bool createWireframe)
+{
+    for(std::map<int, PointCloudDrawable*>::iterator iter=pointClouds_.begin(); iter!=pointClouds_.end(); ++iter)
+    {
+        if(iter->second->isCropped())
+        {
+            iter->second->uncropPolygons(createWireframe);
+        }
+    }
+    cropUploaded_ = false;
+}
+
+void Scene::setCropPreview(bool enabled)
+{
+    if(cropPreview_ != enabled)
+    {
+        LOGI("Crop preview=%s", enabled?"true":"false");
+        cropPreview_ = enabled;
+    }
+}
+
+void Scene::commitCrop()
+{
+    LOGI("Commit crop (revision=%d)", (int)cropRevision_);
+    cropCommitRevision_ = cropRevision_;
+}
+
+//Should only be called in OpenGL thread!
+void Scene::updateCroppedVolumeFromPoses()
+{
+    double volume = 0.0;
+    int nodes = 0;
+    std::function<void(double)> callback;
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        if(croppedRevision_ != cropRevision_)
+        {
+            // Wait for the crop job of the current revision
+            return;
+        }
+        // O(nodes): moments are in mesh frame, only the poses changed.
+        // The ground is the one of the crop.
+        const Eigen::Vector3f reference = croppedReference_;
+        double signedVolume = 0.0;
+        for(std::map<int, MeshVolume::Moments>::iterator iter=croppedMoments_.begin(); iter!=croppedMoments_.end(); ++iter)
+        {
+            std::map<int, PointCloudDrawable*>::iterator jter = pointClouds_.find(iter->first);
+            std::map<int, rtabmap::Mesh>::iterator kter = originalMeshes_.find(iter->first);
+            if(jter != pointClouds_.end() && kter != originalMeshes_.end())
+            {
+                rtabmap::Transform meshToScene = MeshVolume::meshToScene(kter->second, jter->second->getPose());
+                signedVolume += iter->second.signedVolume(meshToScene, reference);
+                std::map<int, MeshCapping::Boundary>::iterator lter = croppedBoundaries_.find(iter->first);
+                if(lter != croppedBoundaries_.end())
+                {
+                    signedVolume += MeshCapping::signedVolume(lter->second, meshToScene, croppedGround_, reference);
+                }
+            }
+        }
+        croppedStats_.signedVolume = signedVolume;
+        volume = std::fabs(signedVolume);
+        nodes = (int)croppedMoments_.size();
+        if(volumeMode_ == kVolumeSurface)
+        {
+            callback = volumeCallback_;
+        }
+    }
+    croppedPosesChanged_ = false;
+    LOGI("Volume updated from moments after pose changes: %f m^3 (%d nodes)", volume, nodes);
+    if(callback)
+    {
+        callback(volume);
+    }
+}
+
+void Scene::cancelVolumeJob()
+{
+    ++cropRevision_;
+    if(volumeThread_)
+    {
+        volumeThread_->join();
+        delete volumeThread_;
+        volumeThread_ = 0;
+    }
+}
+
+std::map<int, Scene::MeshSnapshot> Scene::snapshotMeshes() const
+{
+    // Snapshot of the original (uncropped) meshes: the clouds and polygons
+    // are shared with the scene, nothing is copied.
+    std::map<int, MeshSnapshot> meshes;
+    for(std::map<int, PointCloudDrawable*>::const_iterator iter=pointClouds_.begin(); iter!=pointClouds_.end(); ++iter)
+    {
+        std::map<int, rtabmap::Mesh>::const_iterator jter = originalMeshes_.find(iter->first);
+        if(iter->second->hasMesh() && jter != originalMeshes_.end())
+        {
+            MeshSnapshot & snapshot = meshes[iter->first];
+            snapshot.mesh = jter->second;
+            snapshot.pose = iter->second->getPose();
+            snapshot.aabbMin = Eigen::Vector3f(iter->second->aabbMinModel().x, iter->second->aabbMinModel().y, iter->second->aabbMinModel().z);
+            snapshot.aabbMax = Eigen::Vector3f(iter->second->aabbMaxModel().x, iter->second->aabbMaxModel().y, iter->second->aabbMaxModel().z);
+        }
+    }
+
+    // BVHs built on the same cloud and polygons
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    for(std::map<int, BvhCache>::const_iterator iter=bvhCache_.begin(); iter!=bvhCache_.end(); ++iter)
+    {
+        std::map<int, MeshSnapshot>::iterator jter = meshes.find(iter->first);
+        if(jter != meshes.end() &&
+           jter->second.mesh.cloud.get() == iter->second.mesh.cloud.get() &&
+           &jter->second.mesh.polygons.get() == &iter->second.mesh.polygons.get())
+        {
+            jter->second.bvh = iter->second.bvh;
+        }
+    }
+    return meshes;
+}
+
+bool Scene::isHeightMapJobRunning() const
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    return heightMapJobRunning_;
+}
+
+//Should only be called in OpenGL thread!
+void Scene::startHeightMapJob()
+{
+    if(heightMapThread_)
+    {
+        heightMapThread_->join();
+        delete heightMapThread_;
+        heightMapThread_ = 0;
+    }
+
+    // Reuse the height map if the meshes didn't change, only the
+    // ground and the volume of the polygon are updated
+    std::shared_ptr<const HeightMapPyramid> pyramid;
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        if(heightMapPyramidRevision_ == meshRevision_)
+        {
+            pyramid = heightMapPyramid_;
+        }
+        heightMapJobRunning_ = true;
+    }
+    std::map<int, MeshSnapshot> meshes;
+    if(pyramid.get() == 0)
+    {
+        meshes = snapshotMeshes();
+    }
+    heightMapJobRevision_ = meshRevision_;
+    heightMapJobCropRevision_ = cropRevision_;
+    LOGI("Starting height map job (revision=%d, crop revision=%d, meshes=%d)",
+            (int)heightMapJobRevision_, (int)heightMapJobCropRevision_, (int)meshes.size());
+    heightMapThread_ = new boost::thread(&Scene::heightMapJob, this,
+            heightMapJobRevision_, heightMapJobCropRevision_, meshes, pyramid, markerPoses_, heightMapCellSize_);
+}
+
+// Worker thread
+void Scene::heightMapJob(
+        unsigned int revision,
+        unsigned int cropRevision,
+        std::map<int, MeshSnapshot> meshes,
+        std::shared_ptr<const HeightMapPyramid> pyramid,
+        std::vector<rtabmap::Transform> polygon,
+        float cellSize)
+{
+    UTimer time;
+    if(pyramid.get() == 0)
+    {
+        std::list<MeshVolume::VertexArrays> vertices;
+        std::vector<MeshVolume::Input> inputs;
+        for(std::map<int, MeshSnapshot>::iterator iter=meshes.begin(); iter!=meshes.end(); ++iter)
+        {
+            const rtabmap::Mesh & mesh = iter->second.mesh;
+            if(!mesh.polygons.empty())
+            {
+                vertices.push_back(MeshVolume::VertexArrays(*mesh.cloud));
+                inputs.push_back(MeshVolume::Input(&vertices.back(), &mesh.polygons.get(), MeshVolume::meshToScene(mesh, iter->second.pose)));
+            }
+        }
+
+        Eigen::Vector2f min, max;
+        if(revision == meshRevision_ && HeightMap::bounds(inputs, min, max))
+        {
+            HeightMap heightMap;
+            heightMap.create(min, max, cellSize, 1024);
+            heightMap.addMeshes(inputs);
+            pyramid.reset(new HeightMapPyramid(heightMap));
+            LOGI("Height map job done (revision=%d): %dx%d cells of %f m, %d levels, meshes=%d, time=%fs",
+                    (int)revision, heightMap.cols(), heightMap.rows(), heightMap.cellSize(), pyramid->levels(), (int)inputs.size(), time.ticks());
+        }
+    }
+
+    // Query the polygon from the pyramid, the ground is sampled on the
+    // cells around the polygon if not cached
+    std::vector<Eigen::Vector2f> roi(polygon.size());
+    for(size_t i=0; i<polygon.size(); ++i)
+    {
+        roi[i] = Eigen::Vector2f(polygon[i].x(), polygon[i].z());
+    }
+    GroundReference::Surface ground;
+    HeightMap::Stats stats;
+    bool queried = false;
+    if(pyramid.get() && revision == meshRevision_ && cropRevision == cropRevision_)
+    {
+        ground = groundSurface(GroundKey(kGroundHeightMap, ""), polygon, revision, [&pyramid](GroundReference & reference) {
+            std::vector<Eigen::Vector3f> cells;
+            pyramid->cells(reference.min(), reference.max(), cells);
+            reference.addPoints(cells);
+        });
+        // quadratic ground too, the pyramid keeps the second order sums
+        stats = pyramid->volume(ground.quadratic(), ground.center, roi);
+        stats.maxHeight = pyramid->maxHeight(ground.quadratic(), ground.center, roi);
+        queried = true;
+        LOGI("Height map volume: %f m^3, footprint=%f m^2, max height=%f m (%fs)",
+                stats.netVolume, stats.footprint, stats.maxHeight, time.ticks());
+    }
+
+    std::function<void(double)> callback;
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        if(revision == meshRevision_)
+        {
+            heightMapPyramid_ = pyramid;
+            heightMapPyramidRevision_ = revision;
+            if(queried && cropRevision == cropRevision_)
+            {
+                heightMapRoi_ = roi;
+                heightMapGround_ = ground;
+                heightMapStats_ = stats;
+                heightMapStatsRevision_ = cropRevision;
+                callback = volumeCallback_;
+            }
+        }
+        heightMapJobRunning_ = false;
+    }
+    volumeCondition_.notify_all();
+    if(callback)
+    {
+        callback(stats.netVolume);
+    }
+}
+
+void Scene::cancelHeightMapJob()
+{
+    ++meshRevision_;
+    if(heightMapThread_)
+    {
+        heightMapThread_->join();
+        delete heightMapThread_;
+        heightMapThread_ = 0;
+    }
+}
+
+bool Scene::addRoi(const std::string & name)
+{
+    if(!polygonClosed_ || markerPoses_.size() < 3)
+    {
+        UWARN("Cannot add ROI \"%s\", the marker polygon is not closed.", name.c_str());
+        return false;
+    }
+    return setRoi(name, markerPoses_);
+}
+
+bool Scene::setRoi(const std::string & name, const std::vector<rtabmap::Transform> & polygon)
+{
+    UASSERT(polygon.size() >= 3);
+    if(name.empty())
+    {
+        UWARN("Cannot add ROI without name.");
+        return false;
+    }
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        if(rois_.find(name) == rois_.end() && (int)rois_.size() >= kMaxRois)
+        {
+            UWARN("Cannot add ROI \"%s\", maximum %d ROIs.", name.c_str(), kMaxRois);
+            return false;
+        }
+        rois_[name] = polygon;
+        ++roiRevision_;
+    }
+    LOGI("ROI \"%s\" set (%d markers)", name.c_str(), (int)polygon.size());
+    return true;
+}
+
+void Scene::removeRoi(const std::string & name)
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    if(name.empty())
+    {
+        for(std::map<std::string, std::vector<rtabmap::Transform> >::iterator iter=rois_.begin(); iter!=rois_.end(); ++iter)
+        {
+            groundCache_.erase(GroundKey(kGroundMeshes, iter->first));
+        }
+        rois_.clear();
+    }
+    else
+    {
+        rois_.erase(name);
+        groundCache_.erase(GroundKey(kGroundMeshes, name));
+    }
+    roiStats_.clear();
+    ++roiRevision_;
+}
+
+std::map<std::string, MeshVolume::Stats> Scene::getRoiVolumeStats(bool waitJob)
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    while(waitJob && roiJobRunning_)
+    {
+        volumeCondition_.wait(lock);
+    }
+    return roiStats_;
+}
+
+bool Scene::isRoiJobRunning() const
+{
+    boost::mutex::scoped_lock lock(volumeMutex_);
+    return roiJobRunning_;
+}
+
+//Should only be called in OpenGL thread!
+void Scene::startRoiJob()
+{
+    if(roiThread_)
+    {
+        roiThread_->join();
+        delete roiThread_;
+        roiThread_ = 0;
+    }
+
+    roiJobRevision_ = roiRevision_;
+    roiJobMeshRevision_ = meshRevision_;
+    std::map<std::string, std::vector<rtabmap::Transform> > rois;
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        rois = rois_;
+        if(rois.empty())
+        {
+            roiStats_.clear();
+            return;
+        }
+        roiJobRunning_ = true;
+    }
+    std::map<int, MeshSnapshot> meshes = snapshotMeshes();
+    LOGI("Starting ROI job (revision=%d, rois=%d, meshes=%d)", (int)roiJobRevision_, (int)rois.size(), (int)meshes.size());
+    roiThread_ = new boost::thread(&Scene::roiJob, this, roiJobRevision_, roiJobMeshRevision_, rois, meshes, volumeCapping_);
+}
+
+// Worker thread
+void Scene::roiJob(
+        unsigned int revision,
+        unsigned int meshRevision,
+        std::map<std::string, std::vector<rtabmap::Transform> > rois,
+        std::map<int, MeshSnapshot> meshes,
+        bool capping)
+{
+    UTimer time;
+    std::vector<MeshCrop> crops;
+    std::vector<GroundReference::Surface> grounds;
+    std::vector<Eigen::Vector3f> references;
+    crops.reserve(rois.size());
+    for(std::map<std::string, std::vector<rtabmap::Transform> >::iterator iter=rois.begin();
+        iter!=rois.end() && revision == roiRevision_ && meshRevision == meshRevision_;
+        ++iter)
+    {
+        crops.push_back(MeshCrop(iter->second));
+        grounds.push_back(groundSurface(iter->first, iter->second, meshRevision, meshes));
+        references.push_back(groundApex(grounds.back(), iter->second));
+    }
+    double groundTime = time.ticks();
+
+    std::list<MeshVolume::VertexArrays> vertices;
+    std::list<std::vector<pcl::Vertices> > polygons;
+    std::vector<MeshVolume::Input> inputs;
+    std::vector<int> groups;
+    std::vector<unsigned int> masks;
+    for(std::map<int, MeshSnapshot>::iterator iter=meshes.begin();
+        iter!=meshes.end() && revision == roiRevision_ && meshRevision == meshRevision_;
+        ++iter)
+    {
+        const rtabmap::Mesh & mesh = iter->second.mesh;
+        rtabmap::Transform meshToScene = MeshVolume::meshToScene(mesh, iter->second.pose);
+
+        // Only the ROIs overlapping the bounds of the mesh are tested
+        Eigen::Vector2f min, max;
+        MeshCrop::boundsXZ(iter->second.aabbMin, iter->second.aabbMax, meshToScene, min, max);
+        std::vector<const MeshCrop*> overlapping;
+        std::vector<int> overlappingIds;
+        for(size_t k=0; k<crops.size(); ++k)
+        {
+            if(crops[k].classify(min, max) >= 0)
+            {
+                overlapping.push_back(&crops[k]);
+                overlappingIds.push_back((int)k);
+            }
+        }
+        if(overlapping.empty() || mesh.polygons.empty())
+        {
+            continue;
+        }
+
+        vertices.push_back(MeshVolume::VertexArrays(*mesh.cloud));
+        MeshCrop::classifyVertices(overlapping, vertices.back(), meshToScene, masks);
+
+        // A polygon is in the ROIs of all its vertices
+        std::vector<std::vector<pcl::Vertices> > roiPolygons(overlapping.size());
+        const std::vector<pcl::Vertices> & meshPolygons = mesh.polygons;
+        for(size_t i=0; i<meshPolygons.size(); ++i)
+        {
+            const std::vector<uint32_t> & v = meshPolygons[i].vertices;
+            unsigned int bits = v.empty()?0:~0u;
+            for(size_t j=0; j<v.size() && bits; ++j)
+            {
+                bits &= v[j] < masks.size()?masks[v[j]]:0;
+            }
+            for(size_t k=0; bits; ++k, bits>>=1)
+            {
+                if(bits & 1)
+                {
+                    roiPolygons[k].push_back(meshPolygons[i]);
+                }
+            }
+        }
+        for(size_t k=0; k<roiPolygons.size(); ++k)
+        {
+            if(!roiPolygons[k].empty())
+            {
+                polygons.push_back(std::vector<pcl::Vertices>());
+                polygons.back().swap(roiPolygons[k]);
+                inputs.push_back(MeshVolume::Input(&vertices.back(), &polygons.back(), meshToScene));
+                groups.push_back(overlappingIds[k]);
+            }
+        }
+    }
+    double classifyTime = time.ticks();
+
+    std::vector<MeshVolume::Stats> stats;
+    if(revision == roiRevision_ && meshRevision == meshRevision_)
+    {
+        stats = MeshVolume::compute(inputs, groups, references);
+        if(capping)
+        {
+            std::vector<MeshCapping::Boundary> boundaries = MeshCapping::extract(inputs);
+            for(size_t i=0; i<inputs.size(); ++i)
+            {
+                stats[groups[i]].signedVolume += MeshCapping::signedVolume(boundaries[i], inputs[i].pose, grounds[groups[i]], references[groups[i]]);
+            }
+        }
+    }
+
+    bool published = false;
+    {
+        boost::mutex::scoped_lock lock(volumeMutex_);
+        if(revision == roiRevision_ && meshRevision == meshRevision_)
+        {
+            roiStats_.clear();
+            int k = 0;
+            for(std::map<std::string, std::vector<rtabmap::Transform> >::iterator iter=rois.begin(); iter!=rois.end(); ++iter, ++k)
+            {
+                roiStats_.insert(std::make_pair(iter->first, stats[k]));
+            }
+            published = true;
+        }
+        roiJobRunning_ = false;
+    }
+    volumeCondition_.notify_all();
+
+    if(published)
+    {
+        LOGI("ROI job done (revision=%d): rois=%d, meshes=%d, inputs=%d, ground=%fs, classify=%fs, volume=%fs",
+                (int)revision, (int)rois.size(), (int)meshes.size(), (int)inputs.size(), groundTime, classifyTime, time.ticks());
+    }
+    else
+    {
+        LOGI("ROI job outdated (revision=%d), dropped after %fs", (int)revision, time.ticks());
+    }
+}
+
+void Scene::cancelRoiJob()
+{
+    ++roiRevision_;
+    if(roiThread_)
+    {
+        roiThread_->join();
+        delete roiThread_;
+        roiThread_ = 0;
+    }
 }
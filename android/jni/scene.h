@@ -22,8 +22,20 @@
 #endif
 #include <memory>
 #include <set>
+#include <deque>
+#include <string>
+#include <atomic>
+#include <functional>
 
 #include "CameraMobile.h"
+#include "mesh_volume.h"
+#include "height_map.h"
+#include "mesh_crop.h"
+#include "mesh_components.h"
+#include "mesh_capping.h"
+#include "crop_region.h"
+#include "volume_uncertainty.h"
+#include "ground_reference.h"
 #include <tango-gl/axis.h>
 #include <tango-gl/camera.h>
 #include <tango-gl/color.h>
@@ -45,9 +57,18 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
 // Scene provides OpenGL drawable objects and renders them for visualization.
 class Scene {
  public:
+  enum VolumeMode {
+    kVolumeSurface = 0,  // tetra sum of the cropped surface with the marker centroid as apex
+    kVolumeHeightMap = 1 // 2.5D height map of all meshes integrated above the ground reference (plane or quadratic)
+  };
+
   // Constructor and destructor.
   Scene();
   ~Scene();
@@ -168,13 +189,255 @@ class Scene {
         float x,
         float y,
         const std::vector<std::pair<float,float>> & polygon);
-    void filterMeshInsidePolygon(
+    static void filterMeshInsidePolygon(
         const std::vector<rtabmap::Transform> & polygon2D,
         rtabmap::Mesh & mesh,
                                         const rtabmap::Transform & drawablePose);
-    double calculateMeshVolume(int meshId);
+    static double computeMeshVolume(
+        const rtabmap::Mesh & mesh,
+        const rtabmap::Transform & drawablePose,
+        const pcl::PointXYZ & reference);
     pcl::PointXYZ computeMarkerPolygonCentroid() const;
-    
+    static pcl::PointXYZ computePolygonCentroid(const std::vector<rtabmap::Transform> & polygon);
+
+    // Crop/volume job: once the marker polygon is closed, meshes are cropped
+    // and their volume integrated on a worker thread. The job is restarted
+    // only when markers or meshes change. Cloud pose changes (e.g., after
+    // a loop closure) keep the crop and re-evaluate the signed volume from
+    // the cached surface moments of each node, so footprint and max height
+    // are the ones of the last crop. The callback is called from the worker
+    // thread or the OpenGL thread.
+    // In height map mode, a height map pyramid of all (uncropped) meshes is
+    // rebuilt on a worker thread only when meshes or poses change, and the
+    // volume of the marker polygon is queried from it by the same job on
+    // every marker change (live volume while markers are moved).
+    void setVolumeCallback(const std::function<void(double)> & callback);
+    // Progressive volume: in surface mode, if the meshes have low resolution
+    // polygons, the volume of the low resolution crop is reported first
+    // through the volume callback, then the full resolution volume. The
+    // refined callback is called after the full resolution volume with the
+    // difference from the low resolution one (from the worker thread).
+    void setVolumeRefinedCallback(const std::function<void(double, double)> & callback);
+    void setVolumeMode(VolumeMode mode, float heightMapCellSize = 0.02f);
+    VolumeMode getVolumeMode() const {return volumeMode_;}
+    bool isPolygonClosed() const {return polygonClosed_;}
+    const std::vector<rtabmap::Transform> & getMarkerPolygon() const {return markerPoses_;}
+    // -1 if there is no volume for the current crop: polygon not closed,
+    // or the job for the last change is not started yet (it is started on
+    // the next rendered frame).
+    double getCroppedVolume(bool waitJob = false);
+    // If current is set, it tells if the stats are the ones of the current
+    // crop (see getCroppedVolume()), otherwise the last ones are returned.
+    MeshVolume::Stats getCroppedVolumeStats(bool waitJob = false, bool * current = 0);
+    // Full resolution volume if available, otherwise the low resolution
+    // one (-1 if none). If waitJob is true, wait only for the first of both.
+    double getCroppedVolumePreview(bool waitJob = false);
+    bool isVolumeJobRunning() const;
+
+    // Crop preview: while the polygon is edited, the meshes are drawn
+    // uncropped and the fragments outside the polygon are discarded in the
+    // shaders. The index buffers of the cropped meshes are uploaded only
+    // on commitCrop() (or when the job is done if preview is disabled or
+    // the polygon has more than PointCloudDrawable::kMaxCropPolygonSize
+    // markers). The shaders only test the marker polygon, so the preview
+    // is not used with crop primitives (setCropRegion()) or pile
+    // separation: the mask of the volume job is uploaded instead, so the
+    // meshes shown are the ones measured. The double-tap depth pick draws
+    // the same cropped set as the display.
+    void setCropPreview(bool enabled);
+    bool isCropPreview() const {return cropPreview_;}
+    void commitCrop();
+
+    // Crop history: each crop uploaded to the meshes is kept as one bit per
+    // polygon with its markers and volume. Undo/redo restore them without
+    // cropping again (done on next render). The first undo after the
+    // markers were edited returns to the last crop.
+    void undoCrop() {--cropHistoryRequest_;}
+    void redoCrop() {++cropHistoryRequest_;}
+
+    // Named ROIs, measured together without cropping the meshes. All ROIs
+    // are evaluated on a worker thread in a single pass: each vertex is
+    // classified against all ROIs at once, a polygon belongs to the ROIs
+    // of all its vertices and the volumes of all ROIs are integrated in
+    // the same parallel pass. The job is restarted when ROIs, meshes or
+    // poses change. The volume of each ROI is relative to its own ground
+    // reference, like the cropped volume.
+    static const int kMaxRois = 32;
+    bool addRoi(const std::string & name); // closed marker polygon, replaces ROI with same name
+    bool setRoi(const std::string & name, const std::vector<rtabmap::Transform> & polygon);
+    void removeRoi(const std::string & name); // all ROIs if name is empty
+    std::map<std::string, MeshVolume::Stats> getRoiVolumeStats(bool waitJob = false);
+
+    // Pile separation: the cropped polygons of all meshes are split in
+    // connected components (meshes of different nodes are connected where
+    // their boundary vertices are closer than weldDistance). Components
+    // with less than minTriangles triangles (debris) are removed from the
+    // crop and not integrated. Volume, footprint and height of each pile are
+    // those of the last crop job. Negative values are clamped to 0.
+    void setPileSeparation(bool enabled, int minTriangles = 100, float weldDistance = 0.02f);
+    std::vector<MeshComponents::Component> getPiles(bool waitJob = false);
+
+    // Capping (see MeshCapping): the boundary loops of the cropped polygons
+    // of each mesh (of each pile with pile separation, of each ROI) are
+    // closed down to the ground reference, so the surface volume is the
+    // one of a closed solid and doesn't depend on the tetra apex. Enabled
+    // by default.
+    void setVolumeCapping(bool enabled);
+
+    // Crop primitives (see CropRegion) intersected with the marker polygon
+    // crop, e.g. a floor and a ceiling, a box to remove or a wall side.
+    // The meshes are then cropped through a triangle BVH per drawable,
+    // built on first use and kept until the mesh changes. An empty region
+    // crops with the marker polygon only.
+    void setCropRegion(const CropRegion & region);
+
+    // Cut/fill overlay (see CutFill::overlayMesh()), drawn over the clouds
+    // without being cropped or measured. Kept on clear(), an empty mesh
+    // removes it. Should only be called in OpenGL thread!
+    void setCutFillOverlay(const rtabmap::Mesh & mesh);
+
+    // Ground reference (see GroundReference): the ground of the marker
+    // polygon and of each ROI is fitted on the meshes around their boundary
+    // (separately on the height map cells for the height map volume), seeded
+    // with the planes detected by the AR session, and cached per ROI until
+    // its polygon, the meshes or the parameters change. The surface volumes use the point of
+    // the ground under the polygon centroid as tetra apex, the height map
+    // volumes use its plane. New seeds are used on the next fit only.
+    void setGroundSeeds(const std::vector<GroundReference::Seed> & seeds);
+    // Invalid parameters (band < 0, inlier distance <= 0) are ignored.
+    void setGroundParameters(const GroundReference::Parameters & parameters);
+    // Ground fitted on the meshes. roi: name of the ROI, empty for the
+    // marker polygon. Returns false if it is not fitted yet (on the current
+    // markers for the marker polygon).
+    bool getGroundSurface(GroundReference::Surface & surface, const std::string & roi = "") const;
+
+    // Inputs of the Monte Carlo volume uncertainty (see VolumeUncertainty):
+    // the local moments and boundary loops of the last crop with its ground
+    // reference, the current poses of their nodes and their covariances.
+    // The covariance of a node is the mean of the covariances of its links
+    // in the graph (see updateGraph()). Returns
+    // false if the crop job is not done or in height map mode. Should only
+    // be called in OpenGL thread (or with rendering locked)!
+    bool getVolumeUncertaintyNodes(
+            std::vector<VolumeUncertainty::Node> & nodes,
+            Eigen::Vector3f & reference,
+            GroundReference::Surface & ground) const;
+
+    // Inputs of the adaptive resolution volume (see HeightMap::solve): the
+    // original meshes overlapping the polygon (x/z) of the ROI (empty for
+    // the closed marker polygon) with their mesh to scene transforms, and
+    // the plane of its ground (fitted on the markers if the ground is not
+    // fitted yet, the least squares plane for a quadratic ground). Returns false if the ROI doesn't exist. Should only be
+    // called in OpenGL thread (or with rendering locked)!
+    bool getVolumeSolverInputs(
+            const std::string & roi,
+            std::vector<rtabmap::Mesh> & meshes,
+            std::vector<rtabmap::Transform> & meshToScene,
+            std::vector<Eigen::Vector2f> & polygon,
+            Eigen::Vector3f & plane) const;
+
+ private:
+    // Mesh given to the worker jobs
+    struct MeshSnapshot {
+        rtabmap::Mesh mesh;      // original (uncropped) mesh
+        rtabmap::Transform pose; // drawable pose
+        Eigen::Vector3f aabbMin; // bounds of the cloud (mesh frame)
+        Eigen::Vector3f aabbMax;
+        std::shared_ptr<const TriangleBvh> bvh; // null if not built yet
+    };
+
+    // BVH of the polygons of a mesh, valid while the mesh is the same
+    struct BvhCache {
+        rtabmap::Mesh mesh; // keeps the cloud and polygons it was built on
+        std::shared_ptr<const TriangleBvh> bvh;
+    };
+
+    // Crop uploaded to the meshes
+    struct CropState {
+        std::vector<int> markerIds;
+        std::vector<rtabmap::Transform> markerPoses;
+        std::map<int, PolygonMask> masks;
+        MeshVolume::Stats stats;
+        std::map<int, MeshVolume::Moments> moments;
+        std::vector<MeshComponents::Component> piles;
+        Eigen::Vector3f reference; // tetra apex on the ground
+        std::map<int, MeshCapping::Boundary> boundaries;
+        GroundReference::Surface ground;
+    };
+
+    // Samples of a cached ground. The marker polygon has one ground fitted on
+    // the mesh vertices and one on the cells of the height map, each checked
+    // against the revision of its own samples.
+    enum GroundSource {
+        kGroundMeshes,
+        kGroundHeightMap
+    };
+    typedef std::pair<GroundSource, std::string> GroundKey; // <source, ROI name or empty for the marker polygon>
+
+    struct GroundCache {
+        std::vector<rtabmap::Transform> polygon;
+        unsigned int meshRevision;
+        GroundReference::Parameters parameters;
+        GroundReference::Surface surface;
+    };
+
+    void startVolumeJob();
+    void volumeJob(
+        unsigned int revision,
+        std::vector<rtabmap::Transform> polygon,
+        std::map<int, MeshSnapshot> meshes,
+        VolumeMode mode,
+        int pileMinTriangles,
+        float pileWeldDistance,
+        bool capping,
+        CropRegion region,
+        unsigned int meshRevision);
+    void applyVolumeJobResult();
+    bool isCropPreviewActive() const;
+    void uncropMeshes(bool createWireframe = false);
+    void pushCropState(const CropState & state);
+    void stepCropHistory(int steps);
+    void restoreCropState(int index);
+    void updateCroppedVolumeFromPoses();
+    void cancelVolumeJob();
+    std::map<int, MeshSnapshot> snapshotMeshes() const;
+
+    // Cached ground of a polygon, addSamples() is called only if it has
+    // to be fitted. The second version samples the mesh vertices (key:
+    // ROI name, empty for the marker polygon).
+    GroundReference::Surface groundSurface(
+        const GroundKey & key,
+        const std::vector<rtabmap::Transform> & polygon,
+        unsigned int meshRevision,
+        const std::function<void(GroundReference &)> & addSamples);
+    GroundReference::Surface groundSurface(
+        const std::string & roi,
+        const std::vector<rtabmap::Transform> & polygon,
+        unsigned int meshRevision,
+        const std::map<int, MeshSnapshot> & meshes);
+    static Eigen::Vector3f groundApex(const GroundReference::Surface & surface, const std::vector<rtabmap::Transform> & polygon);
+
+    bool isHeightMapJobRunning() const;
+    void startHeightMapJob();
+    void heightMapJob(
+        unsigned int revision,
+        unsigned int cropRevision,
+        std::map<int, MeshSnapshot> meshes,
+        std::shared_ptr<const HeightMapPyramid> pyramid,
+        std::vector<rtabmap::Transform> polygon,
+        float cellSize);
+    void cancelHeightMapJob();
+
+    bool isRoiJobRunning() const;
+    void startRoiJob();
+    void roiJob(
+        unsigned int revision,
+        unsigned int meshRevision,
+        std::map<std::string, std::vector<rtabmap::Transform> > rois,
+        std::map<int, MeshSnapshot> meshes,
+        bool capping);
+    void cancelRoiJob();
+
  private:
   // Camera object that allows user to use touch input to interact with.
   tango_gl::GestureCamera* gesture_camera_;
@@ -191,9 +454,13 @@ class Scene {
   // Bounding box
   BoundingBoxDrawable * box_;
 
+  // Cut/fill difference map between two sessions (scene frame)
+  PointCloudDrawable * cutFillOverlay_;
+
   // Trace of pose data.
   tango_gl::Trace* trace_;
   GraphDrawable * graph_;
+  std::map<int, cv::Mat> nodeCovariances_; // from the links of the graph
   bool graphVisible_;
   bool gridVisible_;
   bool traceVisible_;
@@ -236,6 +503,67 @@ class Scene {
     float lineWidth_;
     bool polygonClosed_;
     std::map<int, rtabmap::Mesh> originalMeshes_;
+
+    boost::thread * volumeThread_;
+    mutable boost::mutex volumeMutex_;
+    boost::condition_variable volumeCondition_;
+    std::atomic<unsigned int> cropRevision_; // incremented when markers or meshes change
+    unsigned int volumeJobRevision_;         // revision of the last started job
+    bool volumeJobRunning_;
+    unsigned int croppedRevision_;           // revision of croppedMasks_/croppedStats_
+    unsigned int croppedAppliedRevision_;    // revision uploaded to drawables
+    std::map<int, PolygonMask> croppedMasks_; // kept polygons of the original meshes
+    bool cropPreview_;
+    bool cropUploaded_;                      // index buffers of the drawables are cropped
+    std::atomic<unsigned int> cropCommitRevision_; // cropRevision_ when commitCrop() was called
+    std::deque<CropState> cropHistory_;
+    int cropHistoryIndex_;                   // state shown, -1 for no crop
+    unsigned int cropHistoryRevision_;       // cropRevision_ when the state was shown
+    std::atomic<int> cropHistoryRequest_;    // undo (<0) or redo (>0) steps
+    MeshVolume::Stats croppedStats_;
+    std::map<int, MeshVolume::Moments> croppedMoments_; // local moments of the cropped polygons
+    std::vector<MeshComponents::Component> croppedPiles_;
+    Eigen::Vector3f croppedReference_;       // tetra apex of the crop
+    std::map<int, MeshCapping::Boundary> croppedBoundaries_; // boundary loops of the cropped polygons (if capped)
+    GroundReference::Surface croppedGround_; // ground of the crop, under the loops
+    bool volumeCapping_;
+    CropRegion cropRegion_;                  // protected by volumeMutex_
+    std::atomic<bool> cropRegionEmpty_;      // cropRegion_.empty(), read without the lock
+    std::map<int, BvhCache> bvhCache_;       // protected by volumeMutex_
+    int pileMinTriangles_;                   // pile separation disabled if < 0
+    float pileWeldDistance_;
+    bool croppedPosesChanged_;
+    std::function<void(double)> volumeCallback_;
+    std::function<void(double, double)> volumeRefinedCallback_;
+    MeshVolume::Stats previewStats_;         // low resolution crop
+    unsigned int previewRevision_;           // revision of previewStats_
+    VolumeMode volumeMode_;
+    float heightMapCellSize_;
+
+    boost::thread * heightMapThread_;
+    std::atomic<unsigned int> meshRevision_; // incremented when meshes or cloud poses change
+    unsigned int heightMapJobRevision_;      // revision of the last started height map job
+    unsigned int heightMapJobCropRevision_;  // cropRevision_ of the last started height map job
+    bool heightMapJobRunning_;
+    std::shared_ptr<const HeightMapPyramid> heightMapPyramid_;
+    unsigned int heightMapPyramidRevision_;  // meshRevision_ of heightMapPyramid_
+    std::vector<Eigen::Vector2f> heightMapRoi_;
+    GroundReference::Surface heightMapGround_;
+    HeightMap::Stats heightMapStats_;
+    unsigned int heightMapStatsRevision_;    // cropRevision_ of heightMapRoi_/heightMapStats_
+
+    std::map<std::string, std::vector<rtabmap::Transform> > rois_; // protected by volumeMutex_
+    std::atomic<unsigned int> roiRevision_;  // incremented when ROIs change
+    boost::thread * roiThread_;
+    unsigned int roiJobRevision_;            // roiRevision_ of the last started job
+    unsigned int roiJobMeshRevision_;        // meshRevision_ of the last started job
+    bool roiJobRunning_;
+    std::map<std::string, MeshVolume::Stats> roiStats_;
+
+    // protected by volumeMutex_
+    std::vector<GroundReference::Seed> groundSeeds_;
+    GroundReference::Parameters groundParameters_;
+    std::map<GroundKey, GroundCache> groundCache_;
 };
 
 #endif  // TANGO_POINT_CLOUD_SCENE_H_
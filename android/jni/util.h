@@ -36,6 +36,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl/point_types.h>
 #include <pcl/Vertices.h>
 #include <pcl/pcl_base.h>
+#include <memory>
+#include <vector>
 
 namespace rtabmap {
 
@@ -162,6 +164,83 @@ inline rtabmap::Transform glmToTransform(const glm::mat4 & mat)
 	return transform;
 }
 
+// Vector shared by all copies (copying is O(1)). All accessors are read
+// only, so reading a copy never copies the data, even if it is not const.
+// The data is replaced with operator=() or swap(), or edited in place with
+// edit(), which copies it first if it is shared (copy-on-write) so that a
+// copy never sees the edits of another. The meshes are copied to other
+// threads only from the OpenGL thread, so edit() should be called there
+// (under Scene::volumeMutex_ for the scene meshes): the data cannot be
+// shared again while it is edited, only released by the other threads.
+template<typename T, typename Alloc = std::allocator<T> >
+class SharedVector
+{
+public:
+	typedef std::vector<T, Alloc> Vector;
+	typedef typename Vector::value_type value_type;
+	typedef typename Vector::size_type size_type;
+	typedef typename Vector::const_reference const_reference;
+	typedef typename Vector::const_iterator const_iterator;
+
+	SharedVector() {}
+	SharedVector & operator=(const Vector & v) {data_ = std::make_shared<Vector>(v); return *this;}
+	SharedVector & operator=(Vector && v) {data_ = std::make_shared<Vector>(std::move(v)); return *this;}
+
+	const Vector & get() const {return data_.get()?*data_:empty_();}
+	operator const Vector &() const {return get();}
+	// Copy the data if shared, then give write access
+	Vector & edit()
+	{
+		if(data_.get() == 0)
+		{
+			data_ = std::make_shared<Vector>();
+		}
+		else if(data_.use_count() > 1)
+		{
+			data_ = std::make_shared<Vector>(*data_);
+		}
+		return *data_;
+	}
+
+	size_type size() const {return get().size();}
+	bool empty() const {return get().empty();}
+	const_reference operator[](size_type i) const {return get()[i];}
+	const_reference at(size_type i) const {return get().at(i);}
+	const_iterator begin() const {return get().begin();}
+	const_iterator end() const {return get().end();}
+
+	void clear() {data_.reset();}
+	void swap(SharedVector & other) {data_.swap(other.data_);}
+	// The content of v becomes the data without copy, v gets the previous
+	// data (copied only if still shared with other copies).
+	void swap(Vector & v)
+	{
+		std::shared_ptr<Vector> data = std::make_shared<Vector>();
+		data->swap(v);
+		if(data_.get())
+		{
+			if(data_.use_count() == 1)
+			{
+				v.swap(*data_);
+			}
+			else
+			{
+				v = *data_;
+			}
+		}
+		data_ = data;
+	}
+
+private:
+	static const Vector & empty_() {static const Vector v; return v;}
+
+private:
+	std::shared_ptr<Vector> data_;
+};
+
+// Copying a mesh is cheap: the cloud, normals, indices and texture are
+// shared pointers and the polygons and texture coordinates are shared
+// vectors, replaced as a whole or copied only when explicitly edited.
 class Mesh
 {
 public:
@@ -177,20 +256,32 @@ public:
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud; // organized cloud
 	pcl::PointCloud<pcl::Normal>::Ptr normals;
 	pcl::IndicesPtr indices;
-	std::vector<pcl::Vertices> polygons;
-	std::vector<pcl::Vertices> polygonsLowRes;
+	SharedVector<pcl::Vertices> polygons;
+	SharedVector<pcl::Vertices> polygonsLowRes;
 	rtabmap::Transform pose; // in rtabmap coordinates
 	bool visible;
 	rtabmap::CameraModel cameraModel;
 	double gains[3]; // RGB gains
 #if PCL_VERSION_COMPARE(>=, 1, 8, 0)
-    	std::vector<Eigen::Vector2f, Eigen::aligned_allocator<Eigen::Vector2f> > texCoords;
+    	SharedVector<Eigen::Vector2f, Eigen::aligned_allocator<Eigen::Vector2f> > texCoords;
 #else
-    	std::vector<Eigen::Vector2f> texCoords;
+    	SharedVector<Eigen::Vector2f> texCoords;
 #endif
 	cv::Mat texture;
 };
 
+// Allocate the image only if it doesn't have the right size and type or if
+// its data is shared (e.g., with a SensorData still in use), so the buffers
+// of the camera callbacks are recycled without overwriting a frame in flight.
+inline void createUnshared(cv::Mat & image, int rows, int cols, int type)
+{
+	if(image.rows != rows || image.cols != cols || image.type() != type ||
+	   (image.u && image.u->refcount > 1))
+	{
+		image = cv::Mat(rows, cols, type);
+	}
+}
+
 typedef enum {
   /// Not apply any rotation.
   ROTATION_IGNORED = -1,
@@ -0,0 +1,179 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "volume_uncertainty.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <Eigen/Geometry>
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+// Square root of a covariance: Cholesky factor, or the square root of the
+// diagonal if it is not positive definite.
+Matrix6d covarianceFactor(const cv::Mat & covariance)
+{
+	Matrix6d L = Matrix6d::Zero();
+	if(covariance.empty())
+	{
+		return L;
+	}
+	UASSERT(covariance.rows == 6 && covariance.cols == 6 && covariance.type() == CV_64FC1);
+	Matrix6d C;
+	for(int i=0; i<6; ++i)
+	{
+		for(int j=0; j<6; ++j)
+		{
+			C(i,j) = covariance.at<double>(i,j);
+		}
+	}
+	Eigen::LLT<Matrix6d> llt(C);
+	if(llt.info() == Eigen::Success)
+	{
+		L = llt.matrixL();
+	}
+	else
+	{
+		for(int i=0; i<6; ++i)
+		{
+			L(i,i) = std::sqrt(std::max(0.0, C(i,i)));
+		}
+	}
+	return L;
+}
+
+double percentile(const std::vector<double> & sorted, double p)
+{
+	if(sorted.empty())
+	{
+		return 0.0;
+	}
+	double index = p * double(sorted.size()-1);
+	size_t i = (size_t)index;
+	if(i+1 >= sorted.size())
+	{
+		return sorted.back();
+	}
+	double t = index - double(i);
+	return sorted[i]*(1.0-t) + sorted[i+1]*t;
+}
+
+} // namespace
+
+VolumeUncertainty::Stats VolumeUncertainty::estimate(
+		const std::vector<Node> & nodes,
+		const Eigen::Vector3f & reference,
+		const GroundReference::Surface & ground,
+		float referenceSigma,
+		int samples,
+		unsigned int seed)
+{
+	UASSERT(samples > 0 && referenceSigma >= 0.0f);
+	Stats stats;
+
+	std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d> > factors(nodes.size());
+	std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d> > drawablePoses(nodes.size());
+	std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d> > meshPoses(nodes.size());
+	const Eigen::Vector3d ref = reference.cast<double>();
+	double volume = 0.0;
+	for(size_t i=0; i<nodes.size(); ++i)
+	{
+		factors[i] = covarianceFactor(nodes[i].covariance);
+		drawablePoses[i] = nodes[i].drawablePose.isNull()?Eigen::Affine3d::Identity():nodes[i].drawablePose.toEigen3d();
+		meshPoses[i] = nodes[i].meshPose.isNull()?Eigen::Affine3d::Identity():nodes[i].meshPose.toEigen3d();
+		volume += nodes[i].moments.signedVolume(drawablePoses[i] * meshPoses[i], ref);
+		for(size_t j=0; j<nodes[i].boundary.size(); ++j)
+		{
+			volume += MeshCapping::signedVolume(nodes[i].boundary[j], drawablePoses[i] * meshPoses[i], ground, ref);
+		}
+	}
+	stats.volume = std::fabs(volume);
+
+	std::vector<double> volumes(samples);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int s=0; s<samples; ++s)
+	{
+		std::mt19937 generator(seed*7919u + (unsigned int)s);
+		std::normal_distribution<double> normal;
+		Eigen::Vector3d sampleReference = ref;
+		const double heightOffset = referenceSigma * normal(generator);
+		sampleReference[1] += heightOffset;
+		double sampleVolume = 0.0;
+		for(size_t i=0; i<nodes.size(); ++i)
+		{
+			Eigen::Affine3d pose = drawablePoses[i];
+			if(!factors[i].isZero())
+			{
+				Vector6d z;
+				for(int k=0; k<6; ++k)
+				{
+					z[k] = normal(generator);
+				}
+				Vector6d d = factors[i] * z;
+				pose = pose *
+						Eigen::Translation3d(d.head<3>()) *
+						Eigen::AngleAxisd(d[5], Eigen::Vector3d::UnitZ()) *
+						Eigen::AngleAxisd(d[4], Eigen::Vector3d::UnitY()) *
+						Eigen::AngleAxisd(d[3], Eigen::Vector3d::UnitX());
+			}
+			sampleVolume += nodes[i].moments.signedVolume(pose * meshPoses[i], sampleReference);
+			for(size_t j=0; j<nodes[i].boundary.size(); ++j)
+			{
+				sampleVolume += MeshCapping::signedVolume(nodes[i].boundary[j], pose * meshPoses[i], ground, sampleReference, heightOffset);
+			}
+		}
+		volumes[s] = std::fabs(sampleVolume);
+	}
+
+	double sum = 0.0;
+	for(int s=0; s<samples; ++s)
+	{
+		sum += volumes[s];
+	}
+	stats.samples = samples;
+	stats.mean = sum / double(samples);
+	double variance = 0.0;
+	for(int s=0; s<samples; ++s)
+	{
+		variance += (volumes[s]-stats.mean)*(volumes[s]-stats.mean);
+	}
+	stats.stdDev = samples>1?std::sqrt(variance / double(samples-1)):0.0;
+	std::sort(volumes.begin(), volumes.end());
+	stats.p5 = percentile(volumes, 0.05);
+	stats.p50 = percentile(volumes, 0.5);
+	stats.p95 = percentile(volumes, 0.95);
+	return stats;
+}
@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef VOLUME_UNCERTAINTY_H_
+#define VOLUME_UNCERTAINTY_H_
+
+#include <vector>
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+#include <rtabmap/core/Transform.h>
+#include "mesh_volume.h"
+#include "mesh_capping.h"
+#include "ground_reference.h"
+
+// Monte Carlo uncertainty of the cropped volume. The signed volume of a
+// node is affine in its pose and in the reference point (see
+// MeshVolume::Moments), so a sample costs O(nodes) without touching the
+// triangles. Each sample perturbs the node poses in their local frame with
+// their covariance and the height of the reference point (and of the ground
+// under the boundary loops when the crop is capped, see MeshCapping, which
+// adds O(boundary) per sample). Samples are
+// distributed over OpenMP threads, each one with its own random generator
+// so that the results don't depend on the number of threads.
+class VolumeUncertainty {
+public:
+	struct Node {
+		MeshVolume::Moments moments;     // local moments of the cropped polygons
+		rtabmap::Transform drawablePose; // scene frame
+		rtabmap::Transform meshPose;     // mesh to drawable (mesh.pose), identity if null
+		cv::Mat covariance;              // 6x6 CV_64FC1 (x, y, z, roll, pitch, yaw), node frame, not perturbed if empty
+		MeshCapping::Boundary boundary;  // loops of the cropped polygons (mesh frame), empty if not capped
+	};
+
+	struct Stats {
+		Stats() :
+			samples(0),
+			volume(0.0),
+			mean(0.0),
+			stdDev(0.0),
+			p5(0.0),
+			p50(0.0),
+			p95(0.0)
+		{}
+		int samples;
+		double volume; // without perturbation (m^3)
+		double mean;   // (m^3)
+		double stdDev; // (m^3)
+		double p5;     // percentiles (m^3)
+		double p50;
+		double p95;
+	};
+
+	// referenceSigma: standard deviation of the reference height (m), the
+	// ground of the boundary loops is shifted by the same amount.
+	static Stats estimate(
+			const std::vector<Node> & nodes,
+			const Eigen::Vector3f & reference,
+			const GroundReference::Surface & ground,
+			float referenceSigma = 0.0f,
+			int samples = 100,
+			unsigned int seed = 0);
+};
+
+#endif /* VOLUME_UNCERTAINTY_H_ */
@@ -0,0 +1,249 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include "yuv_to_bgr.h"
+#include "util.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <algorithm>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YUV_TO_BGR_NEON
+#endif
+
+namespace {
+
+// ITU-R BT.601, video range, 20 bits fixed-point (same as cv::cvtColor)
+const int kShift = 20;
+const int kHalf = 1 << (kShift - 1);
+const int kCY = 1220542;
+const int kCUB = 2116026;
+const int kCUG = -409993;
+const int kCVG = -852492;
+const int kCVR = 1673527;
+
+inline unsigned char clamp(int v)
+{
+	return (unsigned char)(v < 0?0:(v > 255?255:v));
+}
+
+inline void pixel(int y, int ruv, int guv, int buv, unsigned char * bgr)
+{
+	const int y00 = std::max(0, y - 16) * kCY;
+	bgr[0] = clamp((y00 + buv) >> kShift);
+	bgr[1] = clamp((y00 + guv) >> kShift);
+	bgr[2] = clamp((y00 + ruv) >> kShift);
+}
+
+inline void chroma(const unsigned char * uv, int uIndex, int & ruv, int & guv, int & buv)
+{
+	const int u = int(uv[uIndex]) - 128;
+	const int v = int(uv[1-uIndex]) - 128;
+	ruv = kHalf + kCVR * v;
+	guv = kHalf + kCVG * v + kCUG * u;
+	buv = kHalf + kCUB * u;
+}
+
+#ifdef YUV_TO_BGR_NEON
+struct ChromaTerms {
+	int32x4_t r[2];
+	int32x4_t g[2];
+	int32x4_t b[2];
+};
+
+// 8 chroma samples
+inline ChromaTerms chromaNeon(const uint8x8_t & u8, const uint8x8_t & v8)
+{
+	const int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), vdupq_n_s16(128));
+	const int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), vdupq_n_s16(128));
+	const int32x4_t half = vdupq_n_s32(kHalf);
+	ChromaTerms terms;
+	for(int i=0; i<2; ++i)
+	{
+		const int32x4_t u32 = vmovl_s16(i==0?vget_low_s16(u):vget_high_s16(u));
+		const int32x4_t v32 = vmovl_s16(i==0?vget_low_s16(v):vget_high_s16(v));
+		terms.r[i] = vmlaq_n_s32(half, v32, kCVR);
+		terms.g[i] = vmlaq_n_s32(vmlaq_n_s32(half, v32, kCVG), u32, kCUG);
+		terms.b[i] = vmlaq_n_s32(half, u32, kCUB);
+	}
+	return terms;
+}
+
+inline uint8x8_t channelNeon(const int32x4_t y00[2], const int32x4_t terms[2])
+{
+	const uint16x4_t low = vqmovun_s32(vshrq_n_s32(vaddq_s32(y00[0], terms[0]), kShift));
+	const uint16x4_t high = vqmovun_s32(vshrq_n_s32(vaddq_s32(y00[1], terms[1]), kShift));
+	return vqmovn_u16(vcombine_u16(low, high));
+}
+
+// 8 luma samples (16 bits) with their chroma terms
+inline uint8x8x3_t pixelsNeon(const uint16x8_t & y, const ChromaTerms & terms)
+{
+	const uint16x8_t y16 = vqsubq_u16(y, vdupq_n_u16(16));
+	int32x4_t y00[2];
+	y00[0] = vmulq_n_s32(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(y16))), kCY);
+	y00[1] = vmulq_n_s32(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(y16))), kCY);
+	uint8x8x3_t bgr;
+	bgr.val[0] = channelNeon(y00, terms.b);
+	bgr.val[1] = channelNeon(y00, terms.g);
+	bgr.val[2] = channelNeon(y00, terms.r);
+	return bgr;
+}
+#endif
+
+// Two luma rows and their chroma row at full resolution
+void convertRows(
+		const unsigned char * y0, const unsigned char * y1, const unsigned char * uv,
+		int width, int uIndex,
+		unsigned char * bgr0, unsigned char * bgr1)
+{
+	int x = 0;
+#ifdef YUV_TO_BGR_NEON
+	for(; x+16<=width; x+=16)
+	{
+		const uint8x8x2_t c = vld2_u8(uv + x);
+		const ChromaTerms terms = chromaNeon(c.val[uIndex], c.val[1-uIndex]);
+		const unsigned char * ys[2] = {y0, y1};
+		unsigned char * outs[2] = {bgr0, bgr1};
+		for(int k=0; k<2; ++k)
+		{
+			// even and odd pixels share their chroma sample
+			const uint8x8x2_t yy = vld2_u8(ys[k] + x);
+			const uint8x8x3_t even = pixelsNeon(vmovl_u8(yy.val[0]), terms);
+			const uint8x8x3_t odd = pixelsNeon(vmovl_u8(yy.val[1]), terms);
+			uint8x8x3_t first, second;
+			for(int j=0; j<3; ++j)
+			{
+				const uint8x8x2_t zipped = vzip_u8(even.val[j], odd.val[j]);
+				first.val[j] = zipped.val[0];
+				second.val[j] = zipped.val[1];
+			}
+			vst3_u8(outs[k] + x*3, first);
+			vst3_u8(outs[k] + x*3 + 24, second);
+		}
+	}
+#endif
+	for(; x<width; x+=2)
+	{
+		int ruv, guv, buv;
+		chroma(uv + x, uIndex, ruv, guv, buv);
+		pixel(y0[x], ruv, guv, buv, bgr0 + x*3);
+		pixel(y1[x], ruv, guv, buv, bgr1 + x*3);
+		if(x+1 < width)
+		{
+			pixel(y0[x+1], ruv, guv, buv, bgr0 + x*3 + 3);
+			pixel(y1[x+1], ruv, guv, buv, bgr1 + x*3 + 3);
+		}
+	}
+}
+
+// Two luma rows and their chroma row to one row at half resolution
+void convertRowsDecimated(
+		const unsigned char * y0, const unsigned char * y1, const unsigned char * uv,
+		int width, int uIndex,
+		unsigned char * bgr)
+{
+	int x = 0;
+#ifdef YUV_TO_BGR_NEON
+	for(; x+8<=width; x+=8)
+	{
+		const uint8x8x2_t c = vld2_u8(uv + x*2);
+		const ChromaTerms terms = chromaNeon(c.val[uIndex], c.val[1-uIndex]);
+		const uint8x8x2_t a = vld2_u8(y0 + x*2);
+		const uint8x8x2_t b = vld2_u8(y1 + x*2);
+		const uint16x8_t sum = vaddq_u16(vaddl_u8(a.val[0], a.val[1]), vaddl_u8(b.val[0], b.val[1]));
+		vst3_u8(bgr + x*3, pixelsNeon(vrshrq_n_u16(sum, 2), terms));
+	}
+#endif
+	for(; x<width; ++x)
+	{
+		int ruv, guv, buv;
+		chroma(uv + x*2, uIndex, ruv, guv, buv);
+		const int mean = (int(y0[x*2]) + int(y0[x*2+1]) + int(y1[x*2]) + int(y1[x*2+1]) + 2) >> 2;
+		pixel(mean, ruv, guv, buv, bgr + x*3);
+	}
+}
+
+} // namespace
+
+void YuvToBgr::convert(
+		const unsigned char * y, int yRowStride,
+		const unsigned char * uv, int uvRowStride,
+		int width, int height,
+		ChromaOrder order,
+		int decimation,
+		cv::Mat & bgr)
+{
+	UASSERT(decimation == 1 || decimation == 2);
+	const int rows = height / decimation;
+	const int cols = width / decimation;
+	rtabmap::createUnshared(bgr, rows, cols, CV_8UC3);
+	convert(y, yRowStride, uv, uvRowStride, width, height, order, decimation, bgr.data, (int)bgr.step);
+}
+
+void YuvToBgr::convert(
+		const unsigned char * y, int yRowStride,
+		const unsigned char * uv, int uvRowStride,
+		int width, int height,
+		ChromaOrder order,
+		int decimation,
+		unsigned char * bgr, int bgrRowStride)
+{
+	UASSERT(y && uv && bgr && width > 0 && height > 0);
+	UASSERT(decimation == 1 || decimation == 2);
+	const int uIndex = order == kNV12?0:1;
+	if(decimation == 2)
+	{
+		for(int r=0; r<height/2; ++r)
+		{
+			convertRowsDecimated(
+					y + (2*r)*yRowStride, y + (2*r+1)*yRowStride, uv + r*uvRowStride,
+					width/2, uIndex,
+					bgr + r*bgrRowStride);
+		}
+	}
+	else
+	{
+		for(int r=0; r+1<height; r+=2)
+		{
+			convertRows(
+					y + r*yRowStride, y + (r+1)*yRowStride, uv + (r/2)*uvRowStride,
+					width, uIndex,
+					bgr + r*bgrRowStride, bgr + (r+1)*bgrRowStride);
+		}
+		if(height % 2)
+		{
+			const int r = height-1;
+			convertRows(
+					y + r*yRowStride, y + r*yRowStride, uv + (r/2)*uvRowStride,
+					width, uIndex,
+					bgr + r*bgrRowStride, bgr + r*bgrRowStride);
+		}
+	}
+}
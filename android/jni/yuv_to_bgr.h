@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#ifndef YUV_TO_BGR_H_
+#define YUV_TO_BGR_H_
+
+#include <opencv2/core/core.hpp>
+
+// Conversion of semi-planar YUV 4:2:0 camera images (a full resolution luma
+// plane and an interleaved 2x2 subsampled chroma plane) to BGR, with the same
+// BT.601 fixed-point coefficients as cv::cvtColor(). The planes are read in
+// place with their row strides, so they don't need to be contiguous in
+// memory. With decimation 2, each output pixel is computed in the same pass
+// from the mean of its 2x2 luma block and its chroma sample (the full
+// resolution image is never created).
+class YuvToBgr {
+public:
+	enum ChromaOrder {
+		kNV21, // V first (Android)
+		kNV12  // U first (iOS)
+	};
+
+	// decimation: 1 or 2. The output is reused if it has the right size and
+	// type and its data is not shared (e.g., with a SensorData still in use),
+	// otherwise it is reallocated.
+	static void convert(
+			const unsigned char * y, int yRowStride,
+			const unsigned char * uv, int uvRowStride,
+			int width, int height,
+			ChromaOrder order,
+			int decimation,
+			cv::Mat & bgr);
+
+	// Same in a buffer of (height/decimation) rows of (width/decimation)
+	// BGR pixels.
+	static void convert(
+			const unsigned char * y, int yRowStride,
+			const unsigned char * uv, int uvRowStride,
+			int width, int height,
+			ChromaOrder order,
+			int decimation,
+			unsigned char * bgr, int bgrRowStride);
+};
+
+#endif /* YUV_TO_BGR_H_ */
@@ -46,6 +46,30 @@ void setupCallbacksNative(const void *object, void * classPtr,
     }
 }
 
+void setupVolumeCallbackNative(const void *object, void(*volumeCallback)(void *, double))
+{
+    if(object)
+    {
+        native(object)->setupSwiftVolumeCallback(volumeCallback);
+    }
+    else
+    {
+        UERROR("object is null!");
+    }
+}
+
+void setupVolumeRefinedCallbackNative(const void *object, void(*volumeRefinedCallback)(void *, double, double))
+{
+    if(object)
+    {
+        native(object)->setupSwiftVolumeRefinedCallback(volumeRefinedCallback);
+    }
+    else
+    {
+        UERROR("object is null!");
+    }
+}
+
 void destroyNativeApplication(const void *object)
 {
     if(object)
@@ -633,6 +657,217 @@ double calculateMeshVolumeNative(const void* object) {
     }
 }
 
+double calculateMeshVolumePreviewNative(const void* object) {
+    if (object) {
+        return native(object)->calculateMeshVolumePreview();
+    } else {
+        UERROR("object is null!");
+        return -1.0;
+    }
+}
+
+double calculateOptimizedMeshVolumeNative(const void* object) {
+    if (object) {
+        return native(object)->calculateOptimizedMeshVolume();
+    } else {
+        UERROR("object is null!");
+        return -1.0;
+    }
+}
+
+void setVolumeModeNative(const void *object, int mode, float heightMapCellSize) {
+    if(object) {
+        native(object)->setVolumeMode(mode, heightMapCellSize);
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+void setOnlineHeightMapNative(const void *object, bool enabled, float cellSize) {
+    if(object) {
+        native(object)->setOnlineHeightMap(enabled, cellSize);
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+double getOnlineVolumeNative(const void *object) {
+    if(object) {
+        return native(object)->getOnlineVolume();
+    } else {
+        UERROR("object is null!");
+        return -1.0;
+    }
+}
+
+void setCropPreviewNative(const void *object, bool enabled) {
+    if(object) {
+        native(object)->setCropPreview(enabled);
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+void commitCropNative(const void *object) {
+    if(object) {
+        native(object)->commitCrop();
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+void undoCropNative(const void *object) {
+    if(object) {
+        native(object)->undoCrop();
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+void redoCropNative(const void *object) {
+    if(object) {
+        native(object)->redoCrop();
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+bool addRoiNative(const void *object, const char * name) {
+    if(object) {
+        return native(object)->addRoi(name);
+    } else {
+        UERROR("object is null!");
+    }
+    return false;
+}
+
+void removeRoiNative(const void *object, const char * name) {
+    if(object) {
+        native(object)->removeRoi(name);
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+void getRoiVolumesNative(const void *object, const char ** names, int count, double * volumes) {
+    if(object) {
+        std::vector<double> v = native(object)->getRoiVolumes(std::vector<std::string>(names, names+count));
+        std::copy(v.begin(), v.end(), volumes);
+    } else {
+        UERROR("object is null!");
+        std::fill(volumes, volumes+count, -1.0);
+    }
+}
+
+void setPileSeparationNative(const void *object, bool enabled, int minTriangles, float weldDistance) {
+    if(object) {
+        native(object)->setPileSeparation(enabled, minTriangles, weldDistance);
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+void setVolumeCappingNative(const void *object, bool enabled) {
+    if(object) {
+        native(object)->setVolumeCapping(enabled);
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+// primitives: see RTABMapApp::setCropRegion()
+bool setCropRegionNative(const void *object, const float * primitives, int size) {
+    if(object) {
+        return native(object)->setCropRegion(std::vector<float>(primitives, primitives+size));
+    } else {
+        UERROR("object is null!");
+    }
+    return false;
+}
+
+// values: volume, footprint and height of each pile, returns the number of piles
+int getPilesNative(const void *object, double * values, int maxPiles) {
+    if(object) {
+        std::vector<double> v = native(object)->getPiles();
+        int piles = std::min((int)v.size()/3, maxPiles);
+        std::copy(v.begin(), v.begin()+piles*3, values);
+        return piles;
+    } else {
+        UERROR("object is null!");
+    }
+    return 0;
+}
+
+// values: cut, fill, net, area and alignment error
+bool computeCutFillNative(const void *object, const char * databaseBefore, const char * databaseAfter, float cellSize, double * values) {
+    if(object) {
+        std::vector<double> v = native(object)->computeCutFill(databaseBefore, databaseAfter, cellSize);
+        std::copy(v.begin(), v.end(), values);
+        return !v.empty();
+    } else {
+        UERROR("object is null!");
+    }
+    return false;
+}
+
+void clearCutFillNative(const void *object) {
+    if(object) {
+        native(object)->clearCutFill();
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+void setGroundReferenceNative(const void *object, float band, float inlierDistance, bool quadratic) {
+    if(object) {
+        native(object)->setGroundReference(band, inlierDistance, quadratic);
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+// planes: x, y, z, qx, qy, qz, qw, n, then n boundary points (x, z) per
+// plane, in ARKit world
+void setDetectedPlanesNative(const void *object, const float * planes, int count) {
+    if(object) {
+        std::vector<rtabmap::CameraMobile::DetectedPlane> detected(count);
+        for(int i=0; i<count; ++i) {
+            int n = (int)planes[7];
+            detected[i] = rtabmap::CameraMobile::detectedPlaneFromOpenGL(
+                rtabmap::Transform(planes[0], planes[1], planes[2], planes[3], planes[4], planes[5], planes[6]),
+                planes+8,
+                n);
+            planes += 8 + n*2;
+        }
+        native(object)->setDetectedPlanes(detected);
+    } else {
+        UERROR("object is null!");
+    }
+}
+
+// values: mean, standard deviation, 5th, 50th and 95th percentiles
+bool estimateVolumeUncertaintyNative(const void *object, int samples, float referenceSigma, double * values) {
+    if(object) {
+        std::vector<double> v = native(object)->estimateVolumeUncertainty(samples, referenceSigma);
+        std::copy(v.begin(), v.end(), values);
+        return !v.empty();
+    } else {
+        UERROR("object is null!");
+    }
+    return false;
+}
+
+bool solveVolumeNative(const void *object, const char * roi, float tolerance, float minCellSize, float maxCellSize, double * values) {
+    if(object) {
+        std::vector<double> v = native(object)->solveVolume(roi?roi:"", tolerance, minCellSize, maxCellSize);
+        std::copy(v.begin(), v.end(), values);
+        return !v.empty();
+    } else {
+        UERROR("object is null!");
+    }
+    return false;
+}
+
 void removePointNative(const void *object) {
     if(object) {
         native(object)->removePointNative();
@@ -31,6 +31,8 @@ void setupCallbacksNative(const void *object, void * classPtr,
                                                    int, int,
                                                    float, float, float, float, float, float),
                           void(*cameraInfoEventCallback)(void *, int, const char*, const char*));
+void setupVolumeCallbackNative(const void *object, void(*volumeCallback)(void *, double));
+void setupVolumeRefinedCallbackNative(const void *object, void(*volumeRefinedCallback)(void *, double, double));
 void destroyNativeApplication(const void *object);
 void setScreenRotationNative(const void *object, int displayRotation);
 int openDatabaseNative(const void *object, const char * databasePath, bool databaseInMemory, bool optimize, bool clearDatabase);
@@ -132,6 +134,28 @@ void setGPSNative(const void *object, double stamp, double longitude, double lat
 void addEnvSensorNative(const void *object, int type, float value);
 //추가됨
 double calculateMeshVolumeNative(const void* object);
+double calculateMeshVolumePreviewNative(const void* object);
+double calculateOptimizedMeshVolumeNative(const void* object);
+void setVolumeModeNative(const void* object, int mode, float heightMapCellSize);
+void setOnlineHeightMapNative(const void* object, bool enabled, float cellSize);
+double getOnlineVolumeNative(const void* object);
+void setCropPreviewNative(const void* object, bool enabled);
+void commitCropNative(const void* object);
+void undoCropNative(const void* object);
+void redoCropNative(const void* object);
+bool addRoiNative(const void* object, const char * name);
+void removeRoiNative(const void* object, const char * name);
+void getRoiVolumesNative(const void* object, const char ** names, int count, double * volumes);
+void setPileSeparationNative(const void* object, bool enabled, int minTriangles, float weldDistance);
+int getPilesNative(const void* object, double * values, int maxPiles);
+void setVolumeCappingNative(const void* object, bool enabled);
+bool setCropRegionNative(const void* object, const float * primitives, int size);
+bool computeCutFillNative(const void* object, const char * databaseBefore, const char * databaseAfter, float cellSize, double * values);
+void clearCutFillNative(const void* object);
+bool estimateVolumeUncertaintyNative(const void* object, int samples, float referenceSigma, double * values);
+bool solveVolumeNative(const void* object, const char * roi, float tolerance, float minCellSize, float maxCellSize, double * values);
+void setGroundReferenceNative(const void* object, float band, float inlierDistance, bool quadratic);
+void setDetectedPlanesNative(const void* object, const float * planes, int count);
 void removePointNative(const void* object);
 
 #ifdef __cplusplus
@@ -105,6 +105,32 @@ class RTABMap {
                     observer.cameraInfoEventReceived(mySelf, type: Int(type), key: strKey, value: strValue)
                 }
              })
+        
+        setupVolumeCallbackNative(native_rtabmap,
+             //volumeCallback, called when the cropped mesh volume has been recomputed
+             {(observer, volume) -> Void in
+                let mySelf = Unmanaged<RTABMap>.fromOpaque(observer!).takeUnretainedValue()
+                for (id, observation) in mySelf.observations {
+                    guard let observer = observation.observer else {
+                        mySelf.observations.removeValue(forKey: id)
+                        continue
+                    }
+                    observer.volumeUpdated(mySelf, volume: volume)
+                }
+             })
+        
+        setupVolumeRefinedCallbackNative(native_rtabmap,
+             //volumeRefinedCallback, called when the full resolution volume replaces the low resolution one
+             {(observer, volume, delta) -> Void in
+                let mySelf = Unmanaged<RTABMap>.fromOpaque(observer!).takeUnretainedValue()
+                for (id, observation) in mySelf.observations {
+                    guard let observer = observation.observer else {
+                        mySelf.observations.removeValue(forKey: id)
+                        continue
+                    }
+                    observer.volumeRefined(mySelf, volume: volume, delta: delta)
+                }
+             })
     }
     
     deinit {
@@ -164,6 +190,178 @@ class RTABMap {
         return calculateMeshVolumeNative(native_rtabmap)
     }
     
+    // Volume of the low resolution crop if the full resolution one is not
+    // ready yet, refined later through volumeRefined()
+    func calculateMeshVolumePreview() -> Double {
+        return calculateMeshVolumePreviewNative(native_rtabmap)
+    }
+    
+    // Enclosed volume of the optimized (exported) mesh, -1 if there is none
+    func calculateOptimizedMeshVolume() -> Double {
+        return calculateOptimizedMeshVolumeNative(native_rtabmap)
+    }
+    
+    // mode: 0=surface, 1=height map
+    func setVolumeMode(mode: Int, heightMapCellSize: Float = 0.02) {
+        setVolumeModeNative(native_rtabmap, Int32(mode), heightMapCellSize)
+    }
+    
+    // Height map accumulated from the depth frames while scanning
+    func setOnlineHeightMap(enabled: Bool, cellSize: Float = 0.05) {
+        setOnlineHeightMapNative(native_rtabmap, enabled, cellSize)
+    }
+    
+    // Volume inside the closed marker polygon, -1 if not available
+    func getOnlineVolume() -> Double {
+        return getOnlineVolumeNative(native_rtabmap)
+    }
+    
+    // While markers are edited, the crop is previewed until committed
+    func setCropPreview(enabled: Bool) {
+        setCropPreviewNative(native_rtabmap, enabled)
+    }
+    
+    func commitCrop() {
+        commitCropNative(native_rtabmap)
+    }
+    
+    // Switch between the last crops
+    func undoCrop() {
+        undoCropNative(native_rtabmap)
+    }
+    
+    func redoCrop() {
+        redoCropNative(native_rtabmap)
+    }
+    
+    func addRoi(name: String) -> Bool {
+        return addRoiNative(native_rtabmap, name)
+    }
+    
+    func removeRoi(name: String) {
+        removeRoiNative(native_rtabmap, name)
+    }
+    
+    // Volumes (m^3) of the ROIs, -1 for unknown ROIs
+    func getRoiVolumes(names: [String]) -> [Double] {
+        var cNames: [UnsafePointer<CChar>?] = names.map { UnsafePointer(strdup($0)) }
+        defer { cNames.forEach { free(UnsafeMutablePointer(mutating: $0)) } }
+        var volumes = [Double](repeating: -1.0, count: names.count)
+        getRoiVolumesNative(native_rtabmap, &cNames, Int32(names.count), &volumes)
+        return volumes
+    }
+    
+    func setPileSeparation(enabled: Bool, minTriangles: Int = 100, weldDistance: Float = 0.02) {
+        setPileSeparationNative(native_rtabmap, enabled, Int32(minTriangles), weldDistance)
+    }
+    
+    // Close the cropped meshes down to the ground before measuring (enabled by default)
+    func setVolumeCapping(enabled: Bool) {
+        setVolumeCappingNative(native_rtabmap, enabled)
+    }
+    
+    // Crop primitives intersected with the marker polygon (scene frame), see RTABMapApp::setCropRegion()
+    enum CropPrimitive {
+        case box(pose: simd_float4x4, size: SIMD3<Float>, inverted: Bool)
+        case prism(polygon: [SIMD2<Float>], floor: Float, ceiling: Float, inverted: Bool)
+        case halfSpace(point: SIMD3<Float>, normal: SIMD3<Float>, inverted: Bool)
+    }
+    
+    @discardableResult
+    func setCropRegion(primitives: [CropPrimitive]) -> Bool {
+        var data: [Float] = []
+        for primitive in primitives {
+            switch primitive {
+            case let .box(pose, size, inverted):
+                let rotation = GLKMatrix3(
+                    m: (pose[0,0], pose[0,1], pose[0,2],
+                        pose[1,0], pose[1,1], pose[1,2],
+                        pose[2,0], pose[2,1], pose[2,2]))
+                let quat = GLKQuaternionMakeWithMatrix3(rotation)
+                data += [0, inverted ? 1 : 0, pose[3,0], pose[3,1], pose[3,2], quat.x, quat.y, quat.z, quat.w, size.x, size.y, size.z]
+            case let .prism(polygon, floor, ceiling, inverted):
+                data += [1, inverted ? 1 : 0, floor, ceiling, Float(polygon.count)]
+                for v in polygon {
+                    data += [v.x, v.y]
+                }
+            case let .halfSpace(point, normal, inverted):
+                data += [2, inverted ? 1 : 0, point.x, point.y, point.z, normal.x, normal.y, normal.z]
+            }
+        }
+        return setCropRegionNative(native_rtabmap, data, Int32(data.count))
+    }
+    
+    // Volume (m^3), footprint (m^2) and height (m) of each pile of the last crop
+    func getPiles(maxPiles: Int = 64) -> [(volume: Double, footprint: Double, height: Double)] {
+        var values = [Double](repeating: 0.0, count: maxPiles*3)
+        let count = Int(getPilesNative(native_rtabmap, &values, Int32(maxPiles)))
+        return (0..<count).map { (values[$0*3], values[$0*3+1], values[$0*3+2]) }
+    }
+    
+    // Cut, fill and net volumes (m^3) between two sessions, nil on failure
+    func computeCutFill(databaseBefore: String, databaseAfter: String, cellSize: Float = 0.05) -> (cut: Double, fill: Double, net: Double, area: Double, rmse: Double)? {
+        var values = [Double](repeating: 0.0, count: 5)
+        if !computeCutFillNative(native_rtabmap, databaseBefore, databaseAfter, cellSize, &values) {
+            return nil
+        }
+        return (values[0], values[1], values[2], values[3], values[4])
+    }
+    
+    func clearCutFill() {
+        clearCutFillNative(native_rtabmap)
+    }
+    
+    func setGroundReference(band: Float = 0.2, inlierDistance: Float = 0.02, quadratic: Bool = false) {
+        setGroundReferenceNative(native_rtabmap, band, inlierDistance, quadratic)
+    }
+    
+    // Horizontal planes of the session, seeds of the ground reference
+    func setDetectedPlanes(anchors: [ARAnchor]) {
+        var data: [Float] = []
+        var count = 0
+        for anchor in anchors {
+            guard let plane = anchor as? ARPlaneAnchor, plane.alignment == .horizontal else {
+                continue
+            }
+            if ARPlaneAnchor.isClassificationSupported && plane.classification == .ceiling {
+                continue
+            }
+            let pose = plane.transform
+            let rotation = GLKMatrix3(
+                m: (pose[0,0], pose[0,1], pose[0,2],
+                    pose[1,0], pose[1,1], pose[1,2],
+                    pose[2,0], pose[2,1], pose[2,2]))
+            let quat = GLKQuaternionMakeWithMatrix3(rotation)
+            let boundary = plane.geometry.boundaryVertices
+            data += [pose[3,0], pose[3,1], pose[3,2], quat.x, quat.y, quat.z, quat.w, Float(boundary.count)]
+            for v in boundary {
+                data += [v.x, v.z]
+            }
+            count += 1
+        }
+        setDetectedPlanesNative(native_rtabmap, data, Int32(count))
+    }
+    
+    // Monte Carlo uncertainty of the cropped volume (m^3), nil if the crop is not ready
+    func estimateVolumeUncertainty(samples: Int = 100, referenceSigma: Float = 0.02) -> (mean: Double, stdDev: Double, p5: Double, p50: Double, p95: Double)? {
+        var values = [Double](repeating: 0.0, count: 5)
+        if !estimateVolumeUncertaintyNative(native_rtabmap, Int32(samples), referenceSigma, &values) {
+            return nil
+        }
+        return (values[0], values[1], values[2], values[3], values[4])
+    }
+    
+    // Adaptive resolution volume (m^3) of a ROI (empty name for the marker polygon): the
+    // cell size is halved from maxCellSize until two volumes differ by less than
+    // tolerance (relative). nil if the ROI doesn't exist.
+    func solveVolume(roi: String = "", tolerance: Float = 0.01, minCellSize: Float = 0.01, maxCellSize: Float = 0.32) -> (volume: Double, cellSize: Float, iterations: Int, difference: Double, converged: Bool)? {
+        var values = [Double](repeating: 0.0, count: 5)
+        if !solveVolumeNative(native_rtabmap, roi, tolerance, minCellSize, maxCellSize, &values) {
+            return nil
+        }
+        return (values[0], Float(values[1]), Int(values[2]), values[3], values[4] != 0.0)
+    }
+    
     func exportMesh(
         cloudVoxelSize: Float,
         regenerateCloud: Bool,
@@ -556,6 +754,13 @@ protocol RTABMapObserver: class {
                       pitch: Float,
                       yaw: Float)
     func cameraInfoEventReceived(_ rtabmap: RTABMap, type: Int, key: String, value: String)
+    func volumeUpdated(_ rtabmap: RTABMap, volume: Double)
+    func volumeRefined(_ rtabmap: RTABMap, volume: Double, delta: Double)
+}
+
+extension RTABMapObserver {
+    func volumeUpdated(_ rtabmap: RTABMap, volume: Double) {}
+    func volumeRefined(_ rtabmap: RTABMap, volume: Double, delta: Double) {}
 }
 
 extension String {
@@ -528,6 +528,9 @@ class ViewController: GLKViewController, ARSessionDelegate, RTABMapObserver, UIP
                     configuration.frameSemantics = .sceneDepth
                 }
                 
+                // Horizontal planes seed the ground reference of the volumes
+                configuration.planeDetection = .horizontal
+                
                 session.run(configuration, options: [.resetSceneReconstruction, .resetTracking, .removeExistingAnchors])
                 
                 switch mState {
@@ -1040,6 +1043,25 @@ class ViewController: GLKViewController, ARSessionDelegate, RTABMapObserver, UIP
         }
     }
     
+    // Plane anchors changed, all planes are sent again
+    func session(_ session: ARSession, didAdd anchors: [ARAnchor]) {
+        updateDetectedPlanes(session)
+    }
+    
+    func session(_ session: ARSession, didUpdate anchors: [ARAnchor]) {
+        updateDetectedPlanes(session)
+    }
+    
+    func session(_ session: ARSession, didRemove anchors: [ARAnchor]) {
+        updateDetectedPlanes(session)
+    }
+    
+    func updateDetectedPlanes(_ session: ARSession) {
+        if let anchors = session.currentFrame?.anchors {
+            rtabmap?.setDetectedPlanes(anchors: anchors)
+        }
+    }
+    
     // This is called when a session fails.
     func session(_ session: ARSession, didFailWithError error: Error) {
         // Present an error message to the user.
@@ -3265,8 +3265,14 @@ class ViewController: GLKViewController, ARSessionDelegate, RTABMapObserver, UIP
     
     @IBAction func editsaveButtonTapped(_ sender: UIButton) {
         //Volume Calculation
+        let volume = rtabmap!.calculateMeshVolume()
+        if volume < 0 {
+            // no volume for the current polygon (not closed or not cropped yet)
+            self.showToast(message: "The volume is not available yet, close the polygon and try again.", seconds: 2)
+            return
+        }
         self.showToast(message: "The volume has been calculated.", seconds: 2)
-        let showvolume = round(1000 * rtabmap!.calculateMeshVolume()) / 1000
+        let showvolume = round(1000 * volume) / 1000
         self.titleContent.text = "Volume : \(showvolume) m³"
         
         // Update the CSV with the new volume